@@ -0,0 +1,40 @@
+#pragma once
+
+// Shared helpers for the microbenchmarks
+
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+// the optimizer can't drop work whose result ends up here
+inline volatile uint64_t gBenchSink = 0;
+
+// runs fn() iterations times after a short warm up and returns the mean ns per call
+template <typename Fn>
+double TimeIt(size_t iterations, Fn&& fn) {
+    for (size_t i = 0; i < iterations / 10; i++)
+        fn();
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        fn();
+    const auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(iterations);
+}
+
+// one line per result so the output is easy to diff or paste into a spreadsheet
+inline void Report(const char* bench, const char* variant, double ns_per_op) {
+    printf("%-12s %-36s %10.2f ns/op\n", bench, variant, ns_per_op);
+}
+
+inline void ReportSpeedup(const char* bench, const char* what, double before, double after) {
+    printf("%-12s %-36s %10.2fx\n", bench, what, after > 0 ? before / after : 0.0);
+}
+
+// each benchmark lives in its own BenchXxx.cpp
+void BenchRand();
+void BenchSimd();
+void BenchCrc();
+void BenchFuzz();
+void BenchSchedule();
@@ -0,0 +1,84 @@
+// Checks every CRC32 implementation the CPU can run against the bytewise reference, then times them
+// The check covers the known "123456789" vector, random lengths, and the same data fed in two
+// pieces through the incremental update(), which is how the proxy uses it.
+
+#include <vector>
+#include <string>
+
+#include "Bench.h"
+#include "crc32.h"
+#include "rand.h"
+
+namespace {
+
+    constexpr crc32::Impl kImpls[] = { crc32::Impl::Bytewise, crc32::Impl::Slicing8, crc32::Impl::Clmul, crc32::Impl::Armv8 };
+    constexpr size_t kSizes[] = { 64, 256, 1024, 4096, 64 * 1024, 1024 * 1024 };
+
+    // returns the number of mismatches against the bytewise reference
+    size_t Verify(crc32::Impl impl) {
+        size_t mismatches{};
+
+        uint32_t check{};
+        const char vector[] = "123456789";
+        crc32::update(impl, check, gsl::span<const char>(vector, 9));
+        if (check != 0xCBF43926)
+            mismatches++;
+
+        RandomNumberGenerator rng(7);
+        for (size_t i = 0; i < 2000; i++) {
+            const size_t len = rng.range(0, 5000).generate();
+            std::vector<char> buf(len);
+            rng.fill(reinterpret_cast<unsigned char*>(buf.data()), len);
+
+            uint32_t expected{};
+            crc32::update(crc32::Impl::Bytewise, expected, buf);
+
+            uint32_t whole{};
+            crc32::update(impl, whole, buf);
+
+            const size_t split = len ? rng.range(0, gsl::narrow_cast<unsigned int>(len)).generate() : 0;
+            uint32_t pieces{};
+            crc32::update(impl, pieces, gsl::span<const char>(buf.data(), split));
+            crc32::update(impl, pieces, gsl::span<const char>(buf.data() + split, len - split));
+
+            if (whole != expected || pieces != expected)
+                mismatches++;
+        }
+
+        return mismatches;
+    }
+}
+
+void BenchCrc() {
+    printf("%-12s crc32 uses %s on this CPU\n", "crc", crc32::Name(crc32::Best()));
+
+    bool failed = false;
+    for (const auto impl : kImpls) {
+        uint32_t probe{};
+        if (!crc32::update(impl, probe, {}))
+            continue;
+
+        const size_t bad = Verify(impl);
+        failed |= bad != 0;
+
+        for (const auto size : kSizes) {
+            std::vector<char> buffer(size);
+            RandomNumberGenerator(size).fill(reinterpret_cast<unsigned char*>(buffer.data()), size);
+
+            // roughly 256MB per measurement whatever the size
+            const size_t iterations = (std::max)(size_t{ 16 }, (256u << 20) / size);
+            uint32_t crc{};
+            const double ns = TimeIt(iterations, [&] {
+                crc32::update(impl, crc, buffer);
+            });
+            gBenchSink = gBenchSink + crc;
+
+            const std::string variant = std::string(crc32::Name(impl)) + " " + std::to_string(size) + " bytes";
+            printf("%-12s %-36s %10.2f GB/s %s\n", "crc", variant.c_str(),
+                ns > 0 ? static_cast<double>(size) / ns : 0.0, bad ? "MISMATCH" : "ok");
+        }
+    }
+
+    if (failed)
+        printf("%-12s crc32 implementations do not match the reference\n", "crc");
+}
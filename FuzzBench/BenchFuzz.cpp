@@ -0,0 +1,160 @@
+// Times Fuzz() and each of its mutations on its own, for every fuzz type and a range of buffer sizes
+// Every mutation runs over the whole buffer with a fixed seed, and the cost of putting the buffer
+// back between calls is measured separately and taken off, so ns/byte is the mutation alone.
+// allocs/call counts operator new calls, a mutation that should work in place but shows one here
+// is copying something it doesn't need to.
+// Grow leaves what it inserts to one side the way the proxy sends it, so its cost is the insert's.
+// The text types load the naughty_*.txt lists from the current directory, like the proxy does,
+// run from the TcpProxyFuzzer directory or NaughtyWord and Grow have nothing to insert.
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <format>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Bench.h"
+#include "Fuzz.h"
+#include "Corpus.h"
+#include "Logger.h"
+
+// Fuzz.cpp logs through this, it's never started so nothing is written
+Logger gLog("benchlog");
+
+namespace {
+    std::atomic<size_t> gAllocations{ 0 };
+}
+
+// counts every allocation in the process, the benchmarks are single threaded so the
+// difference across a loop is what that loop allocated
+void* operator new(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+
+    constexpr char kFuzzTypes[] = { 'b', 't', 'x', 'j', 'h' };
+    constexpr size_t kSizes[] = { MIN_BUFF_LEN, 64, 256, 1024, 4096, 64 * 1024, 1024 * 1024 };
+
+    // roughly 32MB through the mutation per measurement whatever the size
+    size_t Iterations(size_t size) noexcept {
+        return (std::max)(size_t{ 16 }, (32u << 20) / size);
+    }
+
+    // mostly letters with a few digits, so the text mutations have something to work on
+    std::vector<char> MakeInput(size_t size) {
+        std::vector<char> input(size);
+        for (size_t i = 0; i < size; i++)
+            input[i] = i % 16 == 15 ? static_cast<char>('0' + i % 10) : static_cast<char>('a' + i % 26);
+
+        return input;
+    }
+
+    struct Measurement {
+        double ns_per_call;
+        double allocs_per_call;
+    };
+
+    // times fn() after putting the buffer back to the input, then takes off what the put back costs
+    // the buffer keeps its capacity, so Grow only allocates when it goes past anything it reached before
+    template <typename Fn>
+    Measurement Measure(const std::vector<char>& input, std::vector<char>& buffer, size_t iterations, Fn&& fn) {
+        const double reset = TimeIt(iterations, [&] {
+            buffer.assign(input.begin(), input.end());
+            gBenchSink = gBenchSink + buffer.size();
+        });
+
+        const size_t before = gAllocations.load(std::memory_order_relaxed);
+        const double total = TimeIt(iterations, [&] {
+            buffer.assign(input.begin(), input.end());
+            fn();
+            gBenchSink = gBenchSink + buffer.size();
+        });
+        const size_t allocs = gAllocations.load(std::memory_order_relaxed) - before;
+
+        // TimeIt() runs a tenth as many again to warm up
+        const size_t calls = iterations + iterations / 10;
+        return { (std::max)(0.0, total - reset), static_cast<double>(allocs) / static_cast<double>(calls) };
+    }
+
+    void Print(const std::string& variant, size_t size, const Measurement& m) {
+        printf("%-12s %-36s %10.3f ns/byte %8.2f allocs/call\n", "fuzz", variant.c_str(),
+            m.ns_per_call / static_cast<double>(size), m.allocs_per_call);
+    }
+}
+
+void BenchFuzz() {
+    // the per-mutation codes on stderr would swamp the results
+    SetFuzzTrace(false);
+    LoadNaughtyCorpus();
+
+    for (const char fuzz_type : kFuzzTypes) {
+        for (const auto size : kSizes) {
+            const std::vector<char> input = MakeInput(size);
+            std::vector<char> buffer{};
+            FuzzInsert insert{};
+            const size_t iterations = Iterations(size);
+
+            // a fixed seed per mutation and size, so the numbers compare between builds
+            for (uint32_t m = 1; m < static_cast<uint32_t>(FuzzMutation::Max); m++) {
+                const auto mutation = static_cast<FuzzMutation>(m);
+                RandomNumberGenerator rng(size * 131 + m);
+                ScopedFuzzRng scoped(rng);
+
+                const Measurement result = Measure(input, buffer, iterations, [&] {
+                    FuzzMutate(buffer, insert, mutation, 0, buffer.size(), 1, fuzz_type);
+                });
+
+                Print(std::format("{} {} {}", fuzz_type, FuzzMutationName(mutation), size), size, result);
+            }
+
+            // the whole thing as the proxy calls it, every chunk fuzzed
+            // Fuzz() keeps its mutations inside the buffer, so nothing should throw, a throw is a bug
+            // the proxy would die of, so any are counted and reported rather than timed as if they were work
+            RandomNumberGenerator rng(size * 131);
+            ScopedFuzzRng scoped(rng);
+            size_t throws = 0;
+
+            const Measurement result = Measure(input, buffer, iterations, [&] {
+                try {
+                    Fuzz(buffer, insert, 100, fuzz_type, 0);
+                }
+                catch (const std::exception&) {
+                    throws++;
+                }
+            });
+
+            const std::string variant = std::format("{} Fuzz() {}", fuzz_type, size);
+            Print(variant, size, result);
+            if (throws)
+                printf("%-12s %-36s %10zu calls threw, the timing above is wrong\n", "fuzz", variant.c_str(), throws);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+// Compares the RNG Fuzz() uses now with the one it used to use:
+// a shared mt19937 behind a uniform_int_distribution whose params were rebuilt on every range() call
+
+#include <random>
+#include <vector>
+
+#include "Bench.h"
+#include "rand.h"
+
+namespace {
+
+    // the previous RandomNumberGenerator, kept here only as the baseline
+    class LegacyRandomNumberGenerator {
+    public:
+        LegacyRandomNumberGenerator()
+            : gen(rd()), dist(0, std::numeric_limits<unsigned int>::max()) {
+        }
+
+        auto generate() {
+            return dist(gen);
+        }
+
+        auto generateChar() {
+            return gsl::narrow_cast<unsigned char>(generateInRange(0, 256));
+        }
+
+        LegacyRandomNumberGenerator& range(unsigned int min, unsigned int max) noexcept {
+            dist.param(std::uniform_int_distribution<unsigned int>::param_type(min, max - 1));
+            return *this;
+        }
+
+    private:
+        std::random_device rd;
+        std::mt19937 gen;
+        std::uniform_int_distribution<unsigned int> dist;
+
+        unsigned int generateInRange(unsigned int min, unsigned int max) {
+            const std::uniform_int_distribution<unsigned int>::param_type newRange(min, max - 1);
+            dist.param(newRange);
+            return dist(gen);
+        }
+    };
+
+    constexpr size_t kCalls = 10'000'000;
+    constexpr size_t kBufferSize = 4096;
+
+    // the range changes on every call, like it does in Fuzz()
+    template <typename Rng>
+    double Ranges(Rng& rng) {
+        unsigned int max = 7;
+        return TimeIt(kCalls, [&] {
+            gBenchSink = gBenchSink + rng.range(0, max).generate();
+            max = max * 3 % 4093 + 2;
+        });
+    }
+
+    // RndByteMultiple with skip 1, one generateChar() per byte of a full buffer
+    template <typename Rng>
+    double Fill(Rng& rng) {
+        std::vector<char> buffer(kBufferSize);
+        const double ns = TimeIt(kCalls / kBufferSize * 10, [&] {
+            for (auto& b : buffer)
+                b = static_cast<char>(rng.generateChar());
+            gBenchSink = gBenchSink + static_cast<unsigned char>(buffer.front());
+        });
+
+        return ns / kBufferSize;
+    }
+
+    // a quick sanity check that the bounded sampling is not skewed
+    // returns chi-squared divided by its degrees of freedom, a fair generator lands close to 1.0
+    double ChiSquaredPerDof(RandomNumberGenerator& rng, unsigned int span) {
+        std::vector<size_t> buckets(span);
+        constexpr size_t samples = 6'000'000;
+        for (size_t i = 0; i < samples; i++)
+            buckets.at(rng.range(0, span).generate())++;
+
+        const double expected = static_cast<double>(samples) / span;
+        double chi2 = 0;
+        for (const auto n : buckets)
+            chi2 += (static_cast<double>(n) - expected) * (static_cast<double>(n) - expected) / expected;
+
+        return chi2 / (span - 1);
+    }
+}
+
+void BenchRand() {
+    LegacyRandomNumberGenerator legacy{};
+    RandomNumberGenerator rng{};
+
+    const double legacyRange = Ranges(legacy);
+    const double newRange = Ranges(rng);
+    Report("rand", "range(0,n).generate() mt19937", legacyRange);
+    Report("rand", "range(0,n).generate() xoshiro256**", newRange);
+    ReportSpeedup("rand", "range speedup", legacyRange, newRange);
+
+    const double legacyFill = Fill(legacy);
+    const double newFill = Fill(rng);
+    Report("rand", "generateChar() per byte mt19937", legacyFill);
+    Report("rand", "generateChar() per byte xoshiro256**", newFill);
+    ReportSpeedup("rand", "fill speedup", legacyFill, newFill);
+
+    printf("%-12s %-36s %10.2f\n", "rand", "chi-squared/dof, range(0,3)", ChiSquaredPerDof(rng, 3));
+    printf("%-12s %-36s %10.2f\n", "rand", "chi-squared/dof, range(0,1000)", ChiSquaredPerDof(rng, 1000));
+}
@@ -0,0 +1,72 @@
+// Compares picking a mutation uniformly, as Fuzz() used to, with the alias tables it picks from now,
+// and checks each table picks in proportion to its weights
+
+#include <cmath>
+#include <algorithm>
+#include <array>
+
+#include "Bench.h"
+#include "rand.h"
+#include "MutationScheduler.h"
+
+namespace {
+
+    constexpr size_t kCalls = 10'000'000;
+
+    // skewed and with some mutations never picked, so the tables need the second draw
+    MutationWeights SkewedWeights() noexcept {
+        MutationWeights weights{};
+        for (size_t m = 0; m < MUTATION_COUNT; m++)
+            weights[m] = m % 4 == 0 ? 0.0 : static_cast<double>(m + 1);
+
+        return weights;
+    }
+
+    double Picks(const AliasTable& table, RandomNumberGenerator& rng) {
+        return TimeIt(kCalls, [&] {
+            gBenchSink = gBenchSink + static_cast<uint64_t>(table.Pick(rng));
+        });
+    }
+
+    // the largest gap between how often a mutation was picked and how often it should have been
+    double WorstError(const AliasTable& table, const MutationWeights& weights, RandomNumberGenerator& rng) {
+        constexpr size_t samples = 6'000'000;
+        std::array<size_t, MUTATION_COUNT> counts{};
+        for (size_t i = 0; i < samples; i++)
+            counts.at(static_cast<size_t>(table.Pick(rng)))++;
+
+        double total = 0;
+        for (const auto w : weights)
+            total += w;
+
+        double worst = 0;
+        for (size_t m = 0; m < MUTATION_COUNT; m++)
+            worst = (std::max)(worst, std::fabs(static_cast<double>(counts[m]) / samples - weights[m] / total));
+
+        return worst;
+    }
+}
+
+void BenchSchedule() {
+    RandomNumberGenerator rng{};
+
+    const double uniform = TimeIt(kCalls, [&] {
+        gBenchSink = gBenchSink + rng.range(0, static_cast<unsigned int>(MUTATION_COUNT)).generate();
+    });
+
+    MutationWeights equal{};
+    equal.fill(1.0);
+    AliasTable equalTable{};
+    equalTable.Build(equal);
+
+    const MutationWeights skewed = SkewedWeights();
+    AliasTable skewedTable{};
+    skewedTable.Build(skewed);
+
+    Report("schedule", "uniform range(0,n)", uniform);
+    Report("schedule", "alias Pick(), equal weights", Picks(equalTable, rng));
+    Report("schedule", "alias Pick(), skewed weights", Picks(skewedTable, rng));
+
+    printf("%-12s %-36s %10.5f\n", "schedule", "worst pick error, equal weights", WorstError(equalTable, equal, rng));
+    printf("%-12s %-36s %10.5f\n", "schedule", "worst pick error, skewed weights", WorstError(skewedTable, skewed, rng));
+}
@@ -0,0 +1,99 @@
+// Checks the vector mutation kernels against the scalar reference, then times them
+// For each kernel, level, stride and length the same input and seed go through the scalar version
+// and the vector version, and the output buffers and the generator state afterwards must match.
+
+#include <vector>
+#include <string>
+
+#include "Bench.h"
+#include "MutationKernels.h"
+
+namespace {
+
+    constexpr size_t kStrides[] = { 1, 2, 3, 4, 5, 7, 9, 17 };
+    constexpr size_t kLengths[] = { 0, 1, 15, 16, 17, 31, 33, 64, 100, 511, 4096 };
+    constexpr uint64_t kSeeds = 50;
+
+    enum class Which { SetUpper, ResetUpper, FillByte, ChangeAscii, Interesting };
+    constexpr const char* kNames[] = { "setUpperBit", "resetUpperBit", "fillByte", "changeAsciiInt", "interestingNumber" };
+
+    void Run(const MutationKernels& k, Which which, std::vector<char>& buf, size_t stride, RandomNumberGenerator& rng) {
+        const gsl::span<char> range(buf.data(), buf.size());
+        switch (which) {
+            case Which::SetUpper:       k.setUpperBit(range, stride); break;
+            case Which::ResetUpper:     k.resetUpperBit(range, stride); break;
+            case Which::FillByte:       k.fillByte(range, stride, 'A'); break;
+            case Which::ChangeAscii:    k.changeAsciiInt(range, stride, rng); break;
+            case Which::Interesting:    k.interestingNumber(range, stride, rng); break;
+        }
+    }
+
+    // returns the number of mismatches against the scalar reference
+    size_t Verify(const MutationKernels& k, Which which) {
+        const MutationKernels& ref = GetKernels(KernelLevel::Scalar);
+        size_t mismatches{};
+
+        for (uint64_t seed = 1; seed <= kSeeds; seed++) {
+            for (const auto stride : kStrides) {
+                for (const auto len : kLengths) {
+                    std::vector<char> input(len);
+                    RandomNumberGenerator(seed * 1000 + len).fill(reinterpret_cast<unsigned char*>(input.data()), len);
+
+                    auto expected = input;
+                    auto actual = input;
+                    RandomNumberGenerator refRng(seed), rng(seed);
+                    Run(ref, which, expected, stride, refRng);
+                    Run(k, which, actual, stride, rng);
+
+                    // the generators must also be in step, or the next mutation would diverge
+                    if (expected != actual || refRng.generate() != rng.generate())
+                        mismatches++;
+                }
+            }
+        }
+
+        return mismatches;
+    }
+}
+
+void BenchSimd() {
+    printf("%-12s best level on this CPU is %s\n", "simd", GetKernels(BestKernelLevel()).name);
+
+    const KernelLevel levels[] = { KernelLevel::Scalar, KernelLevel::Sse2, KernelLevel::Avx2 };
+    bool failed = false;
+
+    for (size_t w = 0; w < std::size(kNames); w++) {
+        const auto which = static_cast<Which>(w);
+        double scalarNs[2]{};
+
+        for (const auto level : levels) {
+            const MutationKernels& k = GetKernels(level);
+            if (k.level != level)
+                continue;
+
+            const size_t bad = Verify(k, which);
+            failed |= bad != 0;
+
+            std::vector<char> buffer(4096, 'x');
+            RandomNumberGenerator rng(42);
+
+            for (size_t s = 0; s < 2; s++) {
+                const size_t stride = s == 0 ? 1 : 3;
+                const double ns = TimeIt(20000, [&] {
+                    Run(k, which, buffer, stride, rng);
+                    gBenchSink = gBenchSink + static_cast<unsigned char>(buffer.front());
+                });
+
+                if (level == KernelLevel::Scalar)
+                    scalarNs[s] = ns;
+
+                const std::string variant = std::string(kNames[w]) + " " + k.name + " stride " + std::to_string(stride);
+                printf("%-12s %-36s %10.2f ns/4KB %6.2fx %s\n", "simd", variant.c_str(), ns,
+                    ns > 0 ? scalarNs[s] / ns : 0.0, bad ? "MISMATCH" : "ok");
+            }
+        }
+    }
+
+    if (failed)
+        printf("%-12s vector kernels do not match the scalar reference\n", "simd");
+}
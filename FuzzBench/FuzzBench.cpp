@@ -0,0 +1,49 @@
+// FuzzBench - microbenchmarks for the TcpProxyFuzzer hot paths
+// Usage: FuzzBench [name]
+// With no name, every benchmark is run. Build and run the Release configuration,
+// Debug numbers are meaningless.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "Bench.h"
+
+namespace {
+    struct Benchmark {
+        const char* name;
+        const char* description;
+        void (*run)();
+    };
+
+    constexpr Benchmark benchmarks[] = {
+        { "rand", "RNG: per-call ranges and per-byte fills, old mt19937 vs xoshiro256**", BenchRand },
+        { "simd", "mutation kernels: scalar reference vs SSE2 and AVX2, output checked against the reference", BenchSimd },
+        { "crc", "CRC32: bytewise vs slicing-by-8 vs folded, GB/s by buffer size, checked against the reference", BenchCrc },
+        { "fuzz", "Fuzz() and each mutation on its own: ns/byte and allocations per call by fuzz type and size", BenchFuzz },
+        { "schedule", "mutation picking: uniform vs alias tables, ns per pick and how closely picks follow the weights", BenchSchedule },
+    };
+}
+
+int main(int argc, char* argv[]) {
+    const char* only = argc > 1 ? argv[1] : nullptr;
+
+    bool ran = false;
+    for (const auto& bench : benchmarks) {
+        if (only && strcmp(only, bench.name) != 0)
+            continue;
+
+        printf("== %s: %s\n", bench.name, bench.description);
+        bench.run();
+        ran = true;
+    }
+
+    if (!ran) {
+        fprintf(stderr, "Unknown benchmark '%s', valid names are:\n", only);
+        for (const auto& bench : benchmarks)
+            fprintf(stderr, "  %s\n", bench.name);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Compiles line-based naughty string files into a corpus the proxy maps with -corpus
+// Each input names the list it goes in, a w after the type means its lines are weighted.
+// The result is read back and summarized, so a file that wouldn't load is caught here.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Tools.h"
+#include "Corpus.h"
+#include "MappedFile.h"
+
+namespace {
+
+    // <type>[w]:<file>, eg; t:naughty.txt or jw:json_keywords.txt
+    bool ParseSource(const std::string& arg, CorpusSource& source) {
+        const auto colon = arg.find(':');
+        if (colon == std::string::npos || colon == 0 || colon > 2 || colon + 1 == arg.size())
+            return false;
+
+        if (colon == 2 && arg.at(1) != 'w')
+            return false;
+
+        source.fuzz_type = arg.at(0);
+        source.weighted = colon == 2;
+        source.filename = arg.substr(colon + 1);
+
+        return true;
+    }
+}
+
+int Compile(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        fprintf(stderr, "Usage: FuzzTools compile <out.tpc> <type>[w]:<file> ...\n");
+        return 1;
+    }
+
+    std::vector<CorpusSource> sources{};
+    for (size_t i = 1; i < args.size(); i++) {
+        CorpusSource source{};
+        if (!ParseSource(args.at(i), source)) {
+            fprintf(stderr, "Bad input: %s, expected <type>[w]:<file>\n", args.at(i).c_str());
+            return 1;
+        }
+
+        sources.push_back(source);
+    }
+
+    const std::string& out = args.at(0);
+    if (!CompileNaughtyCorpus(sources, out))
+        return 1;
+
+    MappedFile file{};
+    CorpusFileHeader header{};
+    if (!file.Open(out) || file.Data().size() < sizeof(header)) {
+        fprintf(stderr, "Unable to read back %s\n", out.c_str());
+        return 1;
+    }
+
+    memcpy(&header, file.Data().data(), sizeof(header));
+    fprintf(stdout, "%s: %llu strings, %llu bytes of data, %zu bytes in all\n", out.c_str(),
+        static_cast<unsigned long long>(header.strings), static_cast<unsigned long long>(header.data_size), file.Data().size());
+
+    for (size_t i = 0; i < CORPUS_LISTS; i++) {
+        const CorpusList& list = header.lists[i];
+        if (list.count == 0)
+            continue;
+
+        if (list.total_weight)
+            fprintf(stdout, "\t%c: %u strings, total weight %u\n", CORPUS_FUZZ_TYPES[i], list.count, list.total_weight);
+        else
+            fprintf(stdout, "\t%c: %u strings\n", CORPUS_FUZZ_TYPES[i], list.count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+// Decodes a binary event log written with -events
+// The file is memory-mapped and only the blocks whose index can match the filters are read,
+// so pulling one connection or a few seconds out of a long run doesn't scan the whole file.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <limits>
+#include <exception>
+
+#include "Tools.h"
+#include "Fuzz.h"
+#include "EventLog.h"
+#include "MappedFile.h"
+
+namespace {
+    struct EventFilter {
+        bool        byConn{ false };
+        uint64_t    conn_id{ 0 };
+        uint64_t    from_us{ 0 };
+        uint64_t    to_us{ (std::numeric_limits<uint64_t>::max)() };
+
+        bool Matches(const EventRecord& record) const noexcept {
+            return (!byConn || record.conn_id == conn_id)
+                && record.time_us >= from_us && record.time_us <= to_us;
+        }
+
+        // could anything in the block behind this index match?
+        bool MayMatch(const EventRecord& index) const noexcept {
+            if (byConn && (conn_id < index.conn_id || conn_id > index.index.conn_max || !EventIndexHasConn(index, conn_id)))
+                return false;
+
+            return index.index.time_max_us >= from_us && index.time_us <= to_us;
+        }
+    };
+
+    const char* DirName(uint8_t dir) noexcept {
+        return dir == 0 ? "c->s" : "s->c";
+    }
+
+    void Print(const EventRecord& record, uint64_t start_us) {
+        const auto seconds = static_cast<time_t>(record.time_us / 1000000);
+        std::tm local{};
+        localtime_s(&local, &seconds);
+        char hms[16]{};
+        strftime(hms, sizeof(hms), "%H:%M:%S", &local);
+
+        const double since = record.time_us >= start_us ? static_cast<double>(record.time_us - start_us) / 1e6 : 0.0;
+        fprintf(stdout, "+%.6f %s.%06llu Conn:%llu %s ", since, hms,
+            static_cast<unsigned long long>(record.time_us % 1000000),
+            static_cast<unsigned long long>(record.conn_id), DirName(record.dir));
+
+        switch (static_cast<EventType>(record.type)) {
+            case EventType::ConnOpen:
+                fprintf(stdout, "open %s Seed:0x%016llx type:%c aggressiveness:%u offset:%u\n",
+                    record.open.fuzzed ? "fuzzed" : "passthrough",
+                    static_cast<unsigned long long>(record.open.seed),
+                    static_cast<char>(record.open.fuzz_type), record.open.fuzz_aggr, record.open.offset);
+                break;
+
+            case EventType::ConnClose:
+                fprintf(stdout, "close %llu bytes CRC32 in:0x%08X out:0x%08X\n",
+                    static_cast<unsigned long long>(record.close.bytes), record.close.crc_in, record.close.crc_out);
+                break;
+
+            case EventType::Recv:
+            case EventType::Send:
+                fprintf(stdout, "%s %u bytes CRC32:0x%08X\n",
+                    record.type == static_cast<uint8_t>(EventType::Recv) ? "recv" : "send",
+                    record.size, record.chunk.crc);
+                break;
+
+            case EventType::Mutation:
+                fprintf(stdout, "mutation %s start:%llu end:%llu skip:%llu\n",
+                    FuzzMutationName(static_cast<FuzzMutation>(record.mutation)),
+                    static_cast<unsigned long long>(record.range.start),
+                    static_cast<unsigned long long>(record.range.end),
+                    static_cast<unsigned long long>(record.range.skip));
+                break;
+
+            default:
+                fprintf(stdout, "unknown record type %u\n", record.type);
+                break;
+        }
+    }
+
+    // seconds from the start of the log, fractions allowed
+    uint64_t ParseOffset(const std::string& value, uint64_t start_us) {
+        return start_us + static_cast<uint64_t>(std::stod(value) * 1e6);
+    }
+}
+
+int Events(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        fprintf(stderr, "Usage: FuzzTools events <file.evl> [-conn:<id>] [-from:<seconds>] [-to:<seconds>]\n");
+        return 1;
+    }
+
+    MappedFile file{};
+    if (!file.Open(args.at(0))) {
+        fprintf(stderr, "Unable to open %s\n", args.at(0).c_str());
+        return 1;
+    }
+
+    const gsl::span<const char> data = file.Data();
+    EventFileHeader header{};
+    if (data.size() < sizeof(header)) {
+        fprintf(stderr, "%s is not an event log\n", args.at(0).c_str());
+        return 1;
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, EVENT_MAGIC, sizeof(EVENT_MAGIC)) != 0
+        || header.version != EVENT_VERSION
+        || header.record_size != EVENT_RECORD_SIZE
+        || header.block_records == 0) {
+        fprintf(stderr, "%s is not an event log this version can read\n", args.at(0).c_str());
+        return 1;
+    }
+
+    // the times on the command line are relative to when the log was opened
+    EventFilter filter{};
+    for (size_t i = 1; i < args.size(); i++) {
+        const std::string& arg = args.at(i);
+        try {
+            if (arg.rfind("-conn:", 0) == 0) {
+                filter.conn_id = std::stoull(arg.substr(6), nullptr, 0);
+                filter.byConn = true;
+            } else if (arg.rfind("-from:", 0) == 0) {
+                filter.from_us = ParseOffset(arg.substr(6), header.start_us);
+            } else if (arg.rfind("-to:", 0) == 0) {
+                filter.to_us = ParseOffset(arg.substr(4), header.start_us);
+            } else {
+                fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+                return 1;
+            }
+        }
+        catch (const std::exception&) {
+            fprintf(stderr, "Bad value for option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    // a record the proxy is half way through writing is ignored
+    const auto records = (data.size() - sizeof(header)) / EVENT_RECORD_SIZE;
+    auto record = [&](size_t i) {
+        EventRecord r{};
+        memcpy(&r, data.data() + sizeof(header) + i * EVENT_RECORD_SIZE, sizeof(r));
+        return r;
+    };
+
+    size_t matched{}, blocksRead{}, blocksSkipped{};
+    auto scan = [&](size_t first, size_t count) {
+        for (size_t i = first; i < first + count; i++) {
+            const EventRecord r = record(i);
+            if (r.type != static_cast<uint8_t>(EventType::Index) && filter.Matches(r)) {
+                Print(r, header.start_us);
+                matched++;
+            }
+        }
+    };
+
+    const size_t stride = header.block_records + 1;
+    const size_t blocks = records / stride;
+    for (size_t b = 0; b < blocks; b++) {
+        const EventRecord index = record(b * stride + header.block_records);
+
+        // no index where there should be one means the file is damaged, fall back to reading the block
+        if (index.type == static_cast<uint8_t>(EventType::Index) && !filter.MayMatch(index)) {
+            blocksSkipped++;
+            continue;
+        }
+
+        scan(b * stride, header.block_records);
+        blocksRead++;
+    }
+
+    // the last block isn't indexed until it fills
+    scan(blocks * stride, records - blocks * stride);
+
+    fprintf(stderr, "%zu of %zu events matched, %zu blocks read, %zu skipped by the index\n",
+        matched, records - blocks, blocksRead, blocksSkipped);
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+// FuzzTools - offline tools for TcpProxyFuzzer output
+// Usage: FuzzTools <command> [args]
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Tools.h"
+#include "Logger.h"
+
+// Fuzz.cpp logs every mutation when this is started, which only debug builds do
+Logger gLog("toolslog");
+
+namespace {
+    struct Command {
+        const char* name;
+        const char* usage;
+        int (*run)(const std::vector<std::string>& args);
+    };
+
+    constexpr Command commands[] = {
+        { "replay", "replay <capture.cap> [-out:<file>] [-seed:<n>] [-corpus:<file.tpc>] [-weights:<file>]\n"
+                    "\tre-runs Fuzz() over a seeded session capture and checks the output matches the proxy's\n"
+                    "\trun it from the proxy's directory, naughty word mutations need the same naughty*.txt files, or the same -corpus the proxy ran with\n"
+                    "\tthe capture has the weights the session picked with, -weights overrides them", Replay },
+        { "events", "events <file.evl> [-conn:<id>] [-from:<seconds>] [-to:<seconds>]\n"
+                    "\tprints the records in a binary event log written with -events, times are seconds from the start of the log\n"
+                    "\tonly the blocks whose index can match the filters are read", Events },
+        { "compile", "compile <out.tpc> <type>[w]:<file> ...\n"
+                    "\tcompiles naughty string files into a corpus for the proxy's -corpus option, type is the list a file goes in: t, x, h or j\n"
+                    "\ta w after the type means every line is a decimal weight, a tab, then the string. Eg; compile http.tpc t:naughty.txt tw:keywords.txt", Compile },
+    };
+
+    void Usage() {
+        fprintf(stdout, "Usage: FuzzTools <command> [args]\nWhere command is one of:\n");
+        for (const auto& cmd : commands)
+            fprintf(stdout, "\t%s\n", cmd.usage);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argv == nullptr || argc < 2) {
+        Usage();
+        return 1;
+    }
+
+#ifdef _DEBUG
+    // a replay is short and the log is for reading afterwards, so nothing is dropped
+    LogSettings logSettings{};
+    logSettings.full = LogFull::Block;
+    if (!gLog.Start(logSettings))
+        fprintf(stderr, "Unable to open the log file in fuzzlogs\n");
+#endif
+
+    const std::vector<std::string> args(argv + 2, argv + argc);
+    for (const auto& cmd : commands) {
+        if (strcmp(argv[1], cmd.name) == 0)
+            return cmd.run(args);
+    }
+
+    fprintf(stderr, "Unknown command: %s\n", argv[1]);
+    Usage();
+
+    return 1;
+}
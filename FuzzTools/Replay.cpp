@@ -0,0 +1,170 @@
+// Replays a seeded session capture
+// The capture holds the seed and every chunk's input bytes as the proxy read them, so feeding the
+// chunks through Fuzz() in order with a generator started from the same seed gives the same output.
+// Each chunk's output is checked against the CRC the proxy recorded after fuzzing it.
+// The capture has the weights the session picked its mutations with, which the replay picks with too.
+// -weights replays with a file's weights instead, a capture from before they were recorded needs it to match.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+
+#include "Tools.h"
+#include "Fuzz.h"
+#include "Capture.h"
+#include "Corpus.h"
+#include "MutationScheduler.h"
+#include "gsl/util"
+#include "crc32.h"
+
+namespace {
+    struct Chunk {
+        std::vector<char>   input{};
+        uint32_t            crc{ 0 };
+    };
+}
+
+int Replay(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        fprintf(stderr, "Usage: FuzzTools replay <capture.cap> [-out:<file>] [-seed:<n>] [-corpus:<file.tpc>] [-weights:<file>]\n");
+        return 1;
+    }
+
+    std::string outPath{};
+    std::string corpusPath{};
+    std::string weightsPath{};
+    bool overrideSeed = false;
+    uint64_t seed{};
+
+    for (size_t i = 1; i < args.size(); i++) {
+        const std::string& arg = args.at(i);
+        try {
+            if (arg.rfind("-out:", 0) == 0) {
+                outPath = arg.substr(5);
+            } else if (arg.rfind("-corpus:", 0) == 0) {
+                corpusPath = arg.substr(8);
+            } else if (arg.rfind("-weights:", 0) == 0) {
+                weightsPath = arg.substr(9);
+            } else if (arg.rfind("-seed:", 0) == 0) {
+                seed = std::stoull(arg.substr(6), nullptr, 0);
+                overrideSeed = true;
+            } else {
+                fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+                return 1;
+            }
+        }
+        catch (const std::exception&) {
+            fprintf(stderr, "Bad value for option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    FILE* f = nullptr;
+    if (fopen_s(&f, args.at(0).c_str(), "rb") != 0 || f == nullptr) {
+        fprintf(stderr, "Unable to open %s\n", args.at(0).c_str());
+        return 1;
+    }
+
+    // read everything up front so the replay itself runs at CPU speed
+    CaptureHeader header{};
+    std::vector<Chunk> chunks{};
+    if (!ReadCaptureHeader(f, header)) {
+        fprintf(stderr, "%s is not a capture file\n", args.at(0).c_str());
+        fclose(f);
+        return 1;
+    }
+
+    Chunk chunk{};
+    while (ReadCaptureChunk(f, chunk.input, chunk.crc))
+        chunks.push_back(chunk);
+
+    const bool truncated = !feof(f);
+    fclose(f);
+
+    if (!overrideSeed)
+        seed = header.seed;
+
+    fprintf(stdout, "Conn:%llu %s Seed:0x%016llx, type:%c, aggressiveness:%u, offset:%u, %zu chunks%s\n",
+        static_cast<unsigned long long>(header.conn_id),
+        header.sock_dir == 0 ? "c->s" : "s->c",
+        static_cast<unsigned long long>(seed),
+        static_cast<char>(header.fuzz_type), header.fuzz_aggr, header.offset,
+        chunks.size(), truncated ? " (the last record is truncated)" : "");
+
+    // before the clock starts, the proxy loads it at startup too
+    if (corpusPath.empty())
+        LoadNaughtyCorpus();
+    else if (!MapNaughtyCorpus(corpusPath))
+        return 1;
+
+    // the weights the session was picking with, the proxy pinned them when it started, so they're the
+    // same for every chunk whatever the weights file or -novelty did while it ran
+    const size_t type = ScheduleFuzzType(header.fuzz_type);
+    if (!weightsPath.empty()) {
+        if (!LoadScheduleWeights(weightsPath))
+            return 1;
+
+        const MutationWeights& loaded = CurrentSchedule().weights[type];
+        if (header.version > 1 && !std::equal(loaded.begin(), loaded.end(), std::begin(header.weights)))
+            fprintf(stderr, "Warning: %s has different weights than the session picked with, the replay won't match\n", weightsPath.c_str());
+    } else if (header.version > 1) {
+        ScheduleWeights weights = DefaultScheduleWeights();
+        std::copy(std::begin(header.weights), std::end(header.weights), weights[type].begin());
+        SetScheduleWeights(weights);
+    }
+
+    const crc32 crc{};
+    RandomNumberGenerator rng(seed);
+    size_t mismatches{}, bytesIn{}, bytesOut{};
+    std::vector<char> output{};
+
+    const auto start = std::chrono::steady_clock::now();
+
+    {
+        const ScopedFuzzRng scopedRng(rng);
+        for (size_t i = 0; i < chunks.size(); i++) {
+            std::vector<char> buffer = chunks.at(i).input;
+            bytesIn += buffer.size();
+
+            // the proxy thread that hit this would have died here too, so there's nothing after it to replay
+            try {
+                Fuzz(buffer, header.fuzz_aggr, header.fuzz_type, header.offset);
+            }
+            catch (const std::exception& e) {
+                fprintf(stderr, "\nFuzz() threw at chunk %zu: %s\n", i, e.what());
+                mismatches++;
+                break;
+            }
+
+            if (crc.calc(buffer) != chunks.at(i).crc) {
+                if (mismatches++ == 0)
+                    fprintf(stderr, "\nChunk %zu does not match the capture\n", i);
+            }
+
+            bytesOut += buffer.size();
+            if (!outPath.empty())
+                output.insert(output.end(), buffer.begin(), buffer.end());
+        }
+    }
+
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stdout, "\nReplayed %zu bytes into %zu bytes in %.3f ms, %zu of %zu chunks differ from the capture\n",
+        bytesIn, bytesOut, elapsed * 1000.0, mismatches, chunks.size());
+
+    if (!outPath.empty()) {
+        FILE* out = nullptr;
+        if (fopen_s(&out, outPath.c_str(), "wb") != 0 || out == nullptr) {
+            fprintf(stderr, "Unable to open %s\n", outPath.c_str());
+            return 1;
+        }
+
+        fwrite(output.data(), 1, output.size(), out);
+        fclose(out);
+    }
+
+    return mismatches ? 2 : 0;
+}
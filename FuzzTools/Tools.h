@@ -0,0 +1,11 @@
+#pragma once
+
+// Offline tools that work on files written by TcpProxyFuzzer
+
+#include <string>
+#include <vector>
+
+// each command lives in its own .cpp, args start after the command name
+int Replay(const std::vector<std::string>& args);
+int Events(const std::vector<std::string>& args);
+int Compile(const std::vector<std::string>& args);
@@ -0,0 +1,79 @@
+// The echo target the proxy forwards to
+// A blocking thread per connection is plenty here, the point is to measure the proxy,
+// and the target has to be cheap enough that it's never the bottleneck.
+
+#define  _WINSOCK_DEPRECATED_NO_WARNINGS 1
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <stdio.h>
+#include <thread>
+#include <array>
+
+#include "ProxyBench.h"
+
+namespace {
+
+    void Echo(SOCKET sock) {
+        std::array<char, 16 * 1024> buffer{};
+
+        int received{};
+        while ((received = recv(sock, buffer.data(), static_cast<int>(buffer.size()), 0)) > 0) {
+            int sent{};
+            while (sent < received) {
+                const int n = send(sock, buffer.data() + sent, received - sent, 0);
+                if (n == SOCKET_ERROR)
+                    break;
+
+                sent += n;
+            }
+
+            if (sent < received)
+                break;
+        }
+
+        closesocket(sock);
+    }
+
+    void AcceptLoop(SOCKET listen_sock) {
+        while (true) {
+            const SOCKET sock = accept(listen_sock, NULL, NULL);
+            if (sock == INVALID_SOCKET) {
+                fprintf(stderr, "Echo accept failed. Error: %d\n", WSAGetLastError());
+                continue;
+            }
+
+            BOOL noDelay = TRUE;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+            std::thread(Echo, sock).detach();
+        }
+    }
+}
+
+unsigned short StartEchoServer() {
+    const SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET) {
+        fprintf(stderr, "Echo socket creation failed. Error: %d\n", WSAGetLastError());
+        return 0;
+    }
+
+    // port 0 lets Windows pick a free one
+    SOCKADDR_IN addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    int len = sizeof(addr);
+    if (bind(sock, reinterpret_cast<SOCKADDR*>(&addr), len) == SOCKET_ERROR ||
+        getsockname(sock, reinterpret_cast<SOCKADDR*>(&addr), &len) == SOCKET_ERROR ||
+        listen(sock, SOMAXCONN) == SOCKET_ERROR) {
+        fprintf(stderr, "Echo bind failed. Error: %d\n", WSAGetLastError());
+        closesocket(sock);
+        return 0;
+    }
+
+    std::thread(AcceptLoop, sock).detach();
+
+    return ntohs(addr.sin_port);
+}
@@ -0,0 +1,244 @@
+// The load generator
+// One thread per connection, each doing strict request/response round trips through the proxy.
+// A fuzzed message can come back longer or shorter than it went out, so a round trip ends when
+// the whole message is back or, once something has arrived, when nothing more turns up for a
+// little while; the time recorded is to the last byte that did arrive, not to the end of the wait.
+
+#define  _WINSOCK_DEPRECATED_NO_WARNINGS 1
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <stdio.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "ProxyBench.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // how long to wait for the first byte of a reply, and for more once some has arrived
+    constexpr int kReplyTimeoutMs = 2000;
+    constexpr int kSettleMs = 20;
+
+    uint64_t Nanos(Clock::duration d) noexcept {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    }
+
+    bool Readable(SOCKET sock, int timeout_ms) noexcept {
+        WSAPOLLFD fd{ sock, POLLRDNORM, 0 };
+        return WSAPoll(&fd, 1, timeout_ms) > 0 && (fd.revents & (POLLRDNORM | POLLHUP | POLLERR));
+    }
+
+    SOCKET ConnectProxy(unsigned short port) noexcept {
+        const SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET)
+            return INVALID_SOCKET;
+
+        SOCKADDR_IN addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+
+        if (connect(sock, reinterpret_cast<SOCKADDR*>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+            closesocket(sock);
+            return INVALID_SOCKET;
+        }
+
+        BOOL noDelay = TRUE;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+        return sock;
+    }
+
+    // closes with a reset, thousands of closes a second would otherwise fill the port range with TIME_WAIT
+    void Abort(SOCKET sock) noexcept {
+        const LINGER linger{ 1, 0 };
+        setsockopt(sock, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&linger), sizeof(linger));
+        closesocket(sock);
+    }
+
+    bool SendAll(SOCKET sock, const std::vector<char>& msg) noexcept {
+        size_t sent = 0;
+        while (sent < msg.size()) {
+            const int n = send(sock, msg.data() + sent, static_cast<int>(msg.size() - sent), 0);
+            if (n == SOCKET_ERROR)
+                return false;
+
+            sent += n;
+        }
+
+        return true;
+    }
+
+    enum class Reply { Ok, Timeout, Error };
+
+    // reads the reply to a message, last is when its final byte arrived
+    Reply ReadReply(SOCKET sock, std::vector<char>& buffer, size_t expected, uint64_t& received, Clock::time_point& last) {
+        size_t got = 0;
+        while (got < expected) {
+            if (!Readable(sock, got == 0 ? kReplyTimeoutMs : kSettleMs))
+                return got == 0 ? Reply::Timeout : Reply::Ok;
+
+            const int n = recv(sock, buffer.data(), static_cast<int>(buffer.size()), 0);
+            if (n <= 0)
+                return Reply::Error;
+
+            got += n;
+            received += n;
+            last = Clock::now();
+        }
+
+        return Reply::Ok;
+    }
+
+    // anything still arriving from a message that came back longer than it went out
+    bool Drain(SOCKET sock, std::vector<char>& buffer, uint64_t& received) {
+        while (Readable(sock, 0)) {
+            const int n = recv(sock, buffer.data(), static_cast<int>(buffer.size()), 0);
+            if (n <= 0)
+                return false;
+
+            received += n;
+        }
+
+        return true;
+    }
+
+    // mostly letters with a few digits, so the text mutations have something to work on
+    std::vector<char> MakeMessage(size_t size) {
+        std::vector<char> msg(size);
+        for (size_t i = 0; i < size; i++)
+            msg[i] = i % 16 == 15 ? static_cast<char>('0' + i % 10) : static_cast<char>('a' + i % 26);
+
+        return msg;
+    }
+
+    void ThroughputWorker(const LoadSettings& settings, Clock::time_point stop, ThroughputResult& result) {
+        const std::vector<char> msg = MakeMessage(settings.msg_size);
+        std::vector<char> buffer(64 * 1024);
+
+        SOCKET sock = INVALID_SOCKET;
+        while (Clock::now() < stop) {
+            if (sock == INVALID_SOCKET) {
+                sock = ConnectProxy(settings.port);
+                if (sock == INVALID_SOCKET) {
+                    result.errors++;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
+            }
+
+            if (!Drain(sock, buffer, result.bytes)) {
+                result.errors++;
+                Abort(sock);
+                sock = INVALID_SOCKET;
+                continue;
+            }
+
+            const auto start = Clock::now();
+            if (!SendAll(sock, msg)) {
+                result.errors++;
+                Abort(sock);
+                sock = INVALID_SOCKET;
+                continue;
+            }
+
+            result.bytes += msg.size();
+
+            auto last = start;
+            switch (ReadReply(sock, buffer, msg.size(), result.bytes, last)) {
+                case Reply::Ok:
+                    result.round_trips++;
+                    result.rtt.Add(Nanos(last - start));
+                    break;
+
+                case Reply::Timeout:
+                    result.timeouts++;
+                    break;
+
+                case Reply::Error:
+                    result.errors++;
+                    Abort(sock);
+                    sock = INVALID_SOCKET;
+                    break;
+            }
+        }
+
+        if (sock != INVALID_SOCKET)
+            Abort(sock);
+    }
+
+    void ConnectWorker(const LoadSettings& settings, Clock::time_point stop, ConnectResult& result) {
+        // big enough that Fuzz() will look at it
+        const std::vector<char> msg = MakeMessage(64);
+        std::vector<char> buffer(4 * 1024);
+        uint64_t ignored{};
+
+        while (Clock::now() < stop) {
+            const auto start = Clock::now();
+            const SOCKET sock = ConnectProxy(settings.port);
+            if (sock == INVALID_SOCKET) {
+                result.failures++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            auto last = start;
+            if (SendAll(sock, msg) && ReadReply(sock, buffer, 1, ignored, last) == Reply::Ok) {
+                result.conns++;
+                result.time.Add(Nanos(last - start));
+            } else {
+                result.failures++;
+            }
+
+            Abort(sock);
+        }
+    }
+
+    void Accumulate(ThroughputResult& total, const ThroughputResult& r) noexcept {
+        total.round_trips += r.round_trips;
+        total.bytes += r.bytes;
+        total.timeouts += r.timeouts;
+        total.errors += r.errors;
+        total.rtt.Add(r.rtt);
+    }
+
+    void Accumulate(ConnectResult& total, const ConnectResult& r) noexcept {
+        total.conns += r.conns;
+        total.failures += r.failures;
+        total.time.Add(r.time);
+    }
+
+    // runs worker on settings.conns threads and adds up what they found
+    template <typename Result, typename Worker>
+    Result RunWorkers(const LoadSettings& settings, Worker worker) {
+        std::vector<Result> results(settings.conns);
+        std::vector<std::thread> threads{};
+
+        const auto start = Clock::now();
+        const auto stop = start + std::chrono::seconds(settings.secs);
+        for (auto& r : results)
+            threads.emplace_back(worker, std::cref(settings), stop, std::ref(r));
+
+        for (auto& t : threads)
+            t.join();
+
+        Result total{};
+        total.secs = std::chrono::duration<double>(Clock::now() - start).count();
+        for (const auto& r : results)
+            Accumulate(total, r);
+
+        return total;
+    }
+}
+
+ThroughputResult RunThroughput(const LoadSettings& settings) {
+    return RunWorkers<ThroughputResult>(settings, ThroughputWorker);
+}
+
+ConnectResult RunConnects(const LoadSettings& settings) {
+    return RunWorkers<ConnectResult>(settings, ConnectWorker);
+}
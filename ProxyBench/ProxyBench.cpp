@@ -0,0 +1,320 @@
+// ProxyBench - end-to-end throughput and latency of TcpProxyFuzzer on loopback
+// Starts an echo target in this process, then for every point in the sweep starts
+// TcpProxyFuzzer.exe in front of it, drives it with the load generator and prints one
+// JSON object per line to stdout. Progress goes to stderr, so stdout can be piped into a
+// file and compared between builds. Build and run the Release configuration of both.
+//
+// Usage: ProxyBench [-name:value ...] [-- extra proxy args]
+//   -proxy:<path>      the proxy to run, the default is TcpProxyFuzzer.exe next to ProxyBench.exe
+//   -conns:<n>         concurrent connections, the default is 16
+//   -size:<bytes>      message size, the default is 1024
+//   -secs:<n>          seconds per phase, there are two phases per sweep point, the default is 5
+//   -dirs:<nscb>       fuzz directions to sweep, the default is nb
+//   -types:<btxjh>     fuzz types to sweep, the default is bt
+//   -aggr:<a,b,...>    aggressiveness values to sweep, the default is 5,50
+//   -engines:<e,...>   forwarding engines to sweep, any of thread, poll and rio, the default is the
+//                      proxy's own, or whichever -engine is in the extra proxy args
+//   -port:<n>          the first proxy port, each sweep point uses the next one, the default is 18080
+// Eg; ProxyBench -conns:64 -size:4096 -dirs:nsb -types:b -aggr:10 -- -engine:poll
+// Eg; ProxyBench -conns:256 -dirs:n -engines:thread,poll,rio
+
+#define  _WINSOCK_DEPRECATED_NO_WARNINGS 1
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <format>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "ProxyBench.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+namespace {
+
+    struct BenchOptions {
+        std::string                 proxy{};
+        LoadSettings                load{};
+        std::string                 dirs{ "nb" };
+        std::string                 types{ "bt" };
+        std::vector<unsigned int>   aggr{ 5, 50 };
+        std::vector<std::string>    engines{ "" };  // empty passes no -engine
+        unsigned short              first_port{ 18080 };
+        std::string                 extra{};        // passed to the proxy as-is
+    };
+
+    // one point in the sweep
+    struct SweepPoint {
+        std::string     engine;
+        char            dir;
+        char            type;
+        unsigned int    aggr;
+    };
+
+    std::string DefaultProxyPath() {
+        char path[MAX_PATH]{};
+        const DWORD len = GetModuleFileNameA(NULL, path, MAX_PATH);
+        std::string dir(path, len);
+        const auto slash = dir.find_last_of("\\/");
+        dir.resize(slash == std::string::npos ? 0 : slash + 1);
+
+        return dir + "TcpProxyFuzzer.exe";
+    }
+
+    std::vector<unsigned int> ParseList(const std::string& value) {
+        std::vector<unsigned int> list{};
+        size_t start = 0;
+        while (start <= value.size()) {
+            const auto comma = value.find(',', start);
+            const auto item = value.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+            list.push_back(static_cast<unsigned int>(std::stoul(item)));
+
+            if (comma == std::string::npos)
+                break;
+
+            start = comma + 1;
+        }
+
+        return list;
+    }
+
+    std::vector<std::string> ParseNames(const std::string& value) {
+        std::vector<std::string> names{};
+        size_t start = 0;
+        while (true) {
+            const auto comma = value.find(',', start);
+            names.push_back(value.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+            if (comma == std::string::npos)
+                return names;
+
+            start = comma + 1;
+        }
+    }
+
+    bool ParseOptions(int argc, char* argv[], BenchOptions& options) {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+
+            if (arg == "--") {
+                for (int j = i + 1; j < argc; j++)
+                    options.extra += std::string(" ") + argv[j];
+                break;
+            }
+
+            const auto colon = arg.find(':');
+            if (arg.size() < 2 || arg.at(0) != '-' || colon == std::string::npos) {
+                fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+                return false;
+            }
+
+            const std::string name = arg.substr(1, colon - 1);
+            const std::string value = arg.substr(colon + 1);
+
+            try {
+                if (name == "proxy")        options.proxy = value;
+                else if (name == "conns")   options.load.conns = std::stoi(value);
+                else if (name == "size")    options.load.msg_size = std::stoul(value);
+                else if (name == "secs")    options.load.secs = std::stoi(value);
+                else if (name == "dirs")    options.dirs = value;
+                else if (name == "types")   options.types = value;
+                else if (name == "aggr")    options.aggr = ParseList(value);
+                else if (name == "engines") options.engines = ParseNames(value);
+                else if (name == "port")    options.first_port = static_cast<unsigned short>(std::stoi(value));
+                else {
+                    fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+                    return false;
+                }
+            }
+            catch (const std::exception&) {
+                fprintf(stderr, "Bad value for option: %s\n", arg.c_str());
+                return false;
+            }
+        }
+
+        const bool dirsOk = !options.dirs.empty() && options.dirs.find_first_not_of("nscb") == std::string::npos;
+        const bool typesOk = !options.types.empty() && options.types.find_first_not_of("btxjh") == std::string::npos;
+        const bool aggrOk = !options.aggr.empty() && std::ranges::all_of(options.aggr, [](unsigned int a) { return a <= 100; });
+        const bool enginesOk = std::ranges::all_of(options.engines,
+            [](const std::string& e) { return e.empty() || e == "thread" || e == "poll" || e == "rio"; });
+        if (!dirsOk || !typesOk || !aggrOk || !enginesOk || options.load.conns == 0 || options.load.msg_size == 0 || options.load.secs == 0) {
+            fprintf(stderr, "Bad sweep settings\n");
+            return false;
+        }
+
+        if (options.proxy.empty())
+            options.proxy = DefaultProxyPath();
+
+        return true;
+    }
+
+    // 'n' doesn't fuzz, so the type and aggressiveness don't matter and it's run once per engine
+    std::vector<SweepPoint> BuildSweep(const BenchOptions& options) {
+        std::vector<SweepPoint> sweep{};
+        for (const std::string& engine : options.engines) {
+            for (const char dir : options.dirs) {
+                if (dir == 'n') {
+                    sweep.push_back({ engine, 'n', 'b', 0 });
+                    continue;
+                }
+
+                for (const char type : options.types)
+                    for (const unsigned int aggr : options.aggr)
+                        sweep.push_back({ engine, dir, type, aggr });
+            }
+        }
+
+        return sweep;
+    }
+
+    // A running TcpProxyFuzzer, killed when this goes away
+    class ProxyProcess {
+    public:
+        ProxyProcess() = default;
+
+        ~ProxyProcess() {
+            if (_pi.hProcess) {
+                TerminateProcess(_pi.hProcess, 0);
+                WaitForSingleObject(_pi.hProcess, 5000);
+                CloseHandle(_pi.hProcess);
+                CloseHandle(_pi.hThread);
+            }
+        }
+
+        // starts the proxy and waits until it accepts connections
+        bool Start(const BenchOptions& options, const SweepPoint& point, unsigned short port, unsigned short target_port) {
+            // the proxy's console output would swamp the results, it goes to NUL
+            SECURITY_ATTRIBUTES sa{ sizeof(sa), NULL, TRUE };
+            const HANDLE nul = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+
+            STARTUPINFOA si{};
+            si.cb = sizeof(si);
+            si.dwFlags = STARTF_USESTDHANDLES;
+            si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+            si.hStdOutput = nul;
+            si.hStdError = nul;
+
+            // the swept engine goes after the extra args, so it's the one that counts
+            std::string cmd = std::format("\"{}\" {} 127.0.0.1 {} 0 {} {} {} -quiet:on -log:off{}{}",
+                options.proxy, port, target_port, point.aggr, point.dir, point.type, options.extra,
+                point.engine.empty() ? "" : " -engine:" + point.engine);
+
+            const BOOL ok = CreateProcessA(NULL, cmd.data(), NULL, NULL, TRUE, 0, NULL, NULL, &si, &_pi);
+            CloseHandle(nul);
+
+            if (!ok) {
+                fprintf(stderr, "Unable to start %s. Error: %lu\n", options.proxy.c_str(), GetLastError());
+                _pi = {};
+                return false;
+            }
+
+            return WaitUntilListening(port);
+        }
+
+        ProxyProcess(const ProxyProcess&) = delete;
+        ProxyProcess(ProxyProcess&&) = delete;
+        ProxyProcess& operator=(const ProxyProcess&) = delete;
+        ProxyProcess& operator=(ProxyProcess&&) = delete;
+
+    private:
+        bool WaitUntilListening(unsigned short port) {
+            for (int attempt = 0; attempt < 100; attempt++) {
+                if (WaitForSingleObject(_pi.hProcess, 0) == WAIT_OBJECT_0) {
+                    fprintf(stderr, "The proxy exited, check the extra args\n");
+                    return false;
+                }
+
+                const SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+                SOCKADDR_IN addr{};
+                addr.sin_family = AF_INET;
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                addr.sin_port = htons(port);
+
+                const bool connected = connect(sock, reinterpret_cast<SOCKADDR*>(&addr), sizeof(addr)) != SOCKET_ERROR;
+                closesocket(sock);
+                if (connected)
+                    return true;
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+
+            fprintf(stderr, "The proxy didn't start listening on port %u\n", port);
+            return false;
+        }
+
+        PROCESS_INFORMATION _pi{};
+    };
+
+    double Micros(uint64_t ns) noexcept {
+        return static_cast<double>(ns) / 1000.0;
+    }
+
+    void Report(const BenchOptions& options, const SweepPoint& point, const ThroughputResult& t, const ConnectResult& c) {
+        const double mib = static_cast<double>(t.bytes) / (1024.0 * 1024.0);
+        printf("{\"engine\":\"%s\",\"dir\":\"%c\",\"type\":\"%c\",\"aggr\":%u,\"conns\":%u,\"size\":%zu,"
+            "\"round_trips_per_sec\":%.1f,\"mib_per_sec\":%.2f,"
+            "\"rtt_p50_us\":%.1f,\"rtt_p99_us\":%.1f,\"rtt_p999_us\":%.1f,\"rtt_max_us\":%.1f,"
+            "\"timeouts\":%llu,\"errors\":%llu,"
+            "\"conns_per_sec\":%.1f,\"connect_p50_us\":%.1f,\"connect_p99_us\":%.1f,\"connect_p999_us\":%.1f,"
+            "\"connect_failures\":%llu}\n",
+            point.engine.empty() ? "default" : point.engine.c_str(), point.dir, point.type, point.aggr, options.load.conns, options.load.msg_size,
+            t.secs > 0 ? static_cast<double>(t.round_trips) / t.secs : 0.0, t.secs > 0 ? mib / t.secs : 0.0,
+            Micros(t.rtt.Percentile(50)), Micros(t.rtt.Percentile(99)), Micros(t.rtt.Percentile(99.9)), Micros(t.rtt.Percentile(100)),
+            static_cast<unsigned long long>(t.timeouts), static_cast<unsigned long long>(t.errors),
+            c.secs > 0 ? static_cast<double>(c.conns) / c.secs : 0.0,
+            Micros(c.time.Percentile(50)), Micros(c.time.Percentile(99)), Micros(c.time.Percentile(99.9)),
+            static_cast<unsigned long long>(c.failures));
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options{};
+    if (!ParseOptions(argc, argv, options))
+        return -1;
+
+    WSADATA wsaData{};
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        fprintf(stderr, "WSAStartup failed\n");
+        return -1;
+    }
+
+    const unsigned short target_port = StartEchoServer();
+    if (target_port == 0) {
+        WSACleanup();
+        return -1;
+    }
+
+    const auto sweep = BuildSweep(options);
+    fprintf(stderr, "%zu sweep points, %u connections, %zu byte messages, %u seconds per phase\n",
+        sweep.size(), options.load.conns, options.load.msg_size, options.load.secs);
+
+    int result = 0;
+    for (size_t i = 0; i < sweep.size(); i++) {
+        const SweepPoint& point = sweep.at(i);
+        fprintf(stderr, "[%zu/%zu] %sdir %c type %c aggr %u\n", i + 1, sweep.size(),
+            point.engine.empty() ? "" : std::format("engine {} ", point.engine).c_str(), point.dir, point.type, point.aggr);
+
+        // a fresh port every time, so connections from the last run still closing can't get in the way
+        LoadSettings load = options.load;
+        load.port = static_cast<unsigned short>(options.first_port + i);
+
+        ProxyProcess proxy{};
+        if (!proxy.Start(options, point, load.port, target_port)) {
+            result = -1;
+            break;
+        }
+
+        const ThroughputResult throughput = RunThroughput(load);
+        const ConnectResult connects = RunConnects(load);
+        Report(options, point, throughput, connects);
+    }
+
+    WSACleanup();
+
+    return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// Shared pieces of the end-to-end proxy benchmark
+
+#include <cstdint>
+#include <cstddef>
+
+#include "Stats.h"
+
+// a loopback echo target, every byte read is written straight back
+// runs until the process exits, returns the port it listens on or 0 on failure
+unsigned short StartEchoServer();
+
+struct LoadSettings {
+    unsigned short  port{ 0 };          // the proxy's listening port on 127.0.0.1
+    unsigned int    conns{ 16 };        // concurrent connections
+    size_t          msg_size{ 1024 };   // bytes per round trip
+    unsigned int    secs{ 5 };          // how long each phase runs
+};
+
+struct ThroughputResult {
+    uint64_t            round_trips{ 0 };
+    uint64_t            bytes{ 0 };     // sent and received by the clients
+    uint64_t            timeouts{ 0 };  // round trips that never came back, eg; truncated to nothing
+    uint64_t            errors{ 0 };    // connections that failed or were reset
+    double              secs{ 0 };
+    HistogramSnapshot   rtt{};
+};
+
+struct ConnectResult {
+    uint64_t            conns{ 0 };     // connect, one small round trip and close
+    uint64_t            failures{ 0 };
+    double              secs{ 0 };
+    HistogramSnapshot   time{};
+};
+
+// every connection sends a message, waits for it to come back and repeats until the time is up
+ThroughputResult RunThroughput(const LoadSettings& settings);
+
+// every thread opens a connection, does one small round trip and closes it, as fast as it can
+ConnectResult RunConnects(const LoadSettings& settings);
@@ -0,0 +1,155 @@
+// Chunk buffers and their sizes, see BufferPool.h
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include "BufferPool.h"
+#include "Stats.h"
+
+namespace {
+
+    // reads in a row that use under a quarter of a grown buffer before it halves
+    constexpr unsigned int kShortReadsToShrink = 8;
+
+    // what every BufferSizer holds above -buffer, kept under -buffer_budget
+    std::atomic<size_t> gGrowth{ 0 };
+
+    // takes more of the budget, or doesn't if that would go over it
+    bool ReserveGrowth(size_t bytes) noexcept {
+        size_t held = gGrowth.load(std::memory_order_relaxed);
+        do {
+            if (held + bytes > gOptions.buffer_budget)
+                return false;
+        } while (!gGrowth.compare_exchange_weak(held, held + bytes, std::memory_order_relaxed));
+
+        return true;
+    }
+}
+
+size_t BufferGrowthBytes() noexcept {
+    return gGrowth.load(std::memory_order_relaxed);
+}
+
+#pragma region Buffer Sizer
+
+BufferSizer::BufferSizer() noexcept
+    : _size(gOptions.buffer_size) {
+}
+
+BufferSizer::~BufferSizer() {
+    gGrowth.fetch_sub(_size - gOptions.buffer_size, std::memory_order_relaxed);
+}
+
+bool BufferSizer::OnRead(size_t bytes) noexcept {
+    // a full read means there was probably more waiting
+    _lastFull = bytes >= _size;
+    if (_lastFull) {
+        _shortReads = 0;
+        return Resize((std::min)(_size * 2, gOptions.max_buffer));
+    }
+
+    if (bytes >= _size / 4 || !Grown()) {
+        _shortReads = 0;
+        return false;
+    }
+
+    if (++_shortReads < kShortReadsToShrink)
+        return false;
+
+    _shortReads = 0;
+    return Resize((std::max)(_size / 2, gOptions.buffer_size));
+}
+
+bool BufferSizer::Shrink() noexcept {
+    _shortReads = 0;
+    return Resize(gOptions.buffer_size);
+}
+
+bool BufferSizer::Resize(size_t size) noexcept {
+    if (size == _size)
+        return false;
+
+    if (size > _size) {
+        if (!ReserveGrowth(size - _size)) {
+            CountStat(StatCounter::BufferGrowsDenied);
+            return false;
+        }
+
+        CountStat(StatCounter::BufferGrows);
+    } else {
+        gGrowth.fetch_sub(_size - size, std::memory_order_relaxed);
+        CountStat(StatCounter::BufferShrinks);
+    }
+
+    _size = size;
+    return true;
+}
+
+#pragma endregion Buffer Sizer
+
+#pragma region Buffer Pool
+
+BufferPool::FreeList* BufferPool::Find(size_t size) noexcept {
+    for (auto& list : _free) {
+        if (list.size == size)
+            return &list;
+    }
+
+    return nullptr;
+}
+
+BufferPool::FreeList* BufferPool::FindCapacity(size_t capacity) noexcept {
+    for (auto& list : _free) {
+        if (list.size + FuzzBufferGrowth(list.size) == capacity)
+            return &list;
+    }
+
+    return nullptr;
+}
+
+std::vector<char> BufferPool::Acquire(size_t size) {
+    FreeList* list = Find(size);
+    if (list == nullptr) {
+        // sizes only ever come from doubling -buffer toward -max_buffer, so this stays short
+        _free.push_back({ size, {} });
+        list = &_free.back();
+    }
+
+    if (list->buffers.empty()) {
+        CountStat(StatCounter::BufferAllocs);
+
+        std::vector<char> buffer{};
+        buffer.reserve(size + FuzzBufferGrowth(size));
+        return buffer;
+    }
+
+    CountStat(StatCounter::BufferReuses);
+
+    std::vector<char> buffer = std::move(list->buffers.back());
+    list->buffers.pop_back();
+    _freeBytes -= buffer.capacity();
+
+    return buffer;
+}
+
+void BufferPool::Release(std::vector<char> buffer) {
+    // only buffers of a size that's been asked for are kept, that drops any Fuzz() regrew
+    const size_t capacity = buffer.capacity();
+    FreeList* list = FindCapacity(capacity);
+    if (list == nullptr || _freeBytes + capacity > _maxFreeBytes)
+        return;
+
+    _freeBytes += capacity;
+    list->buffers.push_back(std::move(buffer));
+}
+
+void BufferPool::Refit(std::vector<char>& buffer, size_t size) {
+    if (buffer.capacity() == size + FuzzBufferGrowth(size))
+        return;
+
+    Release(std::move(buffer));
+    buffer = Acquire(size);
+}
+
+#pragma endregion Buffer Pool
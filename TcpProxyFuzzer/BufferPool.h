@@ -0,0 +1,139 @@
+#pragma once
+
+// Chunk buffers, how big they are and where they come from
+// A direction reads into a buffer of its current size, which starts at -buffer. When reads keep
+// filling it, it doubles toward -max_buffer so bulk transfers take fewer, larger recv() calls, and
+// when reads come back short or the direction goes idle it drops back down. What all the directions
+// hold above -buffer together is capped by -buffer_budget, a direction that would go over stays
+// the size it is, so thousands of connections never add up to more than that plus -buffer each.
+//
+// Every buffer is reserved to its size plus the most one Fuzz() call can grow it by (see FuzzBufferGrowth),
+// so neither recv() into it nor fuzzing it ever reallocates. Grow's bytes are kept to one side
+// (see FuzzInsert), only Truncate lengthens a buffer. Buffers are recycled through a pool per size,
+// so once the pools have warmed up a resize or a new connection doesn't go to the heap.
+// A pool isn't thread safe: the poll and RIO loops each own one, the thread engine's threads
+// come and go with their connections so they share one behind a lock, taken once per direction
+// and once per resize.
+
+#include <vector>
+#include <mutex>
+
+#include "Proxy.h"
+#include "Fuzz.h"
+
+// a direction with a grown buffer that reads nothing for this long goes back to -buffer
+constexpr unsigned int BUFFER_IDLE_MS = 1000;
+
+// what all the grown buffers hold above -buffer, in bytes, for the stats
+size_t BufferGrowthBytes() noexcept;
+
+// Decides how big a direction's next read is
+class BufferSizer {
+public:
+    BufferSizer() noexcept;
+
+    // gives back what it holds of -buffer_budget
+    ~BufferSizer();
+
+    size_t Size() const noexcept {
+        return _size;
+    }
+
+    // bigger than -buffer, so it's worth shrinking when the direction idles
+    bool Grown() const noexcept {
+        return _size > gOptions.buffer_size;
+    }
+
+    // call after each read into a buffer of Size(), returns true if Size() changed
+    bool OnRead(size_t bytes) noexcept;
+
+    // the last read filled the buffer, so there's probably more waiting and the next won't block
+    bool LastReadFull() const noexcept {
+        return _lastFull;
+    }
+
+    // back to -buffer, for a direction that's gone idle, returns true if Size() changed
+    bool Shrink() noexcept;
+
+    BufferSizer(const BufferSizer&) = delete;
+    BufferSizer(BufferSizer&&) = delete;
+    BufferSizer& operator=(const BufferSizer&) = delete;
+    BufferSizer& operator=(BufferSizer&&) = delete;
+
+private:
+    bool Resize(size_t size) noexcept;
+
+    size_t          _size;
+    unsigned int    _shortReads{ 0 };   // reads in a row that used under a quarter of the buffer
+    bool            _lastFull{ false };
+};
+
+class BufferPool {
+public:
+    // keeps at most max_free_bytes in idle buffers, more than that are freed as they come back
+    explicit BufferPool(size_t max_free_bytes = 16 * 1024 * 1024) noexcept
+        : _maxFreeBytes(max_free_bytes) {
+    }
+
+    // a buffer with room for size bytes plus FuzzBufferGrowth(size), a reused one keeps its last size and contents,
+    // so resizing it back up to size doesn't zero-fill it again
+    std::vector<char> Acquire(size_t size);
+
+    // takes the buffer back, one that had to grow past its headroom is dropped rather than kept
+    void Release(std::vector<char> buffer);
+
+    // swaps buffer for one sized for size if it isn't already, what was in it is lost
+    void Refit(std::vector<char>& buffer, size_t size);
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool(BufferPool&&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    BufferPool& operator=(BufferPool&&) = delete;
+
+private:
+    // the idle buffers of one size, there's only ever a handful of sizes
+    struct FreeList {
+        size_t                          size{ 0 };
+        std::vector<std::vector<char>>  buffers{};
+    };
+
+    FreeList* Find(size_t size) noexcept;
+    FreeList* FindCapacity(size_t capacity) noexcept;
+
+    std::vector<FreeList>   _free{};
+    size_t                  _freeBytes{ 0 };
+    size_t                  _maxFreeBytes;
+};
+
+// the same, for threads that share a pool
+class SharedBufferPool {
+public:
+    SharedBufferPool() = default;
+
+    std::vector<char> Acquire(size_t size) {
+        std::lock_guard lock(_lock);
+        return _pool.Acquire(size);
+    }
+
+    void Release(std::vector<char> buffer) {
+        std::lock_guard lock(_lock);
+        _pool.Release(std::move(buffer));
+    }
+
+    void Refit(std::vector<char>& buffer, size_t size) {
+        if (buffer.capacity() == size + FuzzBufferGrowth(size))
+            return;
+
+        std::lock_guard lock(_lock);
+        _pool.Refit(buffer, size);
+    }
+
+    SharedBufferPool(const SharedBufferPool&) = delete;
+    SharedBufferPool(SharedBufferPool&&) = delete;
+    SharedBufferPool& operator=(const SharedBufferPool&) = delete;
+    SharedBufferPool& operator=(SharedBufferPool&&) = delete;
+
+private:
+    std::mutex  _lock{};
+    BufferPool  _pool{};
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+// Capture files for seeded sessions
+// With -seed, every fuzzed direction records the bytes it read, one record per chunk, before Fuzz()
+// touches them. Together with the direction's seed that's enough to re-run Fuzz() offline and get
+// exactly the same output, see the replay command in FuzzTools. The header also has the mutation weights
+// the direction picked with, so the replay picks the same way whatever -weights and -novelty did.
+//
+// Layout, little-endian:
+//     CaptureHeader
+//     then per chunk: uint32_t length, length bytes of input, uint32_t CRC32 of the fuzzed output
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+
+#include "MutationScheduler.h"
+
+constexpr char CAPTURE_MAGIC[4] = { 'T', 'P', 'F', 'C' };
+// version 1 has no weights, it's still read, and replays with the defaults or -weights
+constexpr uint32_t CAPTURE_VERSION = 2;
+
+// the largest chunk the reader accepts, anything bigger means the file is corrupt
+constexpr uint32_t CAPTURE_MAX_CHUNK = 16 * 1024 * 1024;
+
+#pragma pack(push, 1)
+struct CaptureHeader {
+    char        magic[4];
+    uint32_t    version;
+    uint64_t    seed;        // seed of this direction's generator
+    uint64_t    conn_id;     // connection number, both directions of a connection share it
+    uint32_t    sock_dir;    // SocketDir
+    uint32_t    fuzz_type;
+    uint32_t    fuzz_aggr;
+    uint32_t    offset;
+    double      weights[MUTATION_COUNT];    // the fuzz_type's weight per FuzzMutation, boosts included, version 2 on
+};
+#pragma pack(pop)
+
+inline bool WriteCaptureHeader(FILE* f, const CaptureHeader& header) noexcept {
+    return fwrite(&header, sizeof(header), 1, f) == 1;
+}
+
+inline bool ReadCaptureHeader(FILE* f, CaptureHeader& header) noexcept {
+    constexpr size_t v1Size = offsetof(CaptureHeader, weights);
+    if (fread(&header, v1Size, 1, f) != 1 || memcmp(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)
+        return false;
+
+    if (header.version == 1)
+        return true;
+
+    return header.version == CAPTURE_VERSION
+        && fread(header.weights, sizeof(header.weights), 1, f) == 1;
+}
+
+// the input is written as soon as it's read, the CRC once the chunk has been fuzzed
+inline void WriteCaptureInput(FILE* f, const std::vector<char>& input) noexcept {
+    const auto len = static_cast<uint32_t>(input.size());
+    fwrite(&len, sizeof(len), 1, f);
+    fwrite(input.data(), 1, input.size(), f);
+}
+
+inline void WriteCaptureOutputCrc(FILE* f, uint32_t crc) noexcept {
+    fwrite(&crc, sizeof(crc), 1, f);
+}
+
+// returns false at the end of the file or if the record is truncated
+inline bool ReadCaptureChunk(FILE* f, std::vector<char>& input, uint32_t& crc) {
+    uint32_t len{};
+    if (fread(&len, sizeof(len), 1, f) != 1 || len > CAPTURE_MAX_CHUNK)
+        return false;
+
+    input.resize(len);
+    return fread(input.data(), 1, len, f) == len
+        && fread(&crc, sizeof(crc), 1, f) == 1;
+}
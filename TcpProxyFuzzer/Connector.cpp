@@ -0,0 +1,256 @@
+// Asynchronous upstream connects
+// The accept loop used to call a blocking connect() to the target before it could accept the
+// next client, so one slow or blackholed target stalled every connection queued behind it.
+// Now the accept loop starts a non-blocking connect and hands it over, and a connector thread
+// (one per listener shard) waits on all the in-flight connects with WSAPoll(), passing each
+// connected pair on to the forwarding engine. A failed or timed-out connect only closes its own client.
+
+#define  _WINSOCK_DEPRECATED_NO_WARNINGS 1
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <process.h>
+#include <windows.h>
+#include <stdio.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "Proxy.h"
+#include "WakeSocket.h"
+#include "Stats.h"
+#include "gsl/util"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingConnect {
+        SOCKET              client_sock{ INVALID_SOCKET };
+        SOCKET              target_sock{ INVALID_SOCKET };
+        Clock::time_point   started{};      // for the connect latency histogram
+        Clock::time_point   deadline{};
+    };
+
+    // the cap on connects in flight is shared by all the connectors
+    std::atomic<unsigned int> gInflight{ 0 };
+
+    class Connector {
+    public:
+        Connector() = default;
+
+        bool Init(_In_ const SOCKADDR_IN& target, unsigned int timeout_ms, unsigned int max_inflight, size_t shard);
+        bool Connect(SOCKET client_sock);
+        void Run();
+
+        Connector(const Connector&) = delete;
+        Connector(Connector&&) = delete;
+        Connector& operator=(const Connector&) = delete;
+        Connector& operator=(Connector&&) = delete;
+
+    private:
+        void AdoptPending(std::vector<PendingConnect>& inflight);
+        void Connected(const PendingConnect& pc);
+        void Failed(const PendingConnect& pc, int err);
+
+        SOCKADDR_IN                 _target{};
+        std::chrono::milliseconds   _timeout{};
+        unsigned int                _max_inflight{ 0 };
+        size_t                      _shard{ 0 };
+
+        WakeSocket                  _wake{};
+        std::mutex                  _pendingLock{};
+        std::vector<PendingConnect> _pending{};
+    };
+
+    // one connector per listener shard
+    std::vector<std::unique_ptr<Connector>> gConnectors{};
+
+    unsigned __stdcall connector_thread(_In_ void* data) {
+        Connector* connector = static_cast<Connector*>(data);
+        connector->Run();
+
+        return 0;
+    }
+}
+
+#pragma region Connector
+
+bool Connector::Init(_In_ const SOCKADDR_IN& target, unsigned int timeout_ms, unsigned int max_inflight, size_t shard) {
+    _target = target;
+    _timeout = std::chrono::milliseconds(timeout_ms);
+    _max_inflight = max_inflight;
+    _shard = shard;
+
+    return _wake.Init();
+}
+
+// called on the accept thread, this never blocks on the network
+// returns false if the client was closed because the connect could not be started
+bool Connector::Connect(SOCKET client_sock) {
+    if (gInflight >= _max_inflight) {
+        fprintf(stderr, "Too many upstream connects in flight (%u), dropping client\n", _max_inflight);
+        CountStat(StatCounter::ConnectsDropped);
+        closesocket(client_sock);
+        return false;
+    }
+
+    const SOCKET target_sock = CreateTcpSocket(gOptions.engine);
+    if (target_sock == INVALID_SOCKET) {
+        fprintf(stderr, "Target socket creation failed. Error: %d\n", WSAGetLastError());
+        CountStat(StatCounter::ConnectFailures);
+        closesocket(client_sock);
+        return false;
+    }
+
+    u_long nonBlocking = 1;
+    ioctlsocket(target_sock, FIONBIO, &nonBlocking);
+
+    if (connect(target_sock, reinterpret_cast<const SOCKADDR*>(&_target), sizeof(_target)) == SOCKET_ERROR &&
+        WSAGetLastError() != WSAEWOULDBLOCK) {
+        fprintf(stderr, "Connect to target failed. Error: %d\n", WSAGetLastError());
+        CountStat(StatCounter::ConnectFailures);
+        closesocket(target_sock);
+        closesocket(client_sock);
+        return false;
+    }
+
+    gInflight++;
+
+    {
+        const auto now = Clock::now();
+        std::lock_guard lock(_pendingLock);
+        _pending.push_back({ client_sock, target_sock, now, now + _timeout });
+    }
+
+    _wake.Wake();
+
+    return true;
+}
+
+void Connector::AdoptPending(std::vector<PendingConnect>& inflight) {
+    _wake.Drain();
+
+    std::lock_guard lock(_pendingLock);
+    inflight.insert(inflight.end(), _pending.begin(), _pending.end());
+    _pending.clear();
+}
+
+void Connector::Connected(const PendingConnect& pc) {
+    gInflight--;
+    RecordLatencySince(StatHistogram::ConnectLatency, pc.started);
+
+    // the thread engine uses blocking sockets, the other engines set the mode they need
+    if (gOptions.engine == ForwardEngine::Thread) {
+        u_long nonBlocking = 0;
+        ioctlsocket(pc.target_sock, FIONBIO, &nonBlocking);
+    }
+
+    StartSession(pc.client_sock, pc.target_sock, _shard);
+}
+
+void Connector::Failed(const PendingConnect& pc, int err) {
+    gInflight--;
+
+    fprintf(stderr, "Connect to target failed. Error: %d\n", err);
+    CountStat(err == WSAETIMEDOUT ? StatCounter::ConnectTimeouts : StatCounter::ConnectFailures);
+    closesocket(pc.target_sock);
+    closesocket(pc.client_sock);
+}
+
+void Connector::Run() {
+    std::vector<PendingConnect> inflight{};
+    std::vector<WSAPOLLFD> fds{};
+
+    while (true) {
+        AdoptPending(inflight);
+
+        // slot 0 is the wake socket, then one slot per in-flight connect
+        // a connect has completed when the socket becomes writable
+        fds.clear();
+        fds.push_back({ _wake.Socket(), POLLRDNORM, 0 });
+
+        auto now = Clock::now();
+        auto nearest = Clock::time_point::max();
+        for (const auto& pc : inflight) {
+            fds.push_back({ pc.target_sock, POLLWRNORM, 0 });
+            nearest = (std::min)(nearest, pc.deadline);
+        }
+
+        // sleep until something completes, a new connect arrives or the nearest deadline passes
+        int timeout = -1;
+        if (!inflight.empty()) {
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nearest - now).count();
+            timeout = gsl::narrow_cast<int>((std::max)(0LL, static_cast<long long>(wait)));
+        }
+
+        if (WSAPoll(fds.data(), gsl::narrow_cast<ULONG>(fds.size()), timeout) == SOCKET_ERROR) {
+            fprintf(stderr, "WSAPoll failed. Error: %d\n", WSAGetLastError());
+            continue;
+        }
+
+        // older versions of Windows don't report a refused connect from WSAPoll(),
+        // those are caught by the timeout instead
+        now = Clock::now();
+        size_t keep = 0;
+        for (size_t i = 0; i < inflight.size(); i++) {
+            const PendingConnect pc = inflight.at(i);
+            const short events = fds.at(i + 1).revents;
+
+            if (events & (POLLERR | POLLHUP | POLLNVAL | POLLWRNORM)) {
+                int err = 0;
+                int len = sizeof(err);
+                getsockopt(pc.target_sock, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len);
+
+                if (err == 0 && (events & POLLWRNORM))
+                    Connected(pc);
+                else
+                    Failed(pc, err ? err : WSAECONNREFUSED);
+            } else if (now >= pc.deadline) {
+                Failed(pc, WSAETIMEDOUT);
+            } else {
+                inflight.at(keep++) = pc;
+            }
+        }
+
+        inflight.resize(keep);
+    }
+}
+
+#pragma endregion Connector
+
+#pragma region Connector API
+
+bool StartConnectors(_In_ const SOCKADDR_IN& target, unsigned int timeout_ms, unsigned int max_inflight, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        auto connector = std::make_unique<Connector>();
+        if (!connector->Init(target, timeout_ms, max_inflight, i)) {
+            fprintf(stderr, "Connector creation failed. Error: %d\n", WSAGetLastError());
+            return false;
+        }
+
+        gConnectors.push_back(std::move(connector));
+    }
+
+    for (size_t i = 0; i < gConnectors.size(); i++) {
+        const auto thread = _beginthreadex(NULL, 0, connector_thread, gConnectors.at(i).get(), 0, NULL);
+        if (thread == 0) {
+            fprintf(stderr, "Connector thread creation failed. Error: %d\n", errno);
+            return false;
+        }
+
+        // the connector runs next to its shard's accept thread
+        PinThread(reinterpret_cast<HANDLE>(thread), i);
+        CloseHandle(reinterpret_cast<HANDLE>(thread));
+    }
+
+    return true;
+}
+
+bool ConnectUpstream(SOCKET client_sock, size_t shard) {
+    return gConnectors.at(shard % gConnectors.size())->Connect(client_sock);
+}
+
+#pragma endregion Connector API
@@ -0,0 +1,314 @@
+// The naughty string corpus, see Corpus.h
+
+#include <array>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <format>
+#include <mutex>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include "Corpus.h"
+#include "Logger.h"
+#include "MappedFile.h"
+#include "gsl/span"
+#include "gsl/narrow"
+
+extern Logger gLog;
+
+namespace {
+
+    // the text files for each list, in the order of CORPUS_FUZZ_TYPES
+    constexpr const char* kFiles[] = { "naughty.txt", "naughty_Xml.txt", "naughty_Html.txt", "naughty_Json.txt" };
+    static_assert(std::size(kFiles) == CORPUS_LISTS, "every list needs a file");
+    static_assert(sizeof(CorpusFileHeader) % sizeof(uint64_t) == 0, "the offsets follow the header and must stay aligned");
+
+    // what the lookups read, it points into the text arena or the mapped file
+    struct Corpus {
+        gsl::span<const char>       data{};
+        gsl::span<const uint64_t>   offsets{};      // strings + 1 entries
+        gsl::span<const uint32_t>   weights{};      // empty unless a list is weighted
+        std::array<CorpusList, CORPUS_LISTS> lists{};
+    };
+
+    Corpus corpus{};
+    std::once_flag loaded{};
+
+    // the text files are packed in here
+    std::vector<char> arena{};
+    std::vector<uint64_t> arenaOffsets{ 0 };
+
+    // or a compiled corpus is mapped here
+    MappedFile mapped{};
+
+    // where fuzz_type's list is in corpus.lists, or CORPUS_LISTS if it doesn't have one
+    size_t ListIndex(unsigned int fuzz_type) noexcept {
+        for (size_t i = 0; i < CORPUS_LISTS; i++)
+            if (CORPUS_FUZZ_TYPES[i] == static_cast<char>(fuzz_type))
+                return i;
+
+        return CORPUS_LISTS;
+    }
+
+    // appends the strings in a file to the arena
+    CorpusList LoadFile(const char* filename) {
+        if (gLog.Enabled())
+            gLog.Log(1, false, std::format("Loading {}", filename));
+
+        CorpusList list{ arenaOffsets.size() - 1, 0, 0 };
+
+        std::vector<std::string> lines{};
+        if (!ReadNaughtyFile(filename, lines)) {
+            if (gLog.Enabled())
+                gLog.Log(1, false, std::format("Error loading {}, err={}", filename, errno));
+
+            return list;
+        }
+
+        for (const auto& line : lines) {
+            arena.insert(arena.end(), line.begin(), line.end());
+            arenaOffsets.push_back(arena.size());
+        }
+
+        list.count = gsl::narrow<uint32_t>(lines.size());
+        return list;
+    }
+
+    // checks a part of the file is inside it and aligned for its type
+    bool InFile(uint64_t at, uint64_t count, size_t element, size_t file_size) noexcept {
+        return at % element == 0 && at <= file_size && count <= (file_size - at) / element;
+    }
+
+    // points the corpus at a compiled file, only what's needed to make every lookup safe is checked
+    // so the load doesn't touch the pages, a lookup then clamps each string to the data
+    bool MapFile(const std::string& path) {
+        if (!mapped.Open(path)) {
+            fprintf(stderr, "Unable to open the corpus %s\n", path.c_str());
+            return false;
+        }
+
+        const gsl::span<const char> file = mapped.Data();
+        CorpusFileHeader header{};
+        if (file.size() >= sizeof(header))
+            memcpy(&header, file.data(), sizeof(header));
+
+        bool valid = file.size() >= sizeof(header)
+            && memcmp(header.magic, CORPUS_MAGIC, sizeof(CORPUS_MAGIC)) == 0
+            && header.version == CORPUS_VERSION
+            && header.strings < (std::numeric_limits<uint64_t>::max)()
+            && InFile(header.offsets_at, header.strings + 1, sizeof(uint64_t), file.size())
+            && (header.weights_at == 0 || InFile(header.weights_at, header.strings, sizeof(uint32_t), file.size()))
+            && InFile(header.data_at, header.data_size, sizeof(char), file.size());
+
+        for (const auto& list : header.lists) {
+            valid = valid
+                && list.first <= header.strings && list.count <= header.strings - list.first
+                && (list.total_weight == 0 || header.weights_at != 0);
+        }
+
+        if (!valid) {
+            fprintf(stderr, "%s is not a corpus this version can read\n", path.c_str());
+            mapped.Close();
+            return false;
+        }
+
+        // the view is page aligned, so the tables are aligned wherever the header says they are
+        const char* base = file.data();
+        corpus.data = gsl::span<const char>(base + header.data_at, gsl::narrow<size_t>(header.data_size));
+        corpus.offsets = gsl::span<const uint64_t>(reinterpret_cast<const uint64_t*>(base + header.offsets_at), gsl::narrow<size_t>(header.strings + 1));
+        if (header.weights_at)
+            corpus.weights = gsl::span<const uint32_t>(reinterpret_cast<const uint32_t*>(base + header.weights_at), gsl::narrow<size_t>(header.strings));
+
+        std::copy(std::begin(header.lists), std::end(header.lists), corpus.lists.begin());
+
+        if (gLog.Enabled())
+            gLog.Log(1, false, std::format("Mapped corpus {}, {} strings, {} bytes", path, header.strings, header.data_size));
+
+        return true;
+    }
+}
+
+void LoadNaughtyCorpus() {
+    std::call_once(loaded, [] {
+        for (size_t i = 0; i < CORPUS_LISTS; i++)
+            corpus.lists[i] = LoadFile(kFiles[i]);
+
+        arena.shrink_to_fit();
+        arenaOffsets.shrink_to_fit();
+        corpus.data = arena;
+        corpus.offsets = arenaOffsets;
+    });
+}
+
+bool MapNaughtyCorpus(const std::string& path) {
+    bool ok = false;
+    std::call_once(loaded, [&] {
+        ok = MapFile(path);
+    });
+
+    return ok;
+}
+
+uint32_t NaughtyDrawRange(unsigned int fuzz_type) noexcept {
+    const size_t list = ListIndex(fuzz_type);
+    if (list == CORPUS_LISTS)
+        return 0;
+
+    const CorpusList& l = corpus.lists[list];
+    if (l.count == 0)
+        return 0;
+
+    return l.total_weight ? l.total_weight : l.count;
+}
+
+std::string_view NaughtyString(unsigned int fuzz_type, uint32_t draw) noexcept {
+    const size_t list = ListIndex(fuzz_type);
+    if (list == CORPUS_LISTS || corpus.lists[list].count == 0)
+        return {};
+
+    const CorpusList& l = corpus.lists[list];
+
+    // a weighted draw lands on the first string whose running total is past it
+    size_t i = draw;
+    if (l.total_weight) {
+        const auto totals = corpus.weights.subspan(gsl::narrow_cast<size_t>(l.first), l.count);
+        i = gsl::narrow_cast<size_t>(std::upper_bound(totals.begin(), totals.end(), draw) - totals.begin());
+    }
+
+    const size_t entry = gsl::narrow_cast<size_t>(l.first) + (std::min)(i, static_cast<size_t>(l.count) - 1);
+    const uint64_t end = (std::min)(corpus.offsets[entry + 1], static_cast<uint64_t>(corpus.data.size()));
+    const uint64_t begin = (std::min)(corpus.offsets[entry], end);
+
+    return std::string_view(corpus.data.data() + begin, gsl::narrow_cast<size_t>(end - begin));
+}
+
+bool ReadNaughtyFile(const std::string& filename, std::vector<std::string>& lines) {
+    std::ifstream inputFile(filename, std::ios::in | std::ios::binary);
+    if (!inputFile.is_open())
+        return false;
+
+    std::string line;
+    while (std::getline(inputFile, line)) {
+        if (!line.empty() && line.at(0) != '#')
+            lines.push_back(line);
+    }
+
+    return true;
+}
+
+bool CompileNaughtyCorpus(const std::vector<CorpusSource>& sources, const std::string& path) {
+    // the strings and their weights, list by list
+    struct Entry {
+        std::string text;
+        uint32_t    weight;
+    };
+
+    std::array<std::vector<Entry>, CORPUS_LISTS> lists{};
+    std::array<bool, CORPUS_LISTS> weighted{};
+
+    for (const auto& source : sources) {
+        const size_t list = ListIndex(source.fuzz_type);
+        if (list == CORPUS_LISTS) {
+            fprintf(stderr, "'%c' isn't a text fuzz type, the lists are t, x, h and j\n", source.fuzz_type);
+            return false;
+        }
+
+        std::vector<std::string> lines{};
+        if (!ReadNaughtyFile(source.filename, lines)) {
+            fprintf(stderr, "Unable to open %s\n", source.filename.c_str());
+            return false;
+        }
+
+        weighted.at(list) = weighted.at(list) || source.weighted;
+
+        for (size_t i = 0; i < lines.size(); i++) {
+            const std::string& line = lines.at(i);
+            if (!source.weighted) {
+                lists.at(list).push_back({ line, 1 });
+                continue;
+            }
+
+            const auto tab = line.find('\t');
+            try {
+                if (tab == std::string::npos || tab == 0)
+                    throw std::invalid_argument("no weight");
+
+                size_t used{};
+                const unsigned long weight = std::stoul(line.substr(0, tab), &used);
+                if (used != tab || weight > (std::numeric_limits<uint32_t>::max)())
+                    throw std::out_of_range("bad weight");
+
+                lists.at(list).push_back({ line.substr(tab + 1), static_cast<uint32_t>(weight) });
+            }
+            catch (const std::exception&) {
+                fprintf(stderr, "%s: string %zu doesn't start with a weight and a tab\n", source.filename.c_str(), i + 1);
+                return false;
+            }
+        }
+    }
+
+    CorpusFileHeader header{};
+    memcpy(header.magic, CORPUS_MAGIC, sizeof(CORPUS_MAGIC));
+    header.version = CORPUS_VERSION;
+
+    std::vector<uint64_t> offsets{ 0 };
+    std::vector<uint32_t> weights{};
+    std::string data{};
+    const bool anyWeighted = std::ranges::any_of(weighted, [](bool w) { return w; });
+
+    for (size_t list = 0; list < CORPUS_LISTS; list++) {
+        CorpusList& l = header.lists[list];
+        l.first = offsets.size() - 1;
+        l.count = gsl::narrow<uint32_t>(lists.at(list).size());
+
+        // running totals, the total has to fit the 32-bit draw Fuzz() makes
+        uint64_t total{};
+        for (const auto& entry : lists.at(list)) {
+            data += entry.text;
+            offsets.push_back(data.size());
+
+            total += entry.weight;
+            if (total > (std::numeric_limits<uint32_t>::max)()) {
+                fprintf(stderr, "The weights in the '%c' list add up to more than %u\n", CORPUS_FUZZ_TYPES[list], (std::numeric_limits<uint32_t>::max)());
+                return false;
+            }
+
+            weights.push_back(static_cast<uint32_t>(total));
+        }
+
+        l.total_weight = weighted.at(list) ? static_cast<uint32_t>(total) : 0;
+        if (weighted.at(list) && l.count && total == 0) {
+            fprintf(stderr, "Every weight in the '%c' list is 0\n", CORPUS_FUZZ_TYPES[list]);
+            return false;
+        }
+    }
+
+    header.strings = offsets.size() - 1;
+    header.offsets_at = sizeof(header);
+    header.weights_at = anyWeighted ? header.offsets_at + offsets.size() * sizeof(uint64_t) : 0;
+    header.data_at = header.offsets_at + offsets.size() * sizeof(uint64_t) + (anyWeighted ? weights.size() * sizeof(uint32_t) : 0);
+    header.data_size = data.size();
+
+    FILE* f = nullptr;
+    if (fopen_s(&f, path.c_str(), "wb") != 0 || f == nullptr) {
+        fprintf(stderr, "Unable to create %s\n", path.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), f) == offsets.size()
+        && (!anyWeighted || fwrite(weights.data(), sizeof(uint32_t), weights.size(), f) == weights.size())
+        && fwrite(data.data(), 1, data.size(), f) == data.size();
+
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "Unable to write %s\n", path.c_str());
+
+    return ok;
+}
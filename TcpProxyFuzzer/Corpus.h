@@ -0,0 +1,77 @@
+#pragma once
+
+// The naughty strings the text fuzz types insert
+// Every list is read once at startup into a single arena, the strings packed end to end with an
+// offsets table over them, so a lookup is two loads and never allocates or copies.
+// Nothing changes after loading, so Fuzz() on any thread reads it without locking.
+//
+// The lists come from the naughty*.txt files, or from a compiled corpus (FuzzTools compile) that
+// is memory-mapped as is. A compiled corpus is the same arena and offsets written to a file, so a
+// large dictionary loads instantly and every proxy process running with it shares the pages.
+//
+// Compiled layout, little-endian:
+//     CorpusFileHeader                 magic TPCO, its own so a corpus and a capture (TPFC) can't be taken for each other
+//     uint64_t offsets[strings + 1]    at offsets_at, string i is data[offsets[i], offsets[i + 1])
+//     uint32_t weights[strings]        at weights_at if there are any, running totals within each list
+//     char     data[data_size]         at data_at
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+constexpr char CORPUS_MAGIC[4] = { 'T', 'P', 'C', 'O' };
+constexpr uint32_t CORPUS_VERSION = 1;
+constexpr size_t CORPUS_LISTS = 4;      // one per text fuzz type
+constexpr char CORPUS_FUZZ_TYPES[CORPUS_LISTS] = { 't', 'x', 'h', 'j' };   // the order of the lists
+
+// a run of consecutive strings in the offsets table
+struct CorpusList {
+    uint64_t    first;          // its first string
+    uint32_t    count;
+    uint32_t    total_weight;   // 0 if the list isn't weighted, then every string is as likely
+};
+
+struct CorpusFileHeader {
+    char        magic[4];
+    uint32_t    version;
+    uint64_t    strings;        // in all the lists together
+    uint64_t    offsets_at;     // where each part starts, from the start of the file
+    uint64_t    weights_at;     // 0 if no list is weighted
+    uint64_t    data_at;
+    uint64_t    data_size;
+    CorpusList  lists[CORPUS_LISTS];
+};
+
+// Loads naughty.txt, naughty_Xml.txt, naughty_Html.txt and naughty_Json.txt from the current directory
+// Call it once before any forwarding starts, later calls do nothing
+// A missing file is logged and leaves that fuzz type with nothing to insert, it isn't an error
+void LoadNaughtyCorpus();
+
+// Maps a compiled corpus instead of loading the text files, the same rules as LoadNaughtyCorpus()
+// returns false if the file can't be mapped, isn't a corpus this version can read, or a corpus is already loaded
+bool MapNaughtyCorpus(const std::string& path);
+
+// How many values a draw for fuzz_type can take, 0 for 'b' or when there's nothing to insert
+// that's the number of strings, or the total weight for a weighted list
+uint32_t NaughtyDrawRange(unsigned int fuzz_type) noexcept;
+
+// the string a draw in [0, NaughtyDrawRange(fuzz_type)) selects, the view stays valid for the life of the process
+std::string_view NaughtyString(unsigned int fuzz_type, uint32_t draw) noexcept;
+
+// Reads the strings from a line-based naughty file, empty lines and lines starting with # are skipped
+// returns false if the file can't be opened
+bool ReadNaughtyFile(const std::string& filename, std::vector<std::string>& lines);
+
+// one input file to CompileNaughtyCorpus()
+struct CorpusSource {
+    char        fuzz_type{ 't' };   // the list its strings go in
+    std::string filename{};
+    bool        weighted{ false };  // every line is a decimal weight, a tab, then the string
+};
+
+// Writes a compiled corpus from line-based files, several files can go into the same list
+// an unweighted file in a weighted list gives each of its strings a weight of 1
+// prints what's wrong to stderr and returns false on failure
+bool CompileNaughtyCorpus(const std::vector<CorpusSource>& sources, const std::string& path);
@@ -0,0 +1,46 @@
+#pragma once
+
+// Runtime checks for the instruction set extensions the hot paths can use
+// These are cheap, but callers pick their implementation once and keep it
+
+#include <intrin.h>
+
+#if defined(_M_X64) || defined(_M_IX86)
+
+inline bool CpuHasSse2() noexcept {
+#ifdef _M_X64
+    return true;
+#else
+    int info[4]{};
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#endif
+}
+
+// carry-less multiply, used with SSE4.1 by the folded CRC32
+inline bool CpuHasPclmul() noexcept {
+    int info[4]{};
+    __cpuid(info, 1);
+    const bool pclmul = (info[2] & (1 << 1)) != 0;
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    return pclmul && sse41;
+}
+
+inline bool CpuHasAvx2() noexcept {
+    int info[4]{};
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // AVX needs the OS to save the YMM registers on a context switch
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+#endif
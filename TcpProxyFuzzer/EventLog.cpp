@@ -0,0 +1,126 @@
+// Binary fuzz event log writer, see EventLog.h for the format
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include "EventLog.h"
+
+namespace {
+    // which log and connection Fuzz() on this thread reports to
+    struct FuzzEventTarget {
+        EventLog*   log{ nullptr };
+        uint64_t    conn_id{ 0 };
+        uint8_t     dir{ 0 };
+    };
+
+    thread_local FuzzEventTarget tTarget{};
+
+    // the file buffer only needs to hold a block and its index
+    constexpr size_t FILE_BUFFER = (EVENT_BLOCK_RECORDS + 1) * EVENT_RECORD_SIZE;
+}
+
+uint64_t EventTimeNow() noexcept {
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+EventLog::~EventLog() {
+    Close();
+}
+
+bool EventLog::Open(const std::string& path) {
+    std::lock_guard lock(_lock);
+    if (_file)
+        return true;
+
+    if (fopen_s(&_file, path.c_str(), "wb") != 0 || _file == nullptr) {
+        _file = nullptr;
+        return false;
+    }
+
+    setvbuf(_file, nullptr, _IOFBF, FILE_BUFFER);
+
+    EventFileHeader header{};
+    memcpy(header.magic, EVENT_MAGIC, sizeof(header.magic));
+    header.version = EVENT_VERSION;
+    header.record_size = EVENT_RECORD_SIZE;
+    header.block_records = EVENT_BLOCK_RECORDS;
+    header.start_us = EventTimeNow();
+    fwrite(&header, sizeof(header), 1, _file);
+    fflush(_file);
+
+    _index = {};
+    _open = true;
+    return true;
+}
+
+void EventLog::Close() {
+    std::lock_guard lock(_lock);
+    if (_file == nullptr)
+        return;
+
+    // a partial block has no index, readers scan it
+    _open = false;
+    fclose(_file);
+    _file = nullptr;
+}
+
+void EventLog::Write(EventRecord record) {
+    std::lock_guard lock(_lock);
+    if (_file == nullptr)
+        return;
+
+    // stamped under the lock so times only go up through the file
+    record.time_us = EventTimeNow();
+    fwrite(&record, sizeof(record), 1, _file);
+
+    if (_index.index.count == 0) {
+        _index.time_us = record.time_us;
+        _index.conn_id = record.conn_id;
+    }
+
+    _index.index.time_max_us = record.time_us;
+    _index.conn_id = (std::min)(_index.conn_id, record.conn_id);
+    _index.index.conn_max = (std::max)(_index.index.conn_max, record.conn_id);
+    const uint64_t bit = record.conn_id % 128;
+    _index.index.conns[bit / 64] |= 1ull << (bit % 64);
+
+    if (++_index.index.count == EVENT_BLOCK_RECORDS) {
+        WriteIndex();
+        fflush(_file);
+    } else if (record.type == static_cast<uint8_t>(EventType::ConnClose)) {
+        fflush(_file);
+    }
+}
+
+// called with the lock held
+void EventLog::WriteIndex() {
+    _index.type = static_cast<uint8_t>(EventType::Index);
+    fwrite(&_index, sizeof(_index), 1, _file);
+    _index = {};
+}
+
+ScopedFuzzEvents::ScopedFuzzEvents(EventLog& log, uint64_t conn_id, uint8_t dir) noexcept {
+    if (log.IsOpen())
+        tTarget = { &log, conn_id, dir };
+}
+
+ScopedFuzzEvents::~ScopedFuzzEvents() {
+    tTarget = {};
+}
+
+void RecordMutation(uint16_t mutation, size_t start, size_t end, size_t skip) {
+    if (tTarget.log == nullptr)
+        return;
+
+    EventRecord record{};
+    record.type = static_cast<uint8_t>(EventType::Mutation);
+    record.dir = tTarget.dir;
+    record.mutation = mutation;
+    record.conn_id = tTarget.conn_id;
+    record.range.start = start;
+    record.range.end = end;
+    record.range.skip = skip;
+    tTarget.log->Write(record);
+}
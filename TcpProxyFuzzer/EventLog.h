@@ -0,0 +1,148 @@
+#pragma once
+
+// Binary fuzz event log
+// With -events:<file> the proxy appends a fixed-size record for every connection open and close,
+// every chunk received and sent on a fuzzed direction, and every mutation Fuzz() applies.
+// Records never move once written, so the file can be memory-mapped and read while it grows.
+//
+// Layout, little-endian, every part is EVENT_RECORD_SIZE bytes:
+//     EventFileHeader
+//     then blocks of EVENT_BLOCK_RECORDS EventRecords, each block followed by one Index record
+//     that summarizes it: time range, connection range and a bitmap of the connections in it
+// A reader can find every index without reading the blocks, block k's index is at a fixed offset,
+// so filtering on a connection or a time range only touches the blocks that can match.
+// The last block has no index until it fills up, readers scan it.
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+constexpr char EVENT_MAGIC[4] = { 'T', 'P', 'F', 'E' };
+constexpr uint32_t EVENT_VERSION = 1;
+constexpr size_t EVENT_RECORD_SIZE = 64;
+constexpr uint32_t EVENT_BLOCK_RECORDS = 255;   // so a block and its index are 16KB
+
+enum class EventType : uint8_t {
+    ConnOpen = 1,
+    ConnClose = 2,
+    Recv = 3,       // a chunk as it was read, before Fuzz()
+    Send = 4,       // the same chunk after Fuzz()
+    Mutation = 5,   // one mutation applied by Fuzz(), records follow the Recv they belong to
+    Index = 6
+};
+
+struct EventFileHeader {
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    record_size;
+    uint32_t    block_records;
+    uint64_t    start_us;           // when the log was opened, microseconds since the Unix epoch
+    uint8_t     reserved[40];
+};
+
+struct EventRecord {
+    uint8_t     type;               // EventType
+    uint8_t     dir;                // SocketDir
+    uint16_t    mutation;           // FuzzMutation, Mutation records only
+    uint32_t    size;               // bytes in the chunk, Recv and Send records only
+    uint64_t    time_us;            // microseconds since the Unix epoch, Index records: the earliest in the block
+    uint64_t    conn_id;            // Index records: the lowest in the block
+
+    union {
+        struct {
+            uint64_t    seed;       // this direction's seed, 0 unless -seed is on
+            uint32_t    fuzz_type;
+            uint32_t    fuzz_aggr;
+            uint32_t    offset;
+            uint32_t    fuzzed;     // 1 if this direction is fuzzed
+        } open;
+
+        struct {
+            uint64_t    bytes;      // forwarded in this direction
+            uint32_t    crc_in;     // -crc only
+            uint32_t    crc_out;
+        } close;
+
+        struct {
+            uint32_t    crc;        // CRC32 of the chunk
+        } chunk;
+
+        struct {
+            uint64_t    start;
+            uint64_t    end;
+            uint64_t    skip;
+        } range;            // the part of the chunk a Mutation record's mutation covered
+
+        struct {
+            uint64_t    time_max_us;
+            uint64_t    conn_max;
+            uint64_t    conns[2];   // bit (conn_id % 128) is set for every connection in the block
+            uint32_t    count;      // records in the block
+        } index;
+    };
+};
+
+static_assert(sizeof(EventFileHeader) == EVENT_RECORD_SIZE, "the header must be one record");
+static_assert(sizeof(EventRecord) == EVENT_RECORD_SIZE, "records must stay fixed size");
+
+// the bit an index record's conns bitmap uses for a connection
+inline bool EventIndexHasConn(const EventRecord& index, uint64_t conn_id) noexcept {
+    const uint64_t bit = conn_id % 128;
+    return (index.index.conns[bit / 64] & (1ull << (bit % 64))) != 0;
+}
+
+// Appends records to an event log, it's shared by every forwarding thread
+// Writing a record is a 64-byte copy into the file buffer under a lock, the buffer is written
+// when a block's index goes out and whenever a connection closes, so a killed proxy
+// loses at most the events of connections that were still open.
+class EventLog {
+public:
+    EventLog() = default;
+    ~EventLog();
+
+    // creates the file, returns false if it can't be
+    bool Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const noexcept {
+        return _open.load(std::memory_order_relaxed);
+    }
+
+    // stamps the time on the record and appends it
+    void Write(EventRecord record);
+
+    EventLog(const EventLog&) = delete;
+    EventLog(EventLog&&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+    EventLog& operator=(EventLog&&) = delete;
+
+private:
+    void WriteIndex();
+
+    std::mutex  _lock{};
+    FILE*       _file{ nullptr };
+    EventRecord _index{};
+    std::atomic<bool> _open{ false };
+};
+
+// microseconds since the Unix epoch
+uint64_t EventTimeNow() noexcept;
+
+// Makes Fuzz() on this thread record its mutations against a connection until the object goes away
+// ProcessChunk() sets this up around Fuzz(), the same way it swaps in the seeded generator
+// Nothing is recorded if the log isn't open
+class ScopedFuzzEvents {
+public:
+    ScopedFuzzEvents(EventLog& log, uint64_t conn_id, uint8_t dir) noexcept;
+    ~ScopedFuzzEvents();
+
+    ScopedFuzzEvents(const ScopedFuzzEvents&) = delete;
+    ScopedFuzzEvents(ScopedFuzzEvents&&) = delete;
+    ScopedFuzzEvents& operator=(const ScopedFuzzEvents&) = delete;
+    ScopedFuzzEvents& operator=(ScopedFuzzEvents&&) = delete;
+};
+
+// called by Fuzz() for each mutation, does nothing unless a ScopedFuzzEvents is active on the thread
+void RecordMutation(uint16_t mutation, size_t start, size_t end, size_t skip);
@@ -0,0 +1,509 @@
+// Poll-based forwarding engine
+// Rather than two blocking threads per connection, a small, fixed set of worker loops
+// multiplex non-blocking sockets with WSAPoll(). Each loop owns its sessions outright
+// so there is no locking on the data path, only when a new connection is handed over.
+
+#define  _WINSOCK_DEPRECATED_NO_WARNINGS 1
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <process.h>
+#include <windows.h>
+#include <stdio.h>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "Proxy.h"
+#include "WakeSocket.h"
+#include "Stats.h"
+#include "BufferPool.h"
+#include "SendQueue.h"
+#include "gsl/util"
+
+namespace {
+
+    // One half of a proxied connection
+    // every read goes into its own pooled buffer, which is queued as is until it's been sent,
+    // with -frame a fuzzed direction reads into its framer instead and queues the pieces it hands back
+    struct Direction {
+        ConnectionData      conn{};
+        bool                bFuzz{ false };
+        SendQueue           queue{};        // read from conn.src_sock, waiting to go to conn.dst_sock
+        uint64_t            bytes{ 0 };     // total forwarded
+        StatClock::time_point lastRead{};   // for idling
+        BufferSizer         sizer{};
+        Framer              framer{ gOptions.frame };
+        std::vector<char>   readBuffer{};   // a fuzzed direction reads into this, it stays at sizer.Size()
+
+        bool Framed() const noexcept {
+            return bFuzz && framer.Enabled();
+        }
+
+        bool HasPending() const noexcept {
+            return !queue.Empty();
+        }
+
+        // a full queue stops the reads until the destination catches up
+        bool CanRead() const noexcept {
+            return !queue.Full();
+        }
+    };
+
+    struct Session {
+        SOCKET                  client_sock{ INVALID_SOCKET };
+        SOCKET                  target_sock{ INVALID_SOCKET };
+        std::array<Direction,2> dir{};      // indexed by SocketDir
+        bool                    closing{ false };
+
+        Direction& ClientToServer() noexcept { return gsl::at(dir, static_cast<int>(SocketDir::ClientToServer)); }
+        Direction& ServerToClient() noexcept { return gsl::at(dir, static_cast<int>(SocketDir::ServerToClient)); }
+    };
+
+    class EventLoop {
+    public:
+        EventLoop() = default;
+
+        bool Init();
+        void Add(std::unique_ptr<Session> session);
+        void Run();
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop(EventLoop&&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+        EventLoop& operator=(EventLoop&&) = delete;
+
+    private:
+        void AdoptPending();
+        bool Service(Session& s, short clientEvents, short targetEvents);
+        bool Read(Direction& d);
+        bool ReadFrames(Direction& d);
+        void QueueFrames(Direction& d, StatClock::time_point received);
+        bool Flush(Direction& d);
+        void ShrinkIdle();
+        void FlushIdleFrames();
+        void Close(Session& s);
+
+        // used to break out of WSAPoll() when another thread hands over a new session
+        WakeSocket      _wake{};
+
+        std::mutex                              _pendingLock{};
+        std::vector<std::unique_ptr<Session>>   _pending{};
+        std::vector<std::unique_ptr<Session>>   _sessions{};
+
+        // every read's buffer comes from here and goes back once it's been sent
+        BufferPool      _buffers{};
+        StatClock::time_point   _lastShrink{};
+        StatClock::time_point   _lastFrameFlush{};
+    };
+
+    std::vector<std::unique_ptr<EventLoop>> gLoops{};
+    std::atomic<size_t>                     gNextLoop{ 0 };
+
+    unsigned __stdcall loop_thread(_In_ void* data) {
+        EventLoop* loop = static_cast<EventLoop*>(data);
+        loop->Run();
+
+        return 0;
+    }
+}
+
+#pragma region Event Loop
+
+bool EventLoop::Init() {
+    return _wake.Init();
+}
+
+// called from the accept thread
+void EventLoop::Add(std::unique_ptr<Session> session) {
+    {
+        std::lock_guard lock(_pendingLock);
+        _pending.push_back(std::move(session));
+    }
+
+    _wake.Wake();
+}
+
+// called on the loop thread, takes ownership of newly added sessions
+void EventLoop::AdoptPending() {
+    _wake.Drain();
+
+    std::vector<std::unique_ptr<Session>> incoming{};
+    {
+        std::lock_guard lock(_pendingLock);
+        incoming.swap(_pending);
+    }
+
+    for (auto& s : incoming) {
+        for (auto& d : s->dir)
+            BeginForwarding(&d.conn, d.bFuzz);
+
+        _sessions.push_back(std::move(s));
+    }
+}
+
+void EventLoop::Run() {
+    std::vector<WSAPOLLFD> fds{};
+
+    while (true) {
+        AdoptPending();
+
+        // slot 0 is the wake socket, then a client/target pair per session
+        fds.clear();
+        fds.push_back({ _wake.Socket(), POLLRDNORM, 0 });
+
+        bool grown = false, holding = false;
+        for (const auto& s : _sessions) {
+            const Direction& c2s = s->ClientToServer();
+            const Direction& s2c = s->ServerToClient();
+            grown = grown || c2s.sizer.Grown() || s2c.sizer.Grown();
+            holding = holding || c2s.framer.Holding() || s2c.framer.Holding();
+
+            // only read from a socket while what's been read from it and not yet sent is under -send_queue,
+            // which stops a slow receiver from making us buffer without limit
+            short clientEvents = 0, targetEvents = 0;
+            if (!s->closing && c2s.CanRead()) clientEvents |= POLLRDNORM;
+            if (!s->closing && s2c.CanRead()) targetEvents |= POLLRDNORM;
+            if (s2c.HasPending()) clientEvents |= POLLWRNORM;
+            if (c2s.HasPending()) targetEvents |= POLLWRNORM;
+
+            // WSAPoll() reports POLLHUP whatever was asked for, so a socket that's closed while its read is
+            // paused would wake every poll until the queue drained, with nothing to do, a socket with nothing
+            // asked for is left out, INVALID_SOCKET keeps its slot and WSAPoll() skips it
+            fds.push_back({ clientEvents ? s->client_sock : INVALID_SOCKET, clientEvents, 0 });
+            fds.push_back({ targetEvents ? s->target_sock : INVALID_SOCKET, targetEvents, 0 });
+        }
+
+        // grown buffers and held messages are checked for idling, so the loop can't sleep for longer than that
+        int timeout = -1;
+        if (holding)
+            timeout = static_cast<int>(FRAME_IDLE_MS);
+        else if (grown)
+            timeout = static_cast<int>(BUFFER_IDLE_MS);
+
+        if (WSAPoll(fds.data(), gsl::narrow_cast<ULONG>(fds.size()), timeout) == SOCKET_ERROR) {
+            fprintf(stderr, "WSAPoll failed. Error: %d\n", WSAGetLastError());
+            continue;
+        }
+
+        // service every session, closing and removing the ones that are done
+        size_t keep = 0;
+        for (size_t i = 0; i < _sessions.size(); i++) {
+            auto& s = _sessions.at(i);
+            const short clientEvents = fds.at(1 + i * 2).revents;
+            const short targetEvents = fds.at(2 + i * 2).revents;
+
+            if (Service(*s, clientEvents, targetEvents)) {
+                if (keep != i)
+                    _sessions.at(keep) = std::move(s);
+                keep++;
+            } else {
+                Close(*s);
+            }
+        }
+
+        _sessions.resize(keep);
+
+        if (grown)
+            ShrinkIdle();
+
+        if (holding)
+            FlushIdleFrames();
+    }
+}
+
+// drops directions that have read nothing for BUFFER_IDLE_MS back to -buffer
+// it's a walk over every session, so it's done at most once per BUFFER_IDLE_MS
+void EventLoop::ShrinkIdle() {
+    const auto now = StatClock::now();
+    const auto idle = std::chrono::milliseconds(BUFFER_IDLE_MS);
+    if (now - _lastShrink < idle)
+        return;
+
+    _lastShrink = now;
+    for (auto& s : _sessions) {
+        for (auto& d : s->dir) {
+            if (d.sizer.Grown() && !d.HasPending() && now - d.lastRead >= idle)
+                d.sizer.Shrink();
+        }
+    }
+}
+
+// passes on the held part of any message that's been waiting FRAME_IDLE_MS for the rest of it,
+// it's queued here and goes out when the destination is next writable
+void EventLoop::FlushIdleFrames() {
+    const auto now = StatClock::now();
+    const auto idle = std::chrono::milliseconds(FRAME_IDLE_MS);
+    if (now - _lastFrameFlush < idle)
+        return;
+
+    _lastFrameFlush = now;
+    for (auto& s : _sessions) {
+        for (auto& d : s->dir) {
+            if (d.framer.Holding() && now - d.lastRead >= idle) {
+                d.framer.Flush();
+                QueueFrames(d, now);
+            }
+        }
+    }
+}
+
+// returns false when the session is finished and should be closed
+bool EventLoop::Service(Session& s, short clientEvents, short targetEvents) {
+    if ((clientEvents | targetEvents) & (POLLERR | POLLNVAL)) {
+        // an error on the target's socket is almost always it resetting the connection
+        if (targetEvents & POLLERR)
+            NoteServerEnd(&s.ServerToClient().conn, WSAECONNRESET);
+
+        return false;
+    }
+
+    Direction& c2s = s.ClientToServer();
+    Direction& s2c = s.ServerToClient();
+
+    // drain outstanding sends first, that frees the direction to read again
+    if ((clientEvents & POLLWRNORM) && !Flush(s2c)) return false;
+    if ((targetEvents & POLLWRNORM) && !Flush(c2s)) return false;
+
+    constexpr short readable = POLLRDNORM | POLLHUP;
+    if (!s.closing && (clientEvents & readable) && c2s.CanRead() && !Read(c2s))
+        s.closing = true;
+
+    if (!s.closing && (targetEvents & readable) && s2c.CanRead() && !Read(s2c))
+        s.closing = true;
+
+    // when one side goes away, send what's left then tear down both sides
+    // the same as the thread engine does, what either framer is holding is part of what's left, the rest
+    // of that message won't come now
+    if (s.closing) {
+        const auto now = StatClock::now();
+        for (auto& d : s.dir) {
+            if (d.framer.Holding()) {
+                d.framer.Flush();
+                QueueFrames(d, now);
+            }
+        }
+    }
+
+    const auto pending = [](const Direction& d) noexcept { return d.HasPending() || d.framer.Holding(); };
+    return !(s.closing && !pending(c2s) && !pending(s2c));
+}
+
+// returns false on EOF or error
+bool EventLoop::Read(Direction& d) {
+    if (d.Framed())
+        return ReadFrames(d);
+
+    // a pooled buffer keeps its size, so a passthrough direction's is only zero-filled when its size changes
+    // a fuzzed chunk is cut to the read and Fuzz() can change its length, so a fuzzed direction reads into
+    // a buffer of its own that keeps its size and hands the read on at its length, see below
+    std::vector<char> buffer{};
+    if (d.bFuzz) {
+        _buffers.Refit(d.readBuffer, d.sizer.Size());
+        std::swap(buffer, d.readBuffer);
+    } else {
+        buffer = _buffers.Acquire(d.sizer.Size());
+    }
+
+    if (buffer.size() != d.sizer.Size())
+        buffer.resize(d.sizer.Size());
+
+    const int bytes_received = recv(d.conn.src_sock, buffer.data(), gsl::narrow_cast<int>(buffer.size()), 0);
+    if (bytes_received <= 0) {
+        const int error = bytes_received == 0 ? 0 : WSAGetLastError();
+        if (d.bFuzz)
+            std::swap(buffer, d.readBuffer);
+        else
+            _buffers.Release(std::move(buffer));
+
+        if (error == WSAEWOULDBLOCK)
+            return true;
+
+        NoteServerEnd(&d.conn, error);
+        return false;
+    }
+
+    const size_t dir = static_cast<size_t>(d.conn.sock_dir);
+    QueuedChunk chunk{};
+    chunk.received = d.lastRead = StatClock::now();
+    d.sizer.OnRead(bytes_received);
+    CountStat(BytesInCounter(dir), bytes_received);
+
+    // passthrough directions send straight from the buffer, untouched
+    if (d.bFuzz) {
+        // a full read swaps places with a full pooled buffer, anything else is copied out at its length,
+        // so the read buffer is never cut short and never zero-filled back out
+        std::vector<char> chunkBuffer = _buffers.Acquire(d.sizer.Size());
+        const size_t read = static_cast<size_t>(bytes_received);
+        if (read == buffer.size() && chunkBuffer.size() == read) {
+            std::swap(chunkBuffer, buffer);
+        } else {
+            chunkBuffer.assign(buffer.begin(), buffer.begin() + bytes_received);
+        }
+
+        d.readBuffer = std::move(buffer);
+        buffer = std::move(chunkBuffer);
+
+        ProcessChunk(&d.conn, d.bFuzz, buffer, chunk.insert);
+        chunk.len = buffer.size();
+    } else {
+        NoteServerRead(&d.conn, gsl::span<const char>(buffer.data(), bytes_received));
+        chunk.len = bytes_received;
+    }
+
+    chunk.buffer = std::move(buffer);
+    d.queue.Push(std::move(chunk));
+
+    return Flush(d);
+}
+
+// reads into the framer, and queues whatever it has ready
+// returns false on EOF or error
+bool EventLoop::ReadFrames(Direction& d) {
+    const gsl::span<char> space = d.framer.ReadSpace(d.sizer.Size());
+    const int bytes_received = recv(d.conn.src_sock, space.data(), gsl::narrow_cast<int>(space.size()), 0);
+    if (bytes_received <= 0) {
+        const int error = bytes_received == 0 ? 0 : WSAGetLastError();
+        d.framer.Commit(0);
+        if (error == WSAEWOULDBLOCK)
+            return true;
+
+        NoteServerEnd(&d.conn, error);
+
+        // what's held of a last message still goes, the session sends what's queued before it closes
+        if (bytes_received == 0) {
+            d.framer.Flush();
+            QueueFrames(d, StatClock::now());
+        }
+
+        return false;
+    }
+
+    d.lastRead = StatClock::now();
+    d.sizer.OnRead(bytes_received);
+    CountStat(BytesInCounter(static_cast<size_t>(d.conn.sock_dir)), bytes_received);
+
+    d.framer.Commit(bytes_received);
+    QueueFrames(d, d.lastRead);
+
+    return Flush(d);
+}
+
+// a read can finish more than one message, they're all queued, so the queue can go over -send_queue by
+// that read's worth before the direction stops reading
+void EventLoop::QueueFrames(Direction& d, StatClock::time_point received) {
+    while (d.framer.Ready()) {
+        QueuedChunk chunk{};
+        chunk.received = received;
+
+        std::vector<char> buffer = _buffers.Acquire(d.sizer.Size());
+        const bool whole = d.framer.Next(buffer);
+        ProcessChunk(&d.conn, d.bFuzz, buffer, chunk.insert, whole);
+
+        chunk.len = buffer.size();
+        chunk.buffer = std::move(buffer);
+        d.queue.Push(std::move(chunk));
+    }
+}
+
+// sends as much of the queue as the socket will take, a fuzzed chunk's insert is gathered in
+// with the buffer either side of it, so it's never copied into place
+// returns false on a send error
+bool EventLoop::Flush(Direction& d) {
+    const size_t dir = static_cast<size_t>(d.conn.sock_dir);
+    std::array<WSABUF, 3> bufs{};
+
+    while (d.HasPending()) {
+        QueuedChunk& chunk = d.queue.Front();
+        const FuzzOutput output = chunk.Output();
+
+        DWORD bytes_sent{};
+        const ULONG count = GatherOutput(output, chunk.sent, bufs);
+        if (WSASend(d.conn.dst_sock, bufs.data(), count, &bytes_sent, 0, NULL, NULL) == SOCKET_ERROR)
+            return WSAGetLastError() == WSAEWOULDBLOCK;
+
+        chunk.sent += bytes_sent;
+        d.bytes += bytes_sent;
+        CountStat(BytesOutCounter(dir), bytes_sent);
+
+        // a partial send goes round again for the rest, which usually finds the socket full and waits for POLLWRNORM
+        if (chunk.sent < output.Size())
+            continue;
+
+        RecordLatencySince(ChunkLatencyHistogram(dir, StatFuzzMode(d.bFuzz, d.conn.fuzz_type)), chunk.received);
+        _buffers.Release(d.queue.Pop());
+    }
+
+    return true;
+}
+
+void EventLoop::Close(Session& s) {
+    closesocket(s.client_sock);
+    closesocket(s.target_sock);
+
+    for (auto& d : s.dir) {
+        EndForwarding(&d.conn, d.bFuzz, d.bytes);
+
+        // anything still queued couldn't be sent
+        while (d.HasPending())
+            _buffers.Release(d.queue.Pop());
+
+        _buffers.Release(d.framer.Release());
+        _buffers.Release(std::move(d.readBuffer));
+    }
+}
+
+#pragma endregion Event Loop
+
+#pragma region Engine API
+
+bool StartEventLoops(unsigned int count) {
+    if (count == 0)
+        count = 1;
+
+    for (unsigned int i = 0; i < count; i++) {
+        auto loop = std::make_unique<EventLoop>();
+        if (!loop->Init()) {
+            fprintf(stderr, "Event loop creation failed. Error: %d\n", WSAGetLastError());
+            return false;
+        }
+
+        gLoops.push_back(std::move(loop));
+    }
+
+    for (size_t i = 0; i < gLoops.size(); i++) {
+        const auto thread = _beginthreadex(NULL, 0, loop_thread, gLoops.at(i).get(), 0, NULL);
+        if (thread == 0) {
+            fprintf(stderr, "Event loop thread creation failed. Error: %d\n", errno);
+            return false;
+        }
+
+        PinThread(reinterpret_cast<HANDLE>(thread), i);
+        CloseHandle(reinterpret_cast<HANDLE>(thread));
+    }
+
+    return true;
+}
+
+// hands a connected client/target pair to one of the shard's loops
+void AddToEventLoop(_In_ const ConnectionData& client_to_target, _In_ const ConnectionData& target_to_client, size_t shard) {
+    u_long nonBlocking = 1;
+    ioctlsocket(client_to_target.src_sock, FIONBIO, &nonBlocking);
+    ioctlsocket(client_to_target.dst_sock, FIONBIO, &nonBlocking);
+
+    auto session = std::make_unique<Session>();
+    session->client_sock = client_to_target.src_sock;
+    session->target_sock = client_to_target.dst_sock;
+    session->ClientToServer().conn = client_to_target;
+    session->ClientToServer().bFuzz = ShouldFuzz(&client_to_target);
+    session->ServerToClient().conn = target_to_client;
+    session->ServerToClient().bFuzz = ShouldFuzz(&target_to_client);
+
+    const size_t which = PickLoop(shard, gLoops.size(), gNextLoop++);
+    gLoops.at(which)->Add(std::move(session));
+}
+
+#pragma endregion Engine API
@@ -0,0 +1,551 @@
+// Message framing, see Framer.h
+
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <limits>
+
+#include "Framer.h"
+#include "Stats.h"
+#include "gsl/util"
+
+namespace {
+
+    constexpr std::string_view kHttpHeadersEnd = "\r\n\r\n";
+
+    bool EqualsNoCase(std::string_view a, std::string_view b) noexcept {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+            [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+    }
+
+    bool ContainsNoCase(std::string_view text, std::string_view word) noexcept {
+        for (size_t i = 0; i + word.size() <= text.size(); i++) {
+            if (EqualsNoCase(text.substr(i, word.size()), word))
+                return true;
+        }
+
+        return false;
+    }
+
+    std::string_view Trim(std::string_view text) noexcept {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+            text.remove_prefix(1);
+
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+            text.remove_suffix(1);
+
+        return text;
+    }
+
+    int HexValue(char c) noexcept {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // the delimiter with its escapes turned into bytes, empty if it's malformed
+    std::string Unescape(std::string_view text) {
+        std::string out{};
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] != '\\') {
+                out += text[i];
+                continue;
+            }
+
+            if (++i == text.size())
+                return {};
+
+            switch (text[i]) {
+                case 'r':  out += '\r'; break;
+                case 'n':  out += '\n'; break;
+                case 't':  out += '\t'; break;
+                case '0':  out += '\0'; break;
+                case '\\': out += '\\'; break;
+                case 'x': {
+                    const int hi = i + 1 < text.size() ? HexValue(text[i + 1]) : -1;
+                    const int lo = i + 2 < text.size() ? HexValue(text[i + 2]) : -1;
+                    if (hi < 0 || lo < 0)
+                        return {};
+
+                    out += static_cast<char>(hi * 16 + lo);
+                    i += 2;
+                }
+                break;
+
+                default:
+                    return {};
+            }
+        }
+
+        return out;
+    }
+
+    // splits the -frame value on colons
+    std::vector<std::string> SplitFields(const std::string& value) {
+        std::vector<std::string> fields{};
+        size_t start = 0;
+        while (true) {
+            const auto colon = value.find(':', start);
+            fields.push_back(value.substr(start, colon - start));
+            if (colon == std::string::npos)
+                return fields;
+
+            start = colon + 1;
+        }
+    }
+}
+
+bool ParseFrameSettings(const std::string& value, FrameSettings& settings) {
+    if (value == "none") {
+        settings.kind = FrameKind::None;
+        return true;
+    }
+
+    if (value == "http") {
+        settings.kind = FrameKind::Http;
+        return true;
+    }
+
+    // the delimiter can have colons in it, so it's everything after the first
+    if (value.starts_with("delim:")) {
+        settings.delimiter = Unescape(value.substr(6));
+        if (settings.delimiter.empty() || settings.delimiter.size() > MAX_FRAME_DELIMITER)
+            return false;
+
+        settings.kind = FrameKind::Delimiter;
+        return true;
+    }
+
+    // length:<offset>:<size>[:<header size>][:le|be][:incl]
+    const std::vector<std::string> fields = SplitFields(value);
+    if (fields.size() < 3 || fields.at(0) != "length")
+        return false;
+
+    settings.length_offset = std::stoul(fields.at(1));
+    settings.length_size = std::stoul(fields.at(2));
+    settings.header_size = settings.length_offset + settings.length_size;
+
+    for (size_t i = 3; i < fields.size(); i++) {
+        const std::string& field = fields.at(i);
+        if (field == "le")                  settings.little_endian = true;
+        else if (field == "be")             settings.little_endian = false;
+        else if (field == "incl")           settings.length_includes_header = true;
+        else if (i == 3 && !field.empty() && std::isdigit(static_cast<unsigned char>(field.front())))
+            settings.header_size = std::stoul(field);
+        else return false;
+    }
+
+    if (settings.length_size == 0 || settings.length_size > sizeof(uint64_t) ||
+        settings.header_size < settings.length_offset + settings.length_size || settings.header_size > MAX_FRAME_HEADER)
+        return false;
+
+    settings.kind = FrameKind::Length;
+    return true;
+}
+
+#pragma region Delimiter Matcher
+
+void DelimiterMatcher::Reset(std::string_view delimiter) noexcept {
+    _length = (std::min)(delimiter.size(), MAX_FRAME_DELIMITER);
+    _matched = 0;
+    std::copy_n(delimiter.begin(), _length, _delimiter.begin());
+
+    // KMP: after a mismatch with k bytes matched, the longest prefix that's also a suffix of those k is still matched
+    if (_length)
+        _fallback[0] = 0;
+
+    size_t k = 0;
+    for (size_t i = 1; i < _length; i++) {
+        while (k > 0 && _delimiter[i] != _delimiter[k])
+            k = _fallback[k - 1];
+
+        if (_delimiter[i] == _delimiter[k])
+            k++;
+
+        _fallback[i] = gsl::narrow_cast<uint8_t>(k);
+    }
+}
+
+size_t DelimiterMatcher::Find(gsl::span<const char> data, bool& found) noexcept {
+    found = false;
+    size_t i = 0;
+    while (i < data.size()) {
+        // nothing matched, so memchr() skips to the next place the delimiter could start
+        if (_matched == 0) {
+            const void* first = memchr(data.data() + i, _delimiter[0], data.size() - i);
+            if (first == nullptr)
+                return data.size();
+
+            i = static_cast<size_t>(static_cast<const char*>(first) - data.data()) + 1;
+            _matched = 1;
+        } else {
+            const char c = data[i++];
+            while (_matched > 0 && c != _delimiter[_matched])
+                _matched = _fallback[_matched - 1];
+
+            if (c == _delimiter[_matched])
+                _matched++;
+        }
+
+        if (_matched == _length) {
+            _matched = 0;
+            found = true;
+            return i;
+        }
+    }
+
+    return i;
+}
+
+#pragma endregion Delimiter Matcher
+
+#pragma region Framer
+
+Framer::Framer(const FrameSettings& settings) noexcept
+    : _settings(settings), _state(StartState()) {
+    if (_settings.kind == FrameKind::Delimiter)
+        _matcher.Reset(_settings.delimiter);
+    else if (_settings.kind == FrameKind::Http)
+        _matcher.Reset(kHttpHeadersEnd);
+}
+
+Framer::State Framer::StartState() const noexcept {
+    switch (_settings.kind) {
+        case FrameKind::Length:     return State::LengthHeader;
+        case FrameKind::Delimiter:  return State::Delimited;
+        case FrameKind::Http:       return State::HttpHeaders;
+        default:                    return State::Raw;
+    }
+}
+
+gsl::span<char> Framer::ReadSpace(size_t size) {
+    // a message after one that's been handed out is moved to the front, rather than the buffer growing
+    if (_begin > 0 && _buffer.size() - _end < size) {
+        std::copy(_buffer.begin() + _begin, _buffer.begin() + _end, _buffer.begin());
+        _end -= _begin;
+        _scan -= _begin;
+        _ready = _ready ? _ready - _begin : 0;
+        _begin = 0;
+    }
+
+    // the buffer is kept at its capacity and never shrinks, so only room it's never had is zero-filled
+    if (_buffer.size() - _end < size) {
+        _buffer.resize(_end + size);
+        _buffer.resize(_buffer.capacity());
+    }
+
+    _readAt = _end;
+
+    return gsl::span<char>(_buffer.data() + _readAt, size);
+}
+
+void Framer::Commit(size_t bytes) {
+    _end = _readAt + bytes;
+    Scan();
+}
+
+bool Framer::Next(std::vector<char>& out) {
+    const size_t end = _ready;
+    const bool message = _readyMessage;
+
+    // out goes to Fuzz() at the piece's length, so it's copied rather than the buffer handed over,
+    // which would have to be zero-filled back out before the next read
+    out.assign(_buffer.begin() + _begin, _buffer.begin() + end);
+    _begin = end;
+
+    if (_begin == _end)
+        _begin = _scan = _end = 0;
+
+    _ready = 0;
+    Scan();
+
+    return message;
+}
+
+void Framer::Flush() {
+    if (!Holding())
+        return;
+
+    // a header can't be parsed once part of it has gone, so there's no getting back in step after one
+    if (_state == State::LengthHeader || _state == State::HttpHeaders) {
+        GiveUp();
+    } else if (_settings.kind == FrameKind::Http) {
+        // an HTTP body that stops short is usually one that was never sent, eg; a HEAD response's
+        // Content-Length, so what's held goes as it is and the next read starts a message
+        _scan = _end;
+        MarkOversize();
+        EndMessage();
+    } else if (!_oversize) {
+        MarkOversize();
+    }
+
+    Scan();
+}
+
+std::vector<char> Framer::Release() noexcept {
+    _begin = _scan = _ready = _end = 0;
+    return std::move(_buffer);
+}
+
+// looks for the end of the current message, stopping at the first piece that's ready
+void Framer::Scan() {
+    while (_ready == 0 && _scan < _end) {
+        if (Step())
+            EndMessage();
+    }
+
+    if (_ready != 0 || _scan == _begin)
+        return;
+
+    if (!_oversize && _scan - _begin > _settings.max_frame) {
+        if (_state == State::HttpHeaders)
+            GiveUp();
+        else
+            MarkOversize();
+    }
+
+    // an oversized message goes out as it arrives
+    if (_oversize) {
+        _ready = _scan;
+        _readyMessage = false;
+    }
+}
+
+// moves _scan on through the current state, returns true when the message ends at _scan
+bool Framer::Step() {
+    const size_t size = _end;
+
+    switch (_state) {
+        case State::LengthHeader: {
+            const size_t header = _settings.header_size;
+            if (size - _begin < header) {
+                _scan = size;
+                return false;
+            }
+
+            uint64_t length = 0;
+            for (size_t i = 0; i < _settings.length_size; i++) {
+                const size_t at = _settings.little_endian ? _settings.length_size - 1 - i : i;
+                length = (length << 8) | static_cast<unsigned char>(_buffer[_begin + _settings.length_offset + at]);
+            }
+
+            // a length that doesn't even cover the header is taken as a message that's just the header
+            uint64_t total = _settings.length_includes_header ? length : length + header;
+            if (total < length || total < header)
+                total = _settings.length_includes_header ? header : (std::numeric_limits<uint64_t>::max)();
+
+            _scan = _begin + header;
+            _left = total - header;
+            _state = State::Body;
+            if (total > _settings.max_frame)
+                MarkOversize();
+
+            return _left == 0;
+        }
+
+        case State::Body:
+        case State::HttpChunkData: {
+            const size_t n = static_cast<size_t>((std::min)(_left, static_cast<uint64_t>(size - _scan)));
+            _scan += n;
+            _left -= n;
+            if (_left != 0)
+                return false;
+
+            if (_state == State::Body)
+                return true;
+
+            _state = State::HttpChunkSize;
+            _chunkDigits = _chunkExtension = false;
+            return false;
+        }
+
+        case State::Delimited:
+        case State::HttpHeaders: {
+            bool found = false;
+            _scan += _matcher.Find(gsl::span<const char>(_buffer.data() + _scan, size - _scan), found);
+            if (!found)
+                return false;
+
+            return _state == State::Delimited || HttpBody();
+        }
+
+        case State::HttpChunkSize:
+            while (_scan < size) {
+                const char c = _buffer[_scan++];
+                if (c == '\n') {
+                    if (!_chunkDigits) {
+                        GiveUp();
+                        return false;
+                    }
+
+                    // the last chunk is 0, then trailers up to a blank line, the others have a CRLF after them
+                    if (_left == 0) {
+                        _state = State::HttpTrailers;
+                        _lineLength = 0;
+                    } else {
+                        _left += 2;
+                        _state = State::HttpChunkData;
+                    }
+
+                    return false;
+                }
+
+                if (_chunkExtension)
+                    continue;
+
+                const int digit = HexValue(c);
+                if (digit < 0) {
+                    _chunkExtension = true;
+                    continue;
+                }
+
+                if (_left > ((std::numeric_limits<uint64_t>::max)() >> 4)) {
+                    GiveUp();
+                    return false;
+                }
+
+                _left = _left * 16 + static_cast<uint64_t>(digit);
+                _chunkDigits = true;
+            }
+
+            return false;
+
+        case State::HttpTrailers:
+            while (_scan < size) {
+                const char c = _buffer[_scan++];
+                if (c == '\n') {
+                    if (_lineLength == 0)
+                        return true;
+
+                    _lineLength = 0;
+                } else if (c != '\r') {
+                    _lineLength++;
+                }
+            }
+
+            return false;
+
+        case State::Raw:
+        default:
+            _scan = size;
+            return false;
+    }
+}
+
+// the headers of an HTTP message are [_begin, _scan), this works out how its body ends
+// returns true if it doesn't have one
+bool Framer::HttpBody() {
+    std::string_view head(_buffer.data() + _begin, _scan - _begin);
+
+    // blank lines between messages are allowed
+    while (!head.empty() && (head.front() == '\r' || head.front() == '\n'))
+        head.remove_prefix(1);
+
+    const bool response = head.starts_with("HTTP/");
+    int status = 0;
+
+    uint64_t length = 0;
+    bool hasLength = false, chunked = false;
+
+    bool firstLine = true;
+    while (!head.empty()) {
+        const auto eol = head.find('\n');
+        const std::string_view line = Trim(head.substr(0, eol));
+        head.remove_prefix(eol == std::string_view::npos ? head.size() : eol + 1);
+
+        if (firstLine) {
+            firstLine = false;
+            const auto space = line.find(' ');
+            if (response && space != std::string_view::npos && space + 4 <= line.size()) {
+                for (size_t i = space + 1; i < space + 4 && std::isdigit(static_cast<unsigned char>(line[i])); i++)
+                    status = status * 10 + (line[i] - '0');
+            }
+
+            continue;
+        }
+
+        const auto colon = line.find(':');
+        if (colon == std::string_view::npos)
+            continue;
+
+        const std::string_view name = Trim(line.substr(0, colon));
+        const std::string_view value = Trim(line.substr(colon + 1));
+        if (EqualsNoCase(name, "Content-Length")) {
+            length = 0;
+            for (const char c : value) {
+                if (!std::isdigit(static_cast<unsigned char>(c)) || length > (std::numeric_limits<uint64_t>::max)() / 10)
+                    break;
+
+                length = length * 10 + static_cast<uint64_t>(c - '0');
+            }
+
+            hasLength = true;
+        } else if (EqualsNoCase(name, "Transfer-Encoding") && ContainsNoCase(value, "chunked")) {
+            chunked = true;
+        }
+    }
+
+    // switching protocols, whatever follows isn't HTTP
+    if (response && status == 101) {
+        _rawAfter = true;
+        return true;
+    }
+
+    if (response && (status / 100 == 1 || status == 204 || status == 304))
+        return true;
+
+    if (chunked) {
+        _state = State::HttpChunkSize;
+        _left = 0;
+        _chunkDigits = _chunkExtension = false;
+        return false;
+    }
+
+    if (hasLength) {
+        _state = State::Body;
+        _left = length;
+        if (length > _settings.max_frame - (std::min)(_settings.max_frame, _scan - _begin))
+            MarkOversize();
+
+        return length == 0;
+    }
+
+    // a response without a length goes on until the connection closes
+    if (response)
+        _rawAfter = true;
+
+    return true;
+}
+
+void Framer::EndMessage() {
+    _ready = _scan;
+    _readyMessage = !_oversize;
+    if (_readyMessage)
+        CountStat(StatCounter::Frames);
+
+    _oversize = false;
+    _left = 0;
+    _state = StartState();
+
+    if (_rawAfter)
+        GiveUp();
+}
+
+void Framer::MarkOversize() {
+    _oversize = true;
+    CountStat(StatCounter::FramesPassed);
+}
+
+void Framer::GiveUp() {
+    _state = State::Raw;
+    _rawAfter = false;
+    if (!_oversize)
+        MarkOversize();
+}
+
+#pragma endregion Framer
@@ -0,0 +1,155 @@
+#pragma once
+
+// Message framing, so a fuzzed direction is fuzzed a protocol message at a time rather than a recv() at a time
+// Without a framer, a message TCP splits over several reads is fuzzed once per read, and -offset counts
+// from wherever the split happened to fall. With -frame, a fuzzed direction reads into its framer, only
+// whole messages come back out, and each is fuzzed once with the offset counted from its start.
+//
+// Reads land straight in the framer's buffer after whatever part of a message it's holding, so a message
+// split over several reads is never moved while it's put together. The buffer is kept at its capacity,
+// so a read isn't zero-filled first, and each piece is copied out once at its length for Fuzz().
+// The framers scan as the bytes come in and never look at a byte twice.
+//
+// A message over -max_frame is passed through unfuzzed as it arrives rather than held, then framing picks
+// up again with the next one. A message that's been waiting FRAME_IDLE_MS for the rest of it goes the same
+// way, which covers a peer that doesn't send what the framer expects, eg; a response to a HEAD request
+// has a Content-Length and no body. An HTTP body that stops short ends its message there, so the next
+// response is framed from its status line, a length framed body is still waited out. Where that happens
+// in a header the framer can't get back in step, so the direction passes everything through from then on.
+// Framing is best effort, every byte is forwarded whatever the framer makes of it.
+//
+// Adding a framer is a FrameKind, its settings in FrameSettings, and its states in Framer::Step().
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+
+#include "gsl/span"
+
+// the default for -max_frame
+constexpr size_t MAX_FRAME_SIZE = 1024 * 1024;
+
+// how long a direction holds part of a message waiting for the rest before passing it on
+constexpr unsigned int FRAME_IDLE_MS = 200;
+
+constexpr size_t MAX_FRAME_HEADER = 64;
+constexpr size_t MAX_FRAME_DELIMITER = 16;
+
+enum class FrameKind {
+    None = 0,       // fuzz each recv() as it comes
+    Length = 1,     // a fixed size header holding the length
+    Delimiter = 2,  // messages end with a delimiter
+    Http = 3        // HTTP/1.1 requests and responses
+};
+
+struct FrameSettings {
+    FrameKind       kind{ FrameKind::None };
+    size_t          length_offset{ 0 };     // where the length is in the header
+    size_t          length_size{ 4 };       // 1 to 8 bytes
+    size_t          header_size{ 4 };       // at least length_offset + length_size
+    bool            little_endian{ false };
+    bool            length_includes_header{ false };
+    std::string     delimiter{};
+    size_t          max_frame{ MAX_FRAME_SIZE };
+};
+
+// parses the value of -frame, eg; length:0:4, length:2:2:6:le:incl, delim:\r\n or http
+// the delimiter takes \r, \n, \t, \0, \\ and \xNN escapes
+bool ParseFrameSettings(const std::string& value, FrameSettings& settings);
+
+// Finds a delimiter a byte at a time, so it can be split across reads and nothing is scanned twice
+class DelimiterMatcher {
+public:
+    DelimiterMatcher() = default;
+
+    void Reset(std::string_view delimiter) noexcept;
+
+    // returns how much of data it looked at, found is set if the delimiter ends there
+    size_t Find(gsl::span<const char> data, bool& found) noexcept;
+
+private:
+    std::array<char, MAX_FRAME_DELIMITER>       _delimiter{};
+    std::array<uint8_t, MAX_FRAME_DELIMITER>    _fallback{};    // how much is still matched after a mismatch
+    size_t                                      _length{ 0 };
+    size_t                                      _matched{ 0 };
+};
+
+// One direction's framer
+class Framer {
+public:
+    // settings is kept, it's gOptions.frame
+    explicit Framer(const FrameSettings& settings) noexcept;
+
+    bool Enabled() const noexcept {
+        return _settings.kind != FrameKind::None;
+    }
+
+    // room for size more bytes after what's held, recv() straight into it and then Commit() what was read
+    gsl::span<char> ReadSpace(size_t size);
+    void Commit(size_t bytes);
+
+    // there's a piece ready for Next()
+    bool Ready() const noexcept {
+        return _ready != 0;
+    }
+
+    // replaces what's in out with the next piece, out should have the capacity for it, so it's a copy
+    // and not an allocation
+    // returns true for a whole message, false for a piece that's passed through as is
+    bool Next(std::vector<char>& out);
+
+    // has part of a message and is waiting for the rest
+    bool Holding() const noexcept {
+        return _ready == 0 && _end > _begin;
+    }
+
+    // stops waiting for the rest of the held message, what's held is ready for Next() as is
+    void Flush();
+
+    // the buffer, for the pool when the direction closes
+    std::vector<char> Release() noexcept;
+
+    Framer(const Framer&) = delete;
+    Framer(Framer&&) = delete;
+    Framer& operator=(const Framer&) = delete;
+    Framer& operator=(Framer&&) = delete;
+
+private:
+    enum class State : uint8_t {
+        LengthHeader,   // waiting for the header
+        Body,           // _left bytes to go, then the message ends
+        Delimited,      // looking for the delimiter
+        HttpHeaders,    // looking for the blank line
+        HttpChunkSize,
+        HttpChunkData,  // _left bytes of chunk and its CRLF, then the next chunk size
+        HttpTrailers,
+        Raw             // framing has given up, everything passes through
+    };
+
+    State StartState() const noexcept;
+    void Scan();
+    bool Step();
+    bool HttpBody();
+    void EndMessage();
+    void MarkOversize();
+    void GiveUp();
+
+    const FrameSettings&    _settings;
+    std::vector<char>       _buffer{};      // kept at its capacity, what's been read ends at _end
+    size_t                  _end{ 0 };
+    size_t                  _begin{ 0 };    // where what hasn't been handed out starts
+    size_t                  _scan{ 0 };     // how far the framer has looked
+    size_t                  _ready{ 0 };    // the end of the piece that's ready, 0 if there isn't one
+    size_t                  _readAt{ 0 };   // where ReadSpace() starts
+    bool                    _readyMessage{ false };
+    State                   _state;
+    uint64_t                _left{ 0 };
+    bool                    _oversize{ false }; // the current message is being passed through as it arrives
+    bool                    _rawAfter{ false }; // once the current message ends, eg; after a 101 response
+    bool                    _chunkDigits{ false };
+    bool                    _chunkExtension{ false };
+    size_t                  _lineLength{ 0 };
+    DelimiterMatcher        _matcher{};
+};
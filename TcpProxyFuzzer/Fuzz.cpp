@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <memory.h>
 #include <sal.h>
 #include <memory>
@@ -8,14 +9,19 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <locale>
-#include <codecvt>
+#include <array>
 #include <vector>
 #include <algorithm>
 #include <iterator>  
+#include <format>
 
 #include "Logger.h"
-#include "rand.h"
+#include "Fuzz.h"
+#include "MutationKernels.h"
+#include "EventLog.h"
+#include "Stats.h"
+#include "Corpus.h"
+#include "MutationScheduler.h"
 #include "gsl\narrow"
 
 // Using Microsoft C++ Guidelines Support Library (GSL) 
@@ -25,181 +31,450 @@
 // https://github.com/microsoft/GSL/blob/main/docs/headers.md#gslspan
 #include "gsl\span" 
 
-// all the possible fuzz mutation types
-enum class FuzzMutation : uint32_t {
-	None,
-	RndByteSingle,
-	RndByteMultiple,
-	ChangeASCIIInt, 
-	SetUpperBit,
-	ResetUpperBit,
-	ZeroByteToNonZero,
-	InterestingNumber,
-	InterestingChar,
-	Truncate,
-	Grow,
-	OverlongUtf8,
-	NaughtyWord,
-	RndUnicode,
-	ReplaceInterestingChar,
-	Max
-};
-
 #pragma region Globals
 
-#ifdef _DEBUG
 extern Logger gLog;
-#endif
 
-// not going to bother fuzzing a small block
-constexpr size_t MIN_BUFF_LEN = 16;
+// the three-letter mutation codes on stderr, -quiet turns them off
+bool fuzzTrace = true;
 
 const std::string interestingChar{ "~!:;\\/,.%-_`$^&#@?+=|\n\r\t\a*<>()[]{}\'\b\v\"\f" };
 
-std::vector<std::string> naughty{};
-bool naughtyLoadAttempted = false;
+// each forwarding thread gets its own generator, there's no locking and no shared state
+thread_local RandomNumberGenerator rng{};
 
-std::vector<std::string> naughtyJson{};
-bool naughtyJsonLoadAttempted = false;
-
-std::vector<std::string> naughtyHtml{};
-bool naughtyHtmlLoadAttempted = false;
+RandomNumberGenerator& FuzzRng() noexcept {
+	return rng;
+}
 
-std::vector<std::string> naughtyXml{};
-bool naughtyXmlLoadAttempted = false;
+// what the last Fuzz() call on this thread did, for LastFuzzMutations()
+thread_local FuzzMutationSet lastMutations{ 0 };
 
-RandomNumberGenerator rng{};
+FuzzMutationSet LastFuzzMutations() noexcept {
+	return lastMutations;
+}
 #pragma endregion Globals
 
 #pragma region RNG and Naughty Files
 
-#pragma warning(push)
-#pragma warning(disable: 4996) // UTF8 encoding is deprecated, need to fix
+// a UTF-8 encoded character, held inline so making one doesn't allocate
+struct Utf8Char {
+	std::array<unsigned char, 3> bytes{};
+	size_t length{ 0 };
+};
 
-// Generates a random Unicode character
-std::string GetRandomUnicodeCharacter() {
+// Generates a random Unicode character from the Basic Multilingual Plane
+static Utf8Char GetRandomUnicodeCharacter() {
 
-	auto codePoint = rng.range(0x0000,0xFFFF).generate();
+	// Avoid surrogate pair range, generate again if in surrogate pair range
+	unsigned int codePoint{};
+	do {
+		codePoint = rng.range(0x0000,0xFFFF).generate();
+	} while (codePoint >= 0xD800 && codePoint <= 0xDFFF);
+
+	// nothing here needs more than three bytes
+	Utf8Char utf8{};
+	if (codePoint < 0x80) {
+		utf8.bytes = { gsl::narrow_cast<unsigned char>(codePoint) };
+		utf8.length = 1;
+	} else if (codePoint < 0x800) {
+		utf8.bytes = { gsl::narrow_cast<unsigned char>(0xC0 | (codePoint >> 6)),
+					   gsl::narrow_cast<unsigned char>(0x80 | (codePoint & 0x3F)) };
+		utf8.length = 2;
+	} else {
+		utf8.bytes = { gsl::narrow_cast<unsigned char>(0xE0 | (codePoint >> 12)),
+					   gsl::narrow_cast<unsigned char>(0x80 | ((codePoint >> 6) & 0x3F)),
+					   gsl::narrow_cast<unsigned char>(0x80 | (codePoint & 0x3F)) };
+		utf8.length = 3;
+	}
+
+	return utf8;
+}
 
-	// Avoid surrogate pair range, but recursively generate again if in surrogate pair range
-	if (codePoint >= 0xD800 && codePoint <= 0xDFFF) 
-		return GetRandomUnicodeCharacter(); 
+// picks a naughty string from the list for fuzz_type, empty if there isn't one
+// the view points into the corpus, nothing is copied
+static std::string_view GetNaughtyString(unsigned int fuzz_type) {
+	const auto range = NaughtyDrawRange(fuzz_type);
+	if (range == 0)
+		return {};
 
-	std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
-	return converter.to_bytes(std::wstring(1, gsl::narrow<wchar_t>(codePoint)));
+	return NaughtyString(fuzz_type, rng.range(0, range).generate());
 }
-#pragma warning(pop)
-
-// Load a file of naughty strings
-static void LoadNaughtyFile(std::string filename, std::vector<std::string>& words) {
-#ifdef _DEBUG
-	gLog.Log(1, false, std::format("Loading %s", filename));
-#endif
-	std::ifstream inputFile(filename, std::ios::in | std::ios::binary);
-	if (inputFile.is_open()) {
-		std::string line;
-		while (std::getline(inputFile, line)) {
-			// Check if the line is non-empty and does not start with # (a comment)
-			if (!line.empty() && line.at(0) != '#') {
-				words.push_back(line);
-			}
-		}
-	} else {
-#ifdef _DEBUG
-		gLog.Log(1, false, std::format("Error loading %s, err=%d", filename, errno));
-#endif
-	}
+
+#pragma endregion RNG and Naughty Files
+
+#pragma region Fuzzing
+
+// the part of the buffer a mutation works on
+// the kernels work on raw memory, so the range is clamped to the buffer rather than relying on at() to throw
+gsl::span<char> MutationRange(std::vector<char>& buffer, size_t start, size_t end) noexcept {
+	const size_t size = buffer.size();
+	start = (std::min)(start, size);
+	end = (std::min)(end, size);
+
+	return gsl::span<char>(buffer.data() + start, end > start ? end - start : 0);
+}
+
+void SetFuzzTrace(bool on) noexcept {
+	fuzzTrace = on;
 }
 
-// gets a naughty string from the appropriate file depending on fuzz_type
-std::string GetNaughtyString(unsigned int fuzz_type) {
-	std::string ret{ };
-	switch (fuzz_type) {
-		case 'j': {
-				const auto len = gsl::narrow_cast<unsigned int>(naughtyJson.size());
-				if (len) {
-					ret = naughtyJson.at(rng.range(0, len).generate());
+static void Trace(const char* code) noexcept {
+	if (fuzzTrace)
+		fputs(code, stderr);
+}
+
+// applies one mutation to buffer[start, end), this is the body of Fuzz()'s loop
+// start is a reference because OverlongUtf8 can move it and Fuzz() carries that into the next iteration
+// returns true if the buffer changed size or Grow filled in insert, Fuzz() stops mutating when it does
+static bool Mutate(std::vector<char>& buffer, FuzzInsert& insert, FuzzMutation whichMutation, size_t& start, size_t end, size_t skip, unsigned int fuzz_type) {
+	bool earlyExit = false;
+
+	// Fuzz()'s range always reaches the end of the buffer and usually runs past it, Truncate cuts the
+	// buffer at the end of the range, so it can lengthen it, everything else stops at the end
+	const size_t cut = end;
+	end = (std::min)(end, buffer.size());
+	start = (std::min)(start, end);
+
+	switch (whichMutation) {
+		///////////////////////////////////////////////////////////
+		// no mutation
+		case FuzzMutation::None:
+			Trace("Non");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Non");
+
+			break;
+
+		///////////////////////////////////////////////////////////
+		// set the range to a random byte
+		case FuzzMutation::RndByteSingle:
+		{
+			Trace("Byt");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Byt");
+
+			const char byte = rng.generateChar();
+			Kernels().fillByte(MutationRange(buffer, start, end), skip, byte);
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// write random bytes to the range
+		case FuzzMutation::RndByteMultiple:
+		{
+			Trace("Rnd");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Rnd");
+
+			FillRandom(MutationRange(buffer, start, end), skip, rng);
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// a variant of above
+		case FuzzMutation::ChangeASCIIInt:
+		{
+			Trace("Chg");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Chg");
+
+			// each byte is randomly incremented, decremented, halved or doubled
+			Kernels().changeAsciiInt(MutationRange(buffer, start, end), skip, rng);
+		}
+		break;
+		
+		///////////////////////////////////////////////////////////
+		// set upper bit
+		case FuzzMutation::SetUpperBit:
+		{
+			Trace("Sup");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Sup");
+
+			Kernels().setUpperBit(MutationRange(buffer, start, end), skip);
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// reset upper bit
+		case FuzzMutation::ResetUpperBit:
+		{
+			Trace("Rup");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Rup");
+
+			Kernels().resetUpperBit(MutationRange(buffer, start, end), skip);
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// set the first zero-byte found to non-zero
+		case FuzzMutation::ZeroByteToNonZero:
+		{
+			Trace("Zer");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Zer");
+
+			for (size_t j = start; j < end; j++) {
+				if (buffer.at(j) == 0) {
+					buffer.at(j) = rng.generateChar();
+					break;
 				}
 			}
-			break;
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// insert interesting edge-case numbers, often 2^n +/- 1
+		case FuzzMutation::InterestingNumber:
+		{
+			Trace("Num");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Num");
+
+			// the table of numbers lives with the kernels, see MutationKernels.cpp
+			Kernels().interestingNumber(MutationRange(buffer, start, end), skip, rng);
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// insert interesting characters
+		case FuzzMutation::InterestingChar:
+		{
+			Trace("Chr");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Chr");
+
+			for (size_t j = start; j < end; j += skip) {
+				const auto which = rng.range(0, gsl::narrow<unsigned int>(interestingChar.length())).generate();
+				buffer.at(j) = gsl::at(interestingChar,which);
+			}
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// replace interesting characters with space
+		case FuzzMutation::ReplaceInterestingChar:
+		{
+			Trace("Rep");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Rep");
+
+			for (size_t j = start; j < end; j++) {
+				auto ch = buffer.at(j);
+				if (interestingChar.find(ch) != std::string::npos) {
+					buffer.at(j) = rng.generateChar();
 
-		case 't': {
-				const auto len = gsl::narrow_cast<unsigned int>(naughty.size());
-				if (len) {
-					ret = naughty.at(rng.range(0, len).generate());
+					// 50% chance to break out of the loop and not tweak all characters
+					if(rng.range(0, 10).generate() >= 5)
+						break;
 				}
 			}
-			break;
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// truncate the buffer
+		case FuzzMutation::Truncate:
+		{
+			Trace("Trn");
+
+			const auto bufflen = gsl::narrow<unsigned int>(cut);
+			buffer.resize(bufflen);
+			earlyExit = true;
+			if (gLog.Enabled())
+				gLog.Log(1, false, std::format("Trn->size: {0}", bufflen));
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// grow the buffer
+		case FuzzMutation::Grow:
+		{
+			Trace("Gro");
+
+			// take the midpoint of the start and end, 
+			// and determine how much to grow the buffer
+			const size_t insert_point = (end - start) / 2;
+			const size_t fillsize = rng.range(4, gsl::narrow_cast<unsigned int>(FUZZ_MAX_GROWTH)).generate();
+
+			if (gLog.Enabled())
+				gLog.Log(1, false, std::format("Gro->mid: At {0}, size: {1}", insert_point, fillsize));
+
+			// the insertion is made to one side and spliced in when the chunk is sent, all nulls to start, then filled in
+			insert.at = insert_point;
+			insert.length = fillsize;
+			const gsl::span<char> fill(insert.bytes.data(), fillsize);
+			std::fill(fill.begin(), fill.end(), '\0');
+
+			switch (fuzz_type) {
+					
+				case 'j': 
+				case 'x': 
+				case 'h': 
+				{
+					const auto data = GetNaughtyString(fuzz_type);
+					if (!data.empty()) {
+						const auto replace_size = (std::min)(data.length(), fillsize);
+						std::copy_n(data.begin(), replace_size, fill.begin());
+						if (gLog.Enabled())
+							gLog.Log(2, false, std::format("Repl Size ({0}): {1}", static_cast<char>(toupper(fuzz_type)), replace_size));
+					}
+				}
+				break;
+
+				case 'b':
+				default:
+				{
+					// 50% chance to fill with random characters
+					// 50% chance to fill with the same random character
+					if (rng.range(0,10).generate() % 2) {
+						for (char& c : fill)
+							c = rng.generateChar();
+					} else {
+						auto r = rng.generateChar();
+						for (char& c : fill)
+							c = r;
+					}
 
-		case 'x': {
-				const auto len = gsl::narrow_cast<unsigned int>(naughtyXml.size());
-				if (len) {
-					ret = naughtyXml.at(rng.range(0, len).generate());
+					break;
 				}
 			}
-			break;
 
-		case 'h': {
-				const auto len = gsl::narrow_cast<unsigned int>(naughtyHtml.size());
-				if (len) {
-					ret = naughtyHtml.at(rng.range(0, len).generate());
+			earlyExit = true;
+		}
+		break;
+
+		///////////////////////////////////////////////////////////
+		// overlong UTF-8 encodings
+		case FuzzMutation::OverlongUtf8: 
+		{
+			Trace("Utf");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Utf");
+
+			// at most four bytes, so they're built in place
+			std::array<unsigned char, 4> overlong{};
+			size_t overlongLen = 0;
+			auto push_back = [&](int byte) { overlong.at(overlongLen++) = static_cast<unsigned char>(byte); };
+			const unsigned int choice = rng.range(0,3).generate();
+			const char base_char = rng.generateChar();
+
+			// just to make sure we don't run off the end of the buffer
+			// max encoding len in 4, so this is a little more conservative
+			// TODO: might use int overflow checks here instead
+			if (end-start < MIN_BUFF_LEN/2)
+				start = end - MIN_BUFF_LEN/2;
+
+			switch (choice) {
+
+				case 0:
+					// 2-byte overlong encoding
+					push_back(0b11000000 | (base_char >> 6));
+					push_back(0b10000000 | (base_char & 0b00111111));
+					break;
+
+				case 1:
+					// 3-byte overlong encoding
+					push_back(0b11100000);
+					push_back(0b10000000 | (base_char >> 6));
+					push_back(0b10000000 | (base_char & 0b00111111));
+					break;
+
+				case 2:
+					// 4-byte overlong encoding
+					push_back(0b11110000);
+					push_back(0b10000000 | (base_char >> 6));
+					push_back(0b10000000 | (base_char & 0b00111111));
+					push_back(0b10000000);
+					break;
+
+				default:
+					break;
+			}
+
+			for (size_t j = start; j < start + overlongLen; j++)
+				buffer.at(j) = overlong.at(j - start);
+		}
+
+		break;
+
+		///////////////////////////////////////////////////////////
+		// insert naughty words
+		// but not if we're doing binary fuzzing
+		case FuzzMutation::NaughtyWord:
+		{
+			if (fuzz_type != 'b') {
+				Trace("Nau");
+				if (gLog.Enabled())
+					gLog.Log(1, false, "Nau");
+
+				const auto nty = GetNaughtyString(fuzz_type);
+
+				for (size_t j = start; j < start + nty.size() && j < end; j++) {
+					buffer.at(j) = nty.at(j - start);
 				}
 			}
-			break;
+		}
+
+		break;
+
+		///////////////////////////////////////////////////////////
+		// insert random Unicode (encoded as UTF-8)
+		case FuzzMutation::RndUnicode: 
+		{
+			Trace("Uni");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "Uni");
+
+			const auto utf8char = GetRandomUnicodeCharacter();
+			for (size_t b = 0; b < utf8char.length; b++) {
+				const unsigned char byte = utf8char.bytes.at(b);
+				for (size_t j = start; j < start + utf8char.length && j < end; j++)
+					buffer.at(j) = byte;
+			}
+		}
+
+		break;
 
 		default:
+			Trace("???");
+			if (gLog.Enabled())
+				gLog.Log(1, false, "???");
+
 			break;
 	}
 
-	return ret;
+	return earlyExit;
 }
 
-#pragma endregion RNG and Naughty Files
-
-#pragma region Fuzzing
-
 // This is called multiple times, usually per block of data
-bool Fuzz(std::vector<char>& buffer, unsigned int fuzzaggr, unsigned int fuzz_type, unsigned int offset) {
+bool Fuzz(std::vector<char>& buffer, FuzzInsert& insert, unsigned int fuzzaggr, unsigned int fuzz_type, unsigned int offset) {
+
+	insert.length = 0;
+	lastMutations = 0;
 
 	// don't fuzz everything
 	// check data is not too small to fuzz
 	// arbitrary decision, the offset can be no more than 50% of the buffer size
 	auto bufflen = buffer.size();
 	if (bufflen < MIN_BUFF_LEN || rng.generatePercent() > fuzzaggr || offset >= bufflen/2) {
-		fprintf(stderr, "Nnn");
-#ifdef _DEBUG
-		gLog.Log(1, false, "Nnn");
-#endif
-		return false;
-	}
-
-	// On first call, load the naughty strings file, but only if fuzz_type is not 'b'
-	// the 'attempted' flag is to prevent trying to load the file
-	// if the file does not exist or there's a load error
-	if (fuzz_type == 't' && naughty.empty() && !naughtyLoadAttempted) {
-		naughtyLoadAttempted = true;
-		LoadNaughtyFile("naughty.txt", naughty);
-	}
+		Trace("Nnn");
+		CountStat(StatCounter::ChunksSkipped);
+		if (gLog.Enabled())
+			gLog.Log(1, false, "Nnn");
 
-	// XML Naughty Strings
-	if (fuzz_type == 'x' && naughtyXml.empty() && !naughtyXmlLoadAttempted) {
-		naughtyXmlLoadAttempted = true;
-		LoadNaughtyFile("naughty_Xml.txt", naughtyXml);
-	}
-
-	// HTML Naughty Strings
-	if (fuzz_type == 'h' && naughtyHtml.empty() && !naughtyHtmlLoadAttempted) {
-		naughtyHtmlLoadAttempted = true;
-		LoadNaughtyFile("naughty_Html.txt", naughtyHtml);
+		return false;
 	}
 
-	// JSON Naughty Strings
-	if (fuzz_type == 'j' && naughtyJson.empty() && !naughtyJsonLoadAttempted) {
-		naughtyJsonLoadAttempted = true;
-		LoadNaughtyFile("naughty_Json.txt", naughtyJson);
-	}
+	CountStat(StatCounter::ChunksFuzzed);
 
 	// get a random range to fuzz, make sure it's big enough, but not too big!
+	// the range is redrawn until it reaches the end of the buffer, the furthest it can reach is
+	// bufflen - offset + (bufflen - 1) / 8, so with an offset past an eighth of the buffer it never
+	// would, then it's drawn once and runs to the end
+	const bool reachable = offset <= (bufflen - 1) / 8;
 	size_t start{}, start_offset{}, end{ };
 	do {
 		auto intermediate = bufflen - gsl::narrow_cast<size_t>(offset);
@@ -207,9 +482,9 @@ bool Fuzz(std::vector<char>& buffer, unsigned int fuzzaggr, unsigned int fuzz_ty
 		start_offset = rng.range(0, gsl::narrow_cast<unsigned int>(bufflen)).generate();
 		start_offset /= 8;
 		start_offset++;
-	} while (start + start_offset < bufflen); //TODO - double check this won't loop forever!
+	} while (reachable && start + start_offset < bufflen);
 
-	end = start + start_offset;
+	end = reachable ? start + start_offset : bufflen;
 
 	// if we need to leave the main fuzzing loop quickly
 	bool earlyExit = false;
@@ -230,9 +505,11 @@ bool Fuzz(std::vector<char>& buffer, unsigned int fuzzaggr, unsigned int fuzz_ty
 	constexpr auto mean = 2.5;
 	const auto iterations = gsl::narrow_cast<unsigned int>(rng.generatePoission(mean));
 
-#ifdef _DEBUG
-	gLog.Log(0, false, std::format("Iter:{0}, Start:{1}, End:{2}", iterations, start, end));
-#endif
+	if (gLog.Enabled())
+		gLog.Log(0, false, std::format("Iter:{0}, Start:{1}, End:{2}", iterations, start, end));
+
+	// the same weights for the whole call, even if they're changed part way through
+	const AliasTable& schedule = CurrentSchedule().Table(fuzz_type);
 
 	// This is where the work is done
 	for (size_t i = 0; i < iterations; i++) {
@@ -243,371 +520,19 @@ bool Fuzz(std::vector<char>& buffer, unsigned int fuzzaggr, unsigned int fuzz_ty
 			? 1
 			: rng.range(1, 10).generate();
 		
-		// which mutation to use. 
-		// The upper-range is updated automatically as new mutations are added
-		const auto whichMutation 
-			= static_cast<FuzzMutation>(rng.range(0, static_cast<unsigned int>(FuzzMutation::Max)).generate());
-
-		switch (whichMutation) {
-			///////////////////////////////////////////////////////////
-			// no mutation
-			case FuzzMutation::None:
-				fprintf(stderr,"Non");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Non");
-#endif
-				break;
-
-			///////////////////////////////////////////////////////////
-			// set the range to a random byte
-			case FuzzMutation::RndByteSingle:
-			{
-				fprintf(stderr, "Byt");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Byt");
-#endif
-				const char byte = rng.generateChar();
-				for (size_t j = start; j < end; j += skip) {
-					buffer.at(j) = byte;
-				}
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// write random bytes to the range
-			case FuzzMutation::RndByteMultiple:
-			{
-				fprintf(stderr, "Rnd");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Rnd");
-#endif
-				for (size_t j = start; j < end; j += skip) {
-					buffer.at(j) = rng.generateChar();
-				}
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// a variant of above
-			case FuzzMutation::ChangeASCIIInt:
-			{
-				fprintf(stderr,"Chg");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Chg");
-#endif
-				for (size_t j = start; j < end; j += skip) {
-					auto c = buffer.at(j);
-					switch (rng.range(0, 4).generate()) {
-						case 0	: c++;	break;
-						case 1	: c--;	break;
-						case 2	: c/=2; break;
-						default	: c*=2; break;
-					}
-
-					buffer.at(j) = c;
-				}
-			}
-			break;
-			
-			///////////////////////////////////////////////////////////
-			// set upper bit
-			case FuzzMutation::SetUpperBit:
-			{
-				fprintf(stderr,"Sup");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Sup");
-#endif
-				for (size_t j = start; j < end; j += skip) {
-					buffer.at(j) |= 0x80;
-				}
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// reset upper bit
-			case FuzzMutation::ResetUpperBit:
-			{
-				fprintf(stderr,"Rup");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Rup");
-#endif
-				for (size_t j = start; j < end; j += skip) {
-					buffer.at(j) &= 0x7F;
-				}
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// set the first zero-byte found to non-zero
-			case FuzzMutation::ZeroByteToNonZero:
-			{
-				fprintf(stderr,"Zer");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Zer");
-#endif
-				for (size_t j = start; j < end; j++) {
-					if (buffer.at(j) == 0) {
-						buffer.at(j) = rng.generateChar();
-						break;
-					}
-				}
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// insert interesting edge-case numbers, often 2^n +/- 1
-			case FuzzMutation::InterestingNumber:
-			{
-				fprintf(stderr,"Num");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Num");
-#endif
-				const unsigned char interestingNum[] 
-					= { 0,1,2,3,4,5,7,8,9,15,16,17,31,32,
-						33,63,64,65,127,128,129,191,192,193,
-						223,224,225,239,240,241,247,248,249,253,
-						254,255 };
-				
-				for (size_t j = start; j < end; j += skip) {
-					const auto which = rng.range(0, _countof(interestingNum)).generate();
-					auto ch = gsl::narrow<unsigned char>(gsl::at(interestingNum, which));
-					buffer.at(j) = ch;
-				}
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// insert interesting characters
-			case FuzzMutation::InterestingChar:
-			{
-				fprintf(stderr,"Chr");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Chr");
-#endif
-				for (size_t j = start; j < end; j += skip) {
-					const auto which = rng.range(0, gsl::narrow<unsigned int>(interestingChar.length())).generate();
-					buffer.at(j) = gsl::at(interestingChar,which);
-				}
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// replace interesting characters with space
-			case FuzzMutation::ReplaceInterestingChar:
-			{
-				fprintf(stderr,"Rep");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Rep");
-#endif
-				for (size_t j = start; j < end; j++) {
-					auto ch = buffer.at(j);
-					if (interestingChar.find(ch) != std::string::npos) {
-						buffer.at(j) = rng.generateChar();
-
-						// 50% chance to break out of the loop and not tweak all characters
-						if(rng.range(0, 10).generate() >= 5)
-							break;
-					}
-				}
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// truncate the buffer
-			case FuzzMutation::Truncate:
-			{
-				fprintf(stderr,"Trn");
-
-				bufflen = gsl::narrow<unsigned int>(end);
-				buffer.resize(bufflen);
-				earlyExit = true;
-#ifdef _DEBUG
-				gLog.Log(1, false, std::format("Trn->size: {0}", bufflen));
-#endif
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// grow the buffer
-			case FuzzMutation::Grow:
-			{
-				fprintf(stderr,"Gro");
-
-				// take the midpoint of the start and end, 
-				// and determine how much to grow the buffer
-				const size_t insert_point = (end - start) / 2;
-				const size_t fillsize = rng.range(4, 128).generate();
-
-#ifdef _DEBUG
-				gLog.Log(1, false, std::format("Gro->mid: At {0}, size: {1}", insert_point, fillsize));
-#endif
-				// this vector will contain the insertion string, 
-				// it is set to all nulls to start
-				std::vector<char> insert(fillsize);
-
-				switch (fuzz_type) {
-						
-					case 'j': 
-					{
-						//TODO Replace with fn()
-						const auto len = gsl::narrow_cast<unsigned int>(naughtyJson.size());
-						if (len) {
-							std::string data = naughtyJson.at(rng.range(0, len).generate());
-							auto replace_size = std::min(data.length(), fillsize);
-							std::copy(data.begin(), data.begin() + replace_size, insert.begin());
-#ifdef _DEBUG
-							gLog.Log(2, false, std::format("Repl Size (J): {0}", replace_size));
-#endif
-						}
-					}
-					break;
-
-					case 'x': 
-					{
-						const auto len = gsl::narrow_cast<unsigned int>(naughtyXml.size());
-						if (len) {
-							std::string data = naughtyXml.at(rng.range(0, len).generate());
-							auto replace_size = std::min(data.length(), fillsize);
-							std::copy(data.begin(), data.begin() + replace_size, insert.begin());
-#ifdef _DEBUG
-							gLog.Log(2, false, std::format("Repl Size (X): {0}", replace_size));
-#endif
-						}
-					}
-					break;
-
-					case 'h': 
-					{
-						const auto len = gsl::narrow_cast<unsigned int>(naughtyHtml.size());
-						if (len) {
-							std::string data = naughtyHtml.at(rng.range(0, len).generate());
-							auto replace_size = std::min(data.length(), fillsize);
-							std::copy(data.begin(), data.begin() + replace_size, insert.begin());							
-#ifdef _DEBUG
-							gLog.Log(2, false, std::format("Repl Size (H): {0}", replace_size));
-#endif
-						}
-					}
-					break;
-
-					case 'b':
-					default:
-					{
-						// 50% chance to fill with random characters
-						// 50% chance to fill with the same random character
-						if (rng.range(0,10).generate() % 2) {
-							for (char& c : insert)
-								c = rng.generateChar();
-						} else {
-							auto r = rng.generateChar();
-							for (char& c : insert)
-								c = r;
-						}
-
-						break;
-					}
-				}
-
-				buffer.insert(buffer.begin() + insert_point, insert.begin(), insert.end());
-				earlyExit = true;
-			}
-			break;
-
-			///////////////////////////////////////////////////////////
-			// overlong UTF-8 encodings
-			case FuzzMutation::OverlongUtf8: 
-			{
-				fprintf(stderr,"Utf");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Utf");
-#endif
-				std::vector<unsigned char> overlong;
-				const unsigned int choice = rng.range(0,3).generate();
-				const char base_char = rng.generateChar();
-
-				// just to make sure we don't run off the end of the buffer
-				// max encoding len in 4, so this is a little more conservative
-				// TODO: might use int overflow checks here instead
-				if (end-start < MIN_BUFF_LEN/2)
-					start = end - MIN_BUFF_LEN/2;
-
-				switch (choice) {
-
-					case 0:
-						// 2-byte overlong encoding
-						overlong.push_back(0b11000000 | (base_char >> 6));
-						overlong.push_back(0b10000000 | (base_char & 0b00111111));
-						break;
-
-					case 1:
-						// 3-byte overlong encoding
-						overlong.push_back(0b11100000);
-						overlong.push_back(0b10000000 | (base_char >> 6));
-						overlong.push_back(0b10000000 | (base_char & 0b00111111));
-						break;
-
-					case 2:
-						// 4-byte overlong encoding
-						overlong.push_back(0b11110000);
-						overlong.push_back(0b10000000 | (base_char >> 6));
-						overlong.push_back(0b10000000 | (base_char & 0b00111111));
-						overlong.push_back(0b10000000);
-						break;
+		// which mutation to use, weighted for the fuzz type, see MutationScheduler.h
+		const auto whichMutation = schedule.Pick(rng);
 
-					default:
-						break;
-				}
-
-				for (size_t j = start; j < start + overlong.size(); j++)
-					buffer.at(j) = overlong.at(j - start);
-			}
-
-			break;
-
-			///////////////////////////////////////////////////////////
-			// insert naughty words
-			// but not if we're doing binary fuzzing
-			case FuzzMutation::NaughtyWord:
-			{
-				if (fuzz_type != 'b') {
-					fprintf(stderr,"Nau");
-#ifdef _DEBUG
-					gLog.Log(1, false, "Nau");
-#endif
-					std::string nty = GetNaughtyString(fuzz_type);
+		RecordMutation(static_cast<uint16_t>(whichMutation), start, end, skip);
+		CountMutation(whichMutation);
+		lastMutations |= 1u << static_cast<uint32_t>(whichMutation);
 
-					for (size_t j = start; j < start + nty.size() && j < end; j++) {
-						buffer.at(j) = nty.at(j - start);
-					}
-				}
-			}
-
-			break;
-
-			///////////////////////////////////////////////////////////
-			// insert random Unicode (encoded as UTF-8)
-			case FuzzMutation::RndUnicode: 
-			{
-				fprintf(stderr,"Uni");
-#ifdef _DEBUG
-				gLog.Log(1, false, "Uni");
-#endif
-				auto utf8char = GetRandomUnicodeCharacter();
-				for (unsigned char byte : utf8char) {
-					for (size_t j = start; j < start + utf8char.length() && j < end; j++)
-						buffer.at(j) = byte;
-				}
-			}
+		// timed from here, so naughty string lookups and logging count towards the mutation's cost
+		const auto mutationStart = StatClock::now();
 
-			break;
+		earlyExit = Mutate(buffer, insert, whichMutation, start, end, skip, fuzz_type);
 
-			default:
-				fprintf(stderr,"???");
-#ifdef _DEBUG
-				gLog.Log(1, false, "???");
-#endif
-				break;
-		}
+		RecordLatencySince(MutationCostHistogram(whichMutation), mutationStart);
 
 		// right now, this only happens on buffer size change because we need 
 		// to re-calc buffer sizes and this is the safest way to do it
@@ -618,4 +543,26 @@ bool Fuzz(std::vector<char>& buffer, unsigned int fuzzaggr, unsigned int fuzz_ty
 	return true;
 }
 
+bool Fuzz(std::vector<char>& buffer, unsigned int fuzzaggr, unsigned int fuzz_type, unsigned int offset) {
+	FuzzInsert insert{};
+	const bool fuzzed = Fuzz(buffer, insert, fuzzaggr, fuzz_type, offset);
+
+	if (insert.length) {
+		const auto bytes = gsl::span<const char>(insert.bytes.data(), insert.length);
+		buffer.insert(buffer.begin() + (std::min)(insert.at, buffer.size()), bytes.begin(), bytes.end());
+	}
+
+	return fuzzed;
+}
+
+bool FuzzMutate(std::vector<char>& buffer, FuzzInsert& insert, FuzzMutation mutation, size_t start, size_t end, size_t skip, unsigned int fuzz_type) {
+	// Fuzz()'s range loop leaves end at or past the end of the buffer, Mutate() clamps that itself, but
+	// here the range is clamped up front, so a Truncate called through this never lengthens the buffer
+	end = (std::min)(end, buffer.size());
+	start = (std::min)(start, end);
+	insert.length = 0;
+
+	return Mutate(buffer, insert, mutation, start, end, (std::max)(skip, static_cast<size_t>(1)), fuzz_type);
+}
+
 #pragma endregion Fuzzing
\ No newline at end of file
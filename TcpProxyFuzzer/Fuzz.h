@@ -0,0 +1,174 @@
+#pragma once
+
+// The fuzzing entry points, see Fuzz.cpp
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+
+#include "rand.h"
+#include "gsl/span"
+
+// all the possible fuzz mutation types
+enum class FuzzMutation : uint32_t {
+    None,
+    RndByteSingle,
+    RndByteMultiple,
+    ChangeASCIIInt,
+    SetUpperBit,
+    ResetUpperBit,
+    ZeroByteToNonZero,
+    InterestingNumber,
+    InterestingChar,
+    Truncate,
+    Grow,
+    OverlongUtf8,
+    NaughtyWord,
+    RndUnicode,
+    ReplaceInterestingChar,
+    Max
+};
+
+// a readable name for a mutation, for tools and reports
+inline const char* FuzzMutationName(FuzzMutation mutation) noexcept {
+    constexpr const char* names[] = {
+        "None", "RndByteSingle", "RndByteMultiple", "ChangeASCIIInt", "SetUpperBit", "ResetUpperBit",
+        "ZeroByteToNonZero", "InterestingNumber", "InterestingChar", "Truncate", "Grow",
+        "OverlongUtf8", "NaughtyWord", "RndUnicode", "ReplaceInterestingChar"
+    };
+    static_assert(std::size(names) == static_cast<size_t>(FuzzMutation::Max), "a mutation is missing its name");
+
+    const auto i = static_cast<size_t>(mutation);
+    return i < std::size(names) ? names[i] : "Unknown";
+}
+
+// not going to bother fuzzing a small block
+constexpr size_t MIN_BUFF_LEN = 16;
+
+// the most Grow inserts into a chunk, it inserts at most 127 bytes and ends the call
+constexpr size_t FUZZ_MAX_GROWTH = 128;
+
+// the most one Fuzz() call can grow a buffer of size bytes by
+// Grow's bytes are kept to one side, but Truncate cuts the buffer at the end of the fuzzed range,
+// and that can run up to an eighth of the buffer past its end, so Truncate can lengthen it
+constexpr size_t FuzzBufferGrowth(size_t size) noexcept {
+    return size / 8 + 1;
+}
+
+// Bytes Fuzz() adds to a chunk, held to one side so the rest of the chunk doesn't have to move
+// Grow is always the last mutation of a call, so a chunk never gets more than one, and the chunk
+// goes out as buffer[0, at), then bytes[0, length), then buffer[at, end)
+struct FuzzInsert {
+    size_t  at{ 0 };
+    size_t  length{ 0 };    // 0 when nothing was inserted
+    std::array<char, FUZZ_MAX_GROWTH> bytes{};
+};
+
+// A fuzzed chunk as it's sent, the data with any insert spliced in, in at most three pieces
+// The pieces point into the data and the insert, so both have to outlive it
+class FuzzOutput {
+public:
+    FuzzOutput(gsl::span<const char> data, const FuzzInsert& insert) noexcept {
+        const size_t at = (std::min)(insert.at, data.size());
+        Add(data.first(at));
+        Add(gsl::span<const char>(insert.bytes.data(), insert.length));
+        Add(data.subspan(at));
+    }
+
+    // the empty pieces are left out
+    gsl::span<const gsl::span<const char>> Pieces() const noexcept {
+        return gsl::span<const gsl::span<const char>>(_pieces.data(), _count);
+    }
+
+    size_t Size() const noexcept {
+        return _size;
+    }
+
+    // copies as much of the output from offset from onward as fits in dest, returns how much that was
+    size_t CopyTo(size_t from, gsl::span<char> dest) const noexcept {
+        size_t copied = 0;
+        for (const auto& piece : Pieces()) {
+            if (from >= piece.size()) {
+                from -= piece.size();
+                continue;
+            }
+
+            const size_t n = (std::min)(piece.size() - from, dest.size() - copied);
+            memcpy(dest.data() + copied, piece.data() + from, n);
+            copied += n;
+            from = 0;
+        }
+
+        return copied;
+    }
+
+private:
+    void Add(gsl::span<const char> piece) noexcept {
+        if (piece.empty())
+            return;
+
+        _pieces[_count++] = piece;
+        _size += piece.size();
+    }
+
+    std::array<gsl::span<const char>, 3> _pieces{};
+    size_t _count{ 0 };
+    size_t _size{ 0 };
+};
+
+// mutates the buffer in place, it can shrink, and what Grow adds is left in insert rather than moved into
+// the buffer, so growing costs the bytes inserted and not a move of everything after them
+// returns false if the buffer was skipped
+// the text fuzz types insert strings from the naughty corpus, LoadNaughtyCorpus() must have run first
+bool Fuzz(std::vector<char>& buffer, FuzzInsert& insert, unsigned int fuzzaggr, unsigned int fuzz_type, unsigned int offset);
+
+// the same, with any insert moved into the buffer, for callers that want the output in one piece
+bool Fuzz(std::vector<char>& buffer, unsigned int fuzzaggr, unsigned int fuzz_type, unsigned int offset);
+
+// Applies one given mutation to buffer[start, end), the same code Fuzz() runs when it picks that mutation,
+// drawing from FuzzRng(), so with a ScopedFuzzRng around it the result only depends on the seed
+// This is for benchmarks and tests, it doesn't count stats or write events the way Fuzz() does
+// The range is clamped to the buffer, returns true for Truncate and Grow, Grow leaves what it adds in insert
+bool FuzzMutate(std::vector<char>& buffer, FuzzInsert& insert, FuzzMutation mutation, size_t start, size_t end, size_t skip, unsigned int fuzz_type);
+
+// a bit per FuzzMutation, 1u << mutation
+using FuzzMutationSet = uint32_t;
+static_assert(static_cast<size_t>(FuzzMutation::Max) <= 32, "FuzzMutationSet needs more bits");
+
+// the mutations the last Fuzz() call on this thread applied, empty if it skipped the chunk
+// -novelty credits them with whatever the server does next, see Novelty.h
+FuzzMutationSet LastFuzzMutations() noexcept;
+
+// Fuzz() prints a three-letter code to stderr for every mutation, quiet mode turns that off
+// set it before any forwarding starts
+void SetFuzzTrace(bool on) noexcept;
+
+// the generator Fuzz() draws from on the calling thread
+RandomNumberGenerator& FuzzRng() noexcept;
+
+// Makes Fuzz() on this thread draw from another generator until the object goes away
+// Seeded sessions keep one generator per direction and swap it in around each Fuzz() call,
+// so the mutations only depend on the seed and the bytes, not on which thread ran them
+class ScopedFuzzRng {
+public:
+    explicit ScopedFuzzRng(RandomNumberGenerator& rng) noexcept
+        : _rng(rng) {
+        std::swap(_rng, FuzzRng());
+    }
+
+    ~ScopedFuzzRng() {
+        std::swap(_rng, FuzzRng());
+    }
+
+    ScopedFuzzRng(const ScopedFuzzRng&) = delete;
+    ScopedFuzzRng(ScopedFuzzRng&&) = delete;
+    ScopedFuzzRng& operator=(const ScopedFuzzRng&) = delete;
+    ScopedFuzzRng& operator=(ScopedFuzzRng&&) = delete;
+
+private:
+    RandomNumberGenerator& _rng;
+};
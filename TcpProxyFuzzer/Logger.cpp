@@ -2,18 +2,98 @@
 #include <chrono>
 #include <format>
 #include <stdexcept>
-#include <iomanip>
 #include <regex>
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
 #include <filesystem>
-#include "mutex"
 #include "gsl/util"
 
-// used in debug to make sure fuzz data is serialized correctly in the log file
-std::mutex _oneLogWrite{};
-
 namespace fs = std::filesystem;
 
+#pragma region LogRing
+
+namespace {
+    size_t RoundUpPow2(size_t n) noexcept {
+        size_t p = 4096;
+        while (p < n)
+            p <<= 1;
+
+        return p;
+    }
+
+    // each thread's ring and the logger it belongs to
+    struct ThreadRingSlot {
+        const Logger*               owner{ nullptr };
+        std::shared_ptr<LogRing>    ring{};
+    };
+
+    thread_local ThreadRingSlot tRing{};
+}
+
+LogRing::LogRing(size_t bytes)
+    : _data(std::make_unique<char[]>(RoundUpPow2(bytes))), _mask(RoundUpPow2(bytes) - 1) {
+}
+
+void LogRing::CopyIn(uint64_t at, const void* src, size_t n) noexcept {
+    const size_t offset = at & _mask;
+    const size_t first = (std::min)(n, _mask + 1 - offset);
+    memcpy(_data.get() + offset, src, first);
+    memcpy(_data.get(), static_cast<const char*>(src) + first, n - first);
+}
+
+void LogRing::CopyOut(uint64_t at, void* dst, size_t n) const noexcept {
+    const size_t offset = at & _mask;
+    const size_t first = (std::min)(n, _mask + 1 - offset);
+    memcpy(dst, _data.get() + offset, first);
+    memcpy(static_cast<char*>(dst) + first, _data.get(), n - first);
+}
+
+bool LogRing::TryPush(int64_t ticks, int indent, bool newline, std::string_view message) noexcept {
+    // a message bigger than the ring is cut down so it can still get through
+    const size_t room = Capacity() - sizeof(Header);
+    if (message.size() > room)
+        message = message.substr(0, room);
+
+    const uint64_t head = _head.load(std::memory_order_relaxed);
+    const uint64_t tail = _tail.load(std::memory_order_acquire);
+    const size_t need = sizeof(Header) + message.size();
+    if (Capacity() - (head - tail) < need)
+        return false;
+
+    const Header header{ ticks, gsl::narrow_cast<uint32_t>(message.size()),
+        gsl::narrow_cast<int16_t>(indent), gsl::narrow_cast<int16_t>(newline) };
+    CopyIn(head, &header, sizeof(header));
+    CopyIn(head + sizeof(header), message.data(), message.size());
+
+    _head.store(head + need, std::memory_order_release);
+    return true;
+}
+
+template <typename Fn>
+void LogRing::Drain(Fn&& fn) {
+    uint64_t tail = _tail.load(std::memory_order_relaxed);
+    const uint64_t head = _head.load(std::memory_order_acquire);
+
+    std::string message{};
+    while (tail != head) {
+        Header header{};
+        CopyOut(tail, &header, sizeof(header));
+        message.resize(header.len);
+        CopyOut(tail + sizeof(header), message.data(), header.len);
+        tail += sizeof(header) + header.len;
+
+        fn(header.ticks, header.indent, header.newline != 0, message);
+    }
+
+    _tail.store(tail, std::memory_order_release);
+}
+
+#pragma endregion LogRing
+
+#pragma region Logger
+
 std::string Logger::GenerateNextFilename(const std::string& baseName) {
 
     const fs::path dirPath = fs::path("fuzzlogs");
@@ -38,49 +118,197 @@ std::string Logger::GenerateNextFilename(const std::string& baseName) {
     return formattedString;
 }
 
-Logger::Logger(const std::string& filename) 
-    : _logFile(GenerateNextFilename(filename), std::ios::app) {
+Logger::Logger(const std::string& filename)
+    : _baseName(filename) {
+}
+
+Logger::~Logger() {
+    Stop();
+}
 
-    if (!_logFile.is_open()) {
-        throw std::runtime_error("Unable to open log file: " + filename);
+bool Logger::Start(const LogSettings& settings) {
+    if (_writer.joinable())
+        return true;
+
+    const std::string filename = GenerateNextFilename(_baseName);
+    if (fopen_s(&_logFile, filename.c_str(), "ab") != 0 || _logFile == nullptr) {
+        _logFile = nullptr;
+        return false;
     }
+
+    _settings = settings;
+    _settings.flush_ms = (std::max)(1u, _settings.flush_ms);
+    _stopping = false;
+    _writer = std::thread(&Logger::WriterLoop, this);
+    _enabled.store(true, std::memory_order_release);
+
+    return true;
 }
 
-Logger::~Logger() {
-    if (_logFile.is_open()) {
-        _logFile.close();
+void Logger::Stop() {
+    _enabled.store(false, std::memory_order_release);
+    if (!_writer.joinable())
+        return;
+
+    {
+        std::lock_guard lock(_wakeLock);
+        _stopping = true;
     }
+
+    _wake.notify_one();
+    _writer.join();
+
+    fclose(_logFile);
+    _logFile = nullptr;
 }
 
-void Logger::Log(int indent, bool newline, const std::string& message) {
+// the first Log() on a thread registers a ring for it, after that it's a thread_local lookup
+LogRing* Logger::ThreadRing() {
+    if (tRing.owner != this || !tRing.ring) {
+        auto ring = std::make_shared<LogRing>(_settings.ring_bytes);
 
-    // this is here in debug builds, so that log data is serialized correctly in the log file
-    // this is a GREAT example of RAII, BTW :)
-    std::lock_guard lock(_oneLogWrite);
+        std::lock_guard lock(_ringsLock);
+        _rings.push_back(ring);
+        tRing.owner = this;
+        tRing.ring = std::move(ring);
+    }
+
+    return tRing.ring.get();
+}
+
+void Logger::Wake() noexcept {
+    if (!_wakePending.exchange(true, std::memory_order_relaxed))
+        _wake.notify_one();
+}
+
+void Logger::Log(int indent, bool newline, const std::string& message) {
+    if (!Enabled())
+        return;
 
-    const auto now = std::chrono::system_clock::now();
-    const auto now_time_t = std::chrono::system_clock::to_time_t(now);
-    const auto now_ms 
-        = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+    const int64_t ticks = std::chrono::system_clock::now().time_since_epoch().count();
+    indent = std::max(0, std::min(indent, static_cast<int>(_indentStrings.size()) - 1));
 
-    std::tm localtime;
-    localtime_s(&localtime, &now_time_t);
+    LogRing* ring = ThreadRing();
+    while (!ring->TryPush(ticks, indent, newline, message)) {
+        if (_settings.full == LogFull::Drop) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
 
-    indent = std::max(0, std::min(indent, static_cast<int>(_indentStrings.size())));
+        // wait for the writer, it may be stopping, in which case give up
+        Wake();
+        std::this_thread::yield();
+        if (!Enabled())
+            return;
+    }
 
-    auto nl = newline ? "\n" : " ";
-    _logFile << nl << _indentStrings.at(indent) << std::put_time(&localtime, "%H:%M:%S") << '.'
-        << std::setfill('0') << std::setw(3) << now_ms.count()
-        << ": " << message << std::endl;
+    // don't wait for the flush interval if the ring is getting full
+    if (ring->HalfFull())
+        Wake();
 }
 
 void Logger::Log(const int indent, bool newline, const std::vector<char>& buf) {
-    std::stringstream hexStream{};
-    for (auto byte : buf) {
-        hexStream << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+    if (!Enabled())
+        return;
+
+    constexpr char hex[] = "0123456789abcdef";
+    std::string hexString(buf.size() * 2, '0');
+    for (size_t i = 0; i < buf.size(); i++) {
+        const auto byte = static_cast<unsigned char>(buf[i]);
+        hexString[i * 2] = hex[byte >> 4];
+        hexString[i * 2 + 1] = hex[byte & 0xF];
+    }
+
+    Log(indent, newline, hexString);
+}
+
+// takes everything out of the rings, sorts it by time and writes it in one go
+// returns the number of lines written
+size_t Logger::WriteBatch() {
+    struct Line {
+        int64_t     ticks;
+        int         indent;
+        bool        newline;
+        size_t      start;
+        size_t      len;
+    };
+
+    std::vector<Line> lines{};
+    std::string text{};
+    uint64_t dropped{};
+
+    {
+        std::lock_guard lock(_ringsLock);
+        for (const auto& ring : _rings) {
+            ring->Drain([&](int64_t ticks, int indent, bool newline, const std::string& message) {
+                lines.push_back({ ticks, indent, newline, text.size(), message.size() });
+                text += message;
+            });
+
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+
+        // a ring only this list still holds belongs to a thread that has exited
+        std::erase_if(_rings, [](const auto& ring) { return ring.use_count() == 1 && ring->Empty(); });
+    }
+
+    std::string out{};
+    if (dropped)
+        out += std::format("\n[{} log lines dropped, the log rings were full]\n", dropped);
+
+    std::stable_sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) { return a.ticks < b.ticks; });
+
+    // the HH:MM:SS part only changes once a second, so it's cached
+    int64_t cachedSecond{ -1 };
+    char hms[16]{};
+
+    out.reserve(out.size() + text.size() + lines.size() * 24);
+    for (const auto& line : lines) {
+        const std::chrono::system_clock::duration since(line.ticks);
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(since).count();
+        const int64_t second = ms / 1000;
+        if (second != cachedSecond) {
+            const auto now_time_t = static_cast<time_t>(second);
+            std::tm localtime{};
+            localtime_s(&localtime, &now_time_t);
+            strftime(hms, sizeof(hms), "%H:%M:%S", &localtime);
+            cachedSecond = second;
+        }
+
+        out += line.newline ? '\n' : ' ';
+        out += _indentStrings.at(line.indent);
+        out += std::format("{}.{:03}: ", hms, ms % 1000);
+        out.append(text, line.start, line.len);
+        out += '\n';
+    }
+
+    if (!out.empty()) {
+        fwrite(out.data(), 1, out.size(), _logFile);
+        fflush(_logFile);
     }
 
-    Log(indent, newline, hexStream.str());
+    return lines.size();
 }
 
+void Logger::WriterLoop() {
+    while (true) {
+        bool stopping{};
+        {
+            std::unique_lock lock(_wakeLock);
+            _wake.wait_for(lock, std::chrono::milliseconds(_settings.flush_ms),
+                [this] { return _stopping || _wakePending.load(std::memory_order_relaxed); });
+            stopping = _stopping;
+        }
+
+        _wakePending.store(false, std::memory_order_relaxed);
+        WriteBatch();
+
+        if (stopping)
+            break;
+    }
+
+    // anything logged while the last batch was written
+    WriteBatch();
+}
 
+#pragma endregion Logger
@@ -1,14 +1,98 @@
 #pragma once
 
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <cstdio>
+#include <cstdint>
 #include <array>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
+// What Log() does when the calling thread's ring is full
+enum class LogFull {
+    Drop = 0,   // the line is counted and thrown away, forwarding never waits on the log
+    Block = 1   // the caller waits for the writer to make room, nothing is lost
+};
+
+struct LogSettings {
+    unsigned int    flush_ms{ 100 };            // how often the writer drains the rings and writes
+    LogFull         full{ LogFull::Drop };
+    size_t          ring_bytes{ 256 * 1024 };   // per thread, rounded up to a power of two
+};
+
+// Single-producer single-consumer byte ring, one per logging thread
+// The owning thread appends records, the writer thread consumes them, no locks either side
+class LogRing {
+public:
+    explicit LogRing(size_t bytes);
+
+    // false if there isn't room for the whole record
+    bool TryPush(int64_t ticks, int indent, bool newline, std::string_view message) noexcept;
+
+    // calls fn(ticks, indent, newline, message) for each record, then frees the space
+    template <typename Fn>
+    void Drain(Fn&& fn);
+
+    bool Empty() const noexcept {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_relaxed);
+    }
+
+    bool HalfFull() const noexcept {
+        return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed) > _mask / 2;
+    }
+
+    size_t Capacity() const noexcept { return _mask + 1; }
+
+    std::atomic<uint64_t>   dropped{ 0 };
+
+    LogRing(const LogRing&) = delete;
+    LogRing(LogRing&&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+    LogRing& operator=(LogRing&&) = delete;
+
+private:
+    struct Header {
+        int64_t     ticks;      // system_clock ticks when Log() was called
+        uint32_t    len;
+        int16_t     indent;
+        int16_t     newline;
+    };
+
+    void CopyIn(uint64_t at, const void* src, size_t n) noexcept;
+    void CopyOut(uint64_t at, void* dst, size_t n) const noexcept;
+
+    std::unique_ptr<char[]> _data;
+    size_t                  _mask;
+
+    // the producer and consumer positions are on their own cache lines
+    alignas(64) std::atomic<uint64_t> _head{ 0 };  // written by the logging thread
+    alignas(64) std::atomic<uint64_t> _tail{ 0 };  // written by the writer thread
+};
+
+// Asynchronous logger
+// Log() formats nothing and takes no lock: it copies the message into the calling thread's ring
+// and returns. A background thread drains all the rings every flush_ms, sorts the lines by time,
+// formats the timestamps and writes the batch with one call.
+// Nothing is logged until Start(), so a disabled logger costs one atomic load per call.
 class Logger {
 public:
     Logger(const std::string& filename);
     ~Logger();
+
+    // opens the next numbered log file and starts the writer, returns false if the file can't be opened
+    bool Start(const LogSettings& settings);
+
+    // drains and writes everything logged so far, then stops the writer
+    void Stop();
+
+    bool Enabled() const noexcept {
+        return _enabled.load(std::memory_order_acquire);
+    }
+
     void Log(const int indent, const bool newline, const std::string& message);
     void Log(const int indent, const bool newline, const std::vector<char>&  buf);
 
@@ -21,7 +105,25 @@ public:
 
 private:
     std::string GenerateNextFilename(const std::string& baseName);
+    LogRing* ThreadRing();
+    void WriterLoop();
+    size_t WriteBatch();
+    void Wake() noexcept;
+
+    const std::string _baseName;
+    FILE* _logFile{ nullptr };
+    LogSettings _settings{};
+    std::atomic<bool> _enabled{ false };
+
+    // rings are registered once per thread, the writer drops them once their thread has gone
+    std::mutex _ringsLock{};
+    std::vector<std::shared_ptr<LogRing>> _rings{};
+
+    std::thread _writer{};
+    std::mutex _wakeLock{};
+    std::condition_variable _wake{};
+    std::atomic<bool> _wakePending{ false };
+    bool _stopping{ false };
 
-    std::ofstream _logFile;
     const std::array<std::string,4> _indentStrings = { "", "  ", "    ", "      " };
 };
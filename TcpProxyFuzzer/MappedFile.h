@@ -0,0 +1,84 @@
+#pragma once
+
+// A read-only memory mapping of a whole file
+// The view is shared with the writer, so a file that is still growing can be mapped,
+// the mapping just covers whatever was there when Open() was called.
+
+#include <windows.h>
+#include <string>
+
+#include "gsl/span"
+
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    ~MappedFile() {
+        Close();
+    }
+
+    // returns false if the file can't be opened or mapped, an empty file maps to an empty span
+    bool Open(const std::string& path) noexcept {
+        Close();
+
+        _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(_file, &size)) {
+            Close();
+            return false;
+        }
+
+        _size = static_cast<size_t>(size.QuadPart);
+        if (_size == 0)
+            return true;
+
+        _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (_mapping == nullptr) {
+            Close();
+            return false;
+        }
+
+        _view = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (_view == nullptr) {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void Close() noexcept {
+        if (_view)
+            UnmapViewOfFile(_view);
+
+        if (_mapping)
+            CloseHandle(_mapping);
+
+        if (_file != INVALID_HANDLE_VALUE)
+            CloseHandle(_file);
+
+        _view = nullptr;
+        _mapping = nullptr;
+        _file = INVALID_HANDLE_VALUE;
+        _size = 0;
+    }
+
+    gsl::span<const char> Data() const noexcept {
+        return _view ? gsl::span<const char>(_view, _size) : gsl::span<const char>{};
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+private:
+    HANDLE      _file{ INVALID_HANDLE_VALUE };
+    HANDLE      _mapping{ nullptr };
+    const char* _view{ nullptr };
+    size_t      _size{ 0 };
+};
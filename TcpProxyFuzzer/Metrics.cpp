@@ -0,0 +1,271 @@
+// Prometheus metrics endpoint
+// -metrics:<port> serves GET /metrics on 127.0.0.1:port in the Prometheus text format.
+// Everything it reports comes from CollectStats(), so scraping costs the forwarding threads
+// nothing, they keep counting into their own blocks and the scrape thread does the summing.
+// It's a tiny blocking server on one thread, one scrape at a time is all it needs.
+
+#define  _WINSOCK_DEPRECATED_NO_WARNINGS 1
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <process.h>
+#include <windows.h>
+#include <stdio.h>
+#include <string>
+#include <format>
+
+#include "Proxy.h"
+#include "Stats.h"
+#include "BufferPool.h"
+#include "MutationScheduler.h"
+#include "Novelty.h"
+#include "gsl/util"
+
+namespace {
+
+    SOCKET gMetricsSock{ INVALID_SOCKET };
+
+    // the histogram lines are cumulative, so only every power of two is reported,
+    // 64ns (mutations are cheap) to about 68s, the finer buckets are still there for the percentiles
+    constexpr size_t kFirstReportedExponent = 6;
+    constexpr size_t kLastReportedExponent = 36;
+
+    void AppendCounter(std::string& out, const char* name, const char* help) {
+        out += std::format("# HELP {} {}\n# TYPE {} counter\n", name, help, name);
+    }
+
+    void AppendHistogram(std::string& out, const char* name, const std::string& labels, const HistogramSnapshot& h) {
+        const std::string sep = labels.empty() ? "" : ",";
+
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            cumulative += h.buckets[b];
+
+            // the last sub-bucket of each power of two ends on the next power of two
+            const uint64_t end = HistogramBucketEnd(b);
+            if (b % HISTOGRAM_SUB_BUCKETS != HISTOGRAM_SUB_BUCKETS - 1 ||
+                end < (1ull << kFirstReportedExponent) || end > (1ull << kLastReportedExponent))
+                continue;
+
+            // a bucket holds values below its end, close enough to Prometheus' <= for latencies
+            out += std::format("{}_bucket{{{}{}le=\"{}\"}} {}\n", name, labels, sep, static_cast<double>(end) / 1e9, cumulative);
+        }
+
+        out += std::format("{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, labels, sep, h.count);
+        const std::string braced = labels.empty() ? "" : "{" + labels + "}";
+        out += std::format("{}_sum{} {}\n", name, braced, static_cast<double>(h.sum_ns) / 1e9);
+        out += std::format("{}_count{} {}\n", name, braced, h.count);
+    }
+
+    std::string FormatPrometheus(const StatsSnapshot& stats) {
+        std::string out{};
+        out.reserve(16 * 1024);
+
+        AppendCounter(out, "tpf_connections_accepted_total", "Clients accepted.");
+        out += std::format("tpf_connections_accepted_total {}\n", stats[StatCounter::Accepted]);
+
+        AppendCounter(out, "tpf_accept_failures_total", "accept() errors.");
+        out += std::format("tpf_accept_failures_total {}\n", stats[StatCounter::AcceptFailures]);
+
+        AppendCounter(out, "tpf_connect_failures_total", "Connects to the target that failed, by reason.");
+        out += std::format("tpf_connect_failures_total{{reason=\"error\"}} {}\n", stats[StatCounter::ConnectFailures]);
+        out += std::format("tpf_connect_failures_total{{reason=\"timeout\"}} {}\n", stats[StatCounter::ConnectTimeouts]);
+        out += std::format("tpf_connect_failures_total{{reason=\"dropped\"}} {}\n", stats[StatCounter::ConnectsDropped]);
+
+        AppendCounter(out, "tpf_sessions_total", "Client and target pairs handed to the engine.");
+        out += std::format("tpf_sessions_total {}\n", stats[StatCounter::SessionsStarted]);
+
+        out += "# HELP tpf_active_connections Sessions with at least one direction still open.\n# TYPE tpf_active_connections gauge\n";
+        out += std::format("tpf_active_connections {}\n", stats.ActiveConnections());
+
+        // rate() over these gives bytes/sec per direction
+        AppendCounter(out, "tpf_bytes_total", "Bytes read and written, by direction.");
+        for (size_t dir = 0; dir < 2; dir++) {
+            const char* name = dir == static_cast<size_t>(SocketDir::ClientToServer) ? "c2s" : "s2c";
+            out += std::format("tpf_bytes_total{{direction=\"{}\",stage=\"in\"}} {}\n", name, stats[BytesInCounter(dir)]);
+            out += std::format("tpf_bytes_total{{direction=\"{}\",stage=\"out\"}} {}\n", name, stats[BytesOutCounter(dir)]);
+        }
+
+        AppendCounter(out, "tpf_chunks_total", "Chunks seen by fuzzed directions.");
+        out += std::format("tpf_chunks_total{{result=\"fuzzed\"}} {}\n", stats[StatCounter::ChunksFuzzed]);
+        out += std::format("tpf_chunks_total{{result=\"skipped\"}} {}\n", stats[StatCounter::ChunksSkipped]);
+
+        AppendCounter(out, "tpf_frames_total", "Messages framed with -frame, whole ones are fuzzed, passed ones go through as they arrive.");
+        out += std::format("tpf_frames_total{{result=\"whole\"}} {}\n", stats[StatCounter::Frames]);
+        out += std::format("tpf_frames_total{{result=\"passed\"}} {}\n", stats[StatCounter::FramesPassed]);
+
+        AppendCounter(out, "tpf_responses_total", "Server answers fingerprinted with -novelty, new ones hadn't been seen before.");
+        out += std::format("tpf_responses_total{{result=\"new\"}} {}\n", stats[StatCounter::NovelResponses]);
+        out += std::format("tpf_responses_total{{result=\"seen\"}} {}\n", stats[StatCounter::Responses] - stats[StatCounter::NovelResponses]);
+
+        AppendCounter(out, "tpf_buffers_total", "Chunk buffers handed out by the pools, and chunks that outgrew theirs.");
+        out += std::format("tpf_buffers_total{{result=\"allocated\"}} {}\n", stats[StatCounter::BufferAllocs]);
+        out += std::format("tpf_buffers_total{{result=\"reused\"}} {}\n", stats[StatCounter::BufferReuses]);
+        out += std::format("tpf_buffers_total{{result=\"regrown\"}} {}\n", stats[StatCounter::BufferRegrows]);
+
+        AppendCounter(out, "tpf_buffer_resizes_total", "Adaptive buffer size changes, and doublings -buffer_budget stopped.");
+        out += std::format("tpf_buffer_resizes_total{{result=\"grown\"}} {}\n", stats[StatCounter::BufferGrows]);
+        out += std::format("tpf_buffer_resizes_total{{result=\"shrunk\"}} {}\n", stats[StatCounter::BufferShrinks]);
+        out += std::format("tpf_buffer_resizes_total{{result=\"denied\"}} {}\n", stats[StatCounter::BufferGrowsDenied]);
+
+        out += "# HELP tpf_buffer_growth_bytes What the grown buffers hold above -buffer, capped by -buffer_budget.\n# TYPE tpf_buffer_growth_bytes gauge\n";
+        out += std::format("tpf_buffer_growth_bytes {}\n", BufferGrowthBytes());
+
+        out += "# HELP tpf_send_queue_bytes What's waiting in the send queues, charged at buffer capacity.\n# TYPE tpf_send_queue_bytes gauge\n";
+        out += std::format("tpf_send_queue_bytes {}\n", stats.QueuedBytes());
+
+        AppendCounter(out, "tpf_throttles_total", "Times a direction stopped reading because its sends couldn't keep up.");
+        out += std::format("tpf_throttles_total {}\n", stats[StatCounter::Throttles]);
+
+        AppendCounter(out, "tpf_throttled_seconds_total", "Time directions spent not reading because their sends couldn't keep up.");
+        out += std::format("tpf_throttled_seconds_total {:.6f}\n", static_cast<double>(stats[StatCounter::ThrottledNs]) / 1e9);
+
+        AppendCounter(out, "tpf_mutations_total", "Mutations applied, by type.");
+        for (size_t m = 0; m < static_cast<size_t>(FuzzMutation::Max); m++) {
+            const auto mutation = static_cast<FuzzMutation>(m);
+            out += std::format("tpf_mutations_total{{mutation=\"{}\"}} {}\n", FuzzMutationName(mutation), stats.Mutation(mutation));
+        }
+
+        AppendCounter(out, "tpf_novelty_credits_total", "Times a mutation was applied ahead of a new server answer, with -novelty.");
+        for (size_t m = 0; m < MUTATION_COUNT; m++) {
+            const auto mutation = static_cast<FuzzMutation>(m);
+            out += std::format("tpf_novelty_credits_total{{mutation=\"{}\"}} {}\n", FuzzMutationName(mutation), NoveltyCredits(mutation));
+        }
+
+        const MutationSchedule& schedule = CurrentSchedule();
+        out += "# HELP tpf_mutation_probability The chance a fuzz picks the mutation, from the weights.\n# TYPE tpf_mutation_probability gauge\n";
+        for (size_t t = 0; t < SCHEDULE_FUZZ_TYPES; t++) {
+            for (size_t m = 0; m < MUTATION_COUNT; m++) {
+                const auto mutation = static_cast<FuzzMutation>(m);
+                out += std::format("tpf_mutation_probability{{fuzz_type=\"{}\",mutation=\"{}\"}} {:.6f}\n",
+                    SCHEDULE_FUZZ_TYPE_NAMES[t], FuzzMutationName(mutation), schedule.tables[t].Probability(mutation));
+            }
+        }
+
+        out += "# HELP tpf_connect_latency_seconds Time to connect to the target.\n# TYPE tpf_connect_latency_seconds histogram\n";
+        AppendHistogram(out, "tpf_connect_latency_seconds", "", stats.Histogram(StatHistogram::ConnectLatency));
+
+        out += "# HELP tpf_chunk_latency_seconds Time from a chunk's recv() to its send() completing.\n# TYPE tpf_chunk_latency_seconds histogram\n";
+        for (size_t dir = 0; dir < 2; dir++) {
+            for (size_t mode = 0; mode < STAT_FUZZ_MODES; mode++) {
+                // a run only ever uses one fuzz_type, so most of these are empty and left out
+                const HistogramSnapshot& h = stats.Histogram(ChunkLatencyHistogram(dir, mode));
+                if (h.count == 0)
+                    continue;
+
+                const std::string labels = std::format("direction=\"{}\",mode=\"{}\"",
+                    dir == static_cast<size_t>(SocketDir::ClientToServer) ? "c2s" : "s2c", StatFuzzModeName(mode));
+                AppendHistogram(out, "tpf_chunk_latency_seconds", labels, h);
+            }
+        }
+
+        out += "# HELP tpf_mutation_cost_seconds Time spent applying each mutation.\n# TYPE tpf_mutation_cost_seconds histogram\n";
+        for (size_t m = 0; m < static_cast<size_t>(FuzzMutation::Max); m++) {
+            const auto mutation = static_cast<FuzzMutation>(m);
+            const HistogramSnapshot& h = stats.Histogram(MutationCostHistogram(mutation));
+            if (h.count == 0)
+                continue;
+
+            AppendHistogram(out, "tpf_mutation_cost_seconds", std::format("mutation=\"{}\"", FuzzMutationName(mutation)), h);
+        }
+
+        return out;
+    }
+
+    void SendAll(SOCKET sock, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            const int n = send(sock, data.data() + sent, gsl::narrow_cast<int>(data.size() - sent), 0);
+            if (n == SOCKET_ERROR)
+                return;
+
+            sent += n;
+        }
+    }
+
+    // reads the request line, the rest of the request is ignored
+    void Serve(SOCKET sock) {
+        std::string request{};
+        char buf[1024]{};
+        while (request.find("\r\n") == std::string::npos && request.size() < 8192) {
+            const int n = recv(sock, buf, sizeof(buf), 0);
+            if (n <= 0)
+                return;
+
+            request.append(buf, n);
+        }
+
+        std::string status = "200 OK";
+        std::string body{};
+        if (request.starts_with("GET /metrics ") || request.starts_with("GET /metrics?")) {
+            body = FormatPrometheus(CollectStats());
+        } else {
+            status = "404 Not Found";
+            body = "Not found, try /metrics\n";
+        }
+
+        SendAll(sock, std::format(
+            "HTTP/1.1 {}\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+            status, body.size(), body));
+    }
+
+    unsigned __stdcall metrics_thread(_In_ void*) {
+        while (true) {
+            const SOCKET sock = accept(gMetricsSock, NULL, NULL);
+            if (sock == INVALID_SOCKET) {
+                fprintf(stderr, "Metrics accept failed. Error: %d\n", WSAGetLastError());
+                continue;
+            }
+
+            // a scraper that connects and says nothing mustn't wedge the endpoint
+            const DWORD timeout_ms = 2000;
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout_ms), sizeof(timeout_ms));
+            setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout_ms), sizeof(timeout_ms));
+
+            Serve(sock);
+
+            shutdown(sock, SD_SEND);
+            closesocket(sock);
+        }
+
+        return 0;
+    }
+}
+
+#pragma region Metrics API
+
+bool StartMetricsServer(unsigned short port) {
+    gMetricsSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (gMetricsSock == INVALID_SOCKET) {
+        fprintf(stderr, "Metrics socket creation failed. Error: %d\n", WSAGetLastError());
+        return false;
+    }
+
+    // loopback only, the numbers say a lot about the target and there's no auth
+    SOCKADDR_IN addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if (bind(gMetricsSock, reinterpret_cast<SOCKADDR*>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+        listen(gMetricsSock, 4) == SOCKET_ERROR) {
+        fprintf(stderr, "Metrics bind failed. Error: %d\n", WSAGetLastError());
+        closesocket(gMetricsSock);
+        gMetricsSock = INVALID_SOCKET;
+        return false;
+    }
+
+    const auto thread = _beginthreadex(NULL, 0, metrics_thread, NULL, 0, NULL);
+    if (thread == 0) {
+        fprintf(stderr, "Metrics thread creation failed. Error: %d\n", errno);
+        closesocket(gMetricsSock);
+        gMetricsSock = INVALID_SOCKET;
+        return false;
+    }
+
+    CloseHandle(reinterpret_cast<HANDLE>(thread));
+
+    return true;
+}
+
+#pragma endregion Metrics API
@@ -0,0 +1,488 @@
+// Vectorized kernels for the strided byte mutations, see MutationKernels.h
+// The vector versions handle the contiguous case, and for the mutations that don't need random
+// numbers, strides up to MAX_SIMD_STRIDE too, using a per-lane phase counter to build the mask
+// of bytes to touch. Everything else, and the tail of every range, goes through the scalar code.
+
+#include <intrin.h>
+#include <cstring>
+#include <array>
+#include <algorithm>
+
+#include "MutationKernels.h"
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define KERNELS_X86 1
+#endif
+
+namespace {
+
+    // the largest stride the vector code handles, Fuzz() uses 1-9
+    constexpr size_t MAX_SIMD_STRIDE = 16;
+
+    // interesting edge-case numbers, often 2^n +/- 1
+    constexpr unsigned char interestingNum[]
+        = { 0,1,2,3,4,5,7,8,9,15,16,17,31,32,
+            33,63,64,65,127,128,129,191,192,193,
+            223,224,225,239,240,241,247,248,249,253,
+            254,255 };
+
+    constexpr uint32_t INTERESTING_COUNT = sizeof(interestingNum);
+
+    // a 16-bit random value v picks interestingNum[(v * 36) >> 16] (Lemire's method),
+    // values whose low half is below 65536 % 36 are rejected so every number is equally likely
+    constexpr uint32_t INTERESTING_REJECT = 65536 % INTERESTING_COUNT;
+
+    constexpr size_t RoundUp8(size_t n) noexcept {
+        return (n + 7) & ~static_cast<size_t>(7);
+    }
+
+    // An endless stream of random bytes from RandomNumberGenerator::fill()
+    // Peek(n) makes n bytes available and Advance(n) consumes them. The generator is asked for
+    // whole outputs to cover what's been peeked, plus the bytes the caller said it will certainly
+    // consume, so after consuming C bytes exactly (C + 7) / 8 outputs have been used no matter how
+    // the kernel chunked its reads. That's what keeps the scalar and vector kernels in step.
+    class RandomBytes {
+    public:
+        RandomBytes(RandomNumberGenerator& rng, size_t minimum) noexcept
+            : _rng(rng), _ahead(RoundUp8(minimum)) {
+        }
+
+        const unsigned char* Peek(size_t n) noexcept {
+            if (_end - _pos < n)
+                Refill(n);
+
+            return _buf.data() + _pos;
+        }
+
+        void Advance(size_t n) noexcept {
+            _pos += n;
+        }
+
+        RandomBytes(const RandomBytes&) = delete;
+        RandomBytes(RandomBytes&&) = delete;
+        RandomBytes& operator=(const RandomBytes&) = delete;
+        RandomBytes& operator=(RandomBytes&&) = delete;
+
+    private:
+        void Refill(size_t n) noexcept {
+            const size_t have = _end - _pos;
+            memmove(_buf.data(), _buf.data() + _pos, have);
+            _pos = 0;
+            _end = have;
+
+            const size_t room = (_buf.size() - _end) & ~static_cast<size_t>(7);
+            const size_t want = (std::max)(RoundUp8(n - have), (std::min)(_ahead, room));
+
+            _rng.fill(_buf.data() + _end, want);
+            _end += want;
+            _ahead = _ahead > want ? _ahead - want : 0;
+        }
+
+        RandomNumberGenerator&          _rng;
+        std::array<unsigned char, 512>  _buf{};
+        size_t                          _pos{ 0 };
+        size_t                          _end{ 0 };
+        size_t                          _ahead{ 0 };    // bytes known to be needed, not generated yet
+    };
+
+    unsigned char* Bytes(gsl::span<char> range) noexcept {
+        return reinterpret_cast<unsigned char*>(range.data());
+    }
+
+    // the first index >= i that the stride lands on
+    size_t NextStrided(size_t i, size_t stride) noexcept {
+        return (i + stride - 1) / stride * stride;
+    }
+
+    // how many bytes of range a stride touches
+    size_t StridedCount(gsl::span<char> range, size_t stride) noexcept {
+        return NextStrided(range.size(), stride) / stride;
+    }
+
+#pragma region Scalar Kernels
+
+    // the top two bits of r pick the change, the vector code does the same per lane
+    // the choice is random, so it's a table lookup rather than a branch that mispredicts half the time
+    unsigned char ChangeAsciiInt(unsigned char c, unsigned char r) noexcept {
+        const unsigned char changed[4] = {
+            static_cast<unsigned char>(c + 1),
+            static_cast<unsigned char>(c - 1),
+            static_cast<unsigned char>(static_cast<signed char>(c) / 2),
+            static_cast<unsigned char>(c * 2)
+        };
+
+        return changed[r >> 6];
+    }
+
+    unsigned char NextInteresting(RandomBytes& random) noexcept {
+        while (true) {
+            const unsigned char* b = random.Peek(2);
+            const uint32_t m = (b[0] | (static_cast<uint32_t>(b[1]) << 8)) * INTERESTING_COUNT;
+            random.Advance(2);
+
+            if ((m & 0xFFFF) >= INTERESTING_REJECT)
+                return interestingNum[m >> 16];
+        }
+    }
+
+    void ChangeAsciiIntTail(unsigned char* p, size_t n, size_t stride, size_t i, RandomBytes& random) noexcept {
+        for (size_t j = NextStrided(i, stride); j < n; j += stride) {
+            p[j] = ChangeAsciiInt(p[j], *random.Peek(1));
+            random.Advance(1);
+        }
+    }
+
+    void InterestingNumberTail(unsigned char* p, size_t n, size_t stride, size_t i, RandomBytes& random) noexcept {
+        for (size_t j = NextStrided(i, stride); j < n; j += stride)
+            p[j] = NextInteresting(random);
+    }
+
+    void SetUpperBitScalar(gsl::span<char> range, size_t stride) noexcept {
+        unsigned char* p = Bytes(range);
+        for (size_t j = 0; j < range.size(); j += stride)
+            p[j] |= 0x80;
+    }
+
+    void ResetUpperBitScalar(gsl::span<char> range, size_t stride) noexcept {
+        unsigned char* p = Bytes(range);
+        for (size_t j = 0; j < range.size(); j += stride)
+            p[j] &= 0x7F;
+    }
+
+    void FillByteScalar(gsl::span<char> range, size_t stride, char byte) noexcept {
+        char* p = range.data();
+        for (size_t j = 0; j < range.size(); j += stride)
+            p[j] = byte;
+    }
+
+    void ChangeAsciiIntScalar(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept {
+        RandomBytes random(rng, StridedCount(range, stride));
+        ChangeAsciiIntTail(Bytes(range), range.size(), stride, 0, random);
+    }
+
+    void InterestingNumberScalar(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept {
+        RandomBytes random(rng, 2 * StridedCount(range, stride));
+        InterestingNumberTail(Bytes(range), range.size(), stride, 0, random);
+    }
+
+    constexpr MutationKernels scalarKernels{
+        KernelLevel::Scalar, "scalar",
+        SetUpperBitScalar, ResetUpperBitScalar, FillByteScalar,
+        ChangeAsciiIntScalar, InterestingNumberScalar
+    };
+
+#pragma endregion Scalar Kernels
+
+#ifdef KERNELS_X86
+
+#pragma region Vector Kernels
+
+    // thin wrappers so the kernels below can be written once for both vector widths
+    struct Sse2 {
+        using Vec = __m128i;
+        static constexpr size_t Width = 16;
+
+        static Vec Load(const unsigned char* p) noexcept { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+        static void Store(unsigned char* p, Vec v) noexcept { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+        static Vec Set1(unsigned char b) noexcept { return _mm_set1_epi8(static_cast<char>(b)); }
+        static Vec And(Vec a, Vec b) noexcept { return _mm_and_si128(a, b); }
+        static Vec Or(Vec a, Vec b) noexcept { return _mm_or_si128(a, b); }
+        static Vec AndNot(Vec a, Vec b) noexcept { return _mm_andnot_si128(a, b); }    // ~a & b
+        static Vec CmpEq(Vec a, Vec b) noexcept { return _mm_cmpeq_epi8(a, b); }
+        static Vec CmpGt(Vec a, Vec b) noexcept { return _mm_cmpgt_epi8(a, b); }       // signed
+        static Vec Add(Vec a, Vec b) noexcept { return _mm_add_epi8(a, b); }
+        static Vec Sub(Vec a, Vec b) noexcept { return _mm_sub_epi8(a, b); }
+        template <int N> static Vec Srli16(Vec a) noexcept { return _mm_srli_epi16(a, N); }
+    };
+
+    struct Avx2 {
+        using Vec = __m256i;
+        static constexpr size_t Width = 32;
+
+        static Vec Load(const unsigned char* p) noexcept { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+        static void Store(unsigned char* p, Vec v) noexcept { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+        static Vec Set1(unsigned char b) noexcept { return _mm256_set1_epi8(static_cast<char>(b)); }
+        static Vec And(Vec a, Vec b) noexcept { return _mm256_and_si256(a, b); }
+        static Vec Or(Vec a, Vec b) noexcept { return _mm256_or_si256(a, b); }
+        static Vec AndNot(Vec a, Vec b) noexcept { return _mm256_andnot_si256(a, b); }
+        static Vec CmpEq(Vec a, Vec b) noexcept { return _mm256_cmpeq_epi8(a, b); }
+        static Vec CmpGt(Vec a, Vec b) noexcept { return _mm256_cmpgt_epi8(a, b); }
+        static Vec Add(Vec a, Vec b) noexcept { return _mm256_add_epi8(a, b); }
+        static Vec Sub(Vec a, Vec b) noexcept { return _mm256_sub_epi8(a, b); }
+        template <int N> static Vec Srli16(Vec a) noexcept { return _mm256_srli_epi16(a, N); }
+    };
+
+    // Applies op to every stride-th byte of range
+    // op.Vec(x, mask) transforms the lanes where mask is 0xFF, op.Scalar(x) does one byte
+    // lane k of block b is byte b*Width + k, its phase is (b*Width + k) % stride and it's touched when that's 0
+    template <typename V, typename Op>
+    void Strided(gsl::span<char> range, size_t stride, const Op& op) noexcept {
+        unsigned char* p = Bytes(range);
+        const size_t n = range.size();
+        size_t i = 0;
+
+        if (stride == 1) {
+            const auto all = V::Set1(0xFF);
+            for (; i + V::Width <= n; i += V::Width)
+                V::Store(p + i, op.Vec(V::Load(p + i), all));
+        } else if (stride <= MAX_SIMD_STRIDE) {
+            std::array<unsigned char, V::Width> lanes{};
+            for (size_t k = 0; k < V::Width; k++)
+                lanes.at(k) = static_cast<unsigned char>(k % stride);
+
+            auto phase = V::Load(lanes.data());
+            const auto zero = V::Set1(0);
+            const auto step = V::Set1(static_cast<unsigned char>(V::Width % stride));
+            const auto strideV = V::Set1(static_cast<unsigned char>(stride));
+            const auto strideM1 = V::Set1(static_cast<unsigned char>(stride - 1));
+
+            for (; i + V::Width <= n; i += V::Width) {
+                V::Store(p + i, op.Vec(V::Load(p + i), V::CmpEq(phase, zero)));
+
+                // phase = (phase + Width) % stride, phase and step are both below stride
+                phase = V::Add(phase, step);
+                phase = V::Sub(phase, V::And(strideV, V::CmpGt(phase, strideM1)));
+            }
+        }
+
+        for (size_t j = NextStrided(i, stride); j < n; j += stride)
+            p[j] = op.Scalar(p[j]);
+    }
+
+    template <typename V>
+    struct SetUpperBitOp {
+        typename V::Vec Vec(typename V::Vec x, typename V::Vec mask) const noexcept { return V::Or(x, V::And(mask, V::Set1(0x80))); }
+        unsigned char Scalar(unsigned char x) const noexcept { return x | 0x80; }
+    };
+
+    template <typename V>
+    struct ResetUpperBitOp {
+        typename V::Vec Vec(typename V::Vec x, typename V::Vec mask) const noexcept { return V::AndNot(V::And(mask, V::Set1(0x80)), x); }
+        unsigned char Scalar(unsigned char x) const noexcept { return x & 0x7F; }
+    };
+
+    template <typename V>
+    struct FillByteOp {
+        unsigned char byte;
+        typename V::Vec Vec(typename V::Vec x, typename V::Vec mask) const noexcept { return V::Or(V::And(mask, V::Set1(byte)), V::AndNot(mask, x)); }
+        unsigned char Scalar(unsigned char) const noexcept { return byte; }
+    };
+
+    template <typename V>
+    void SetUpperBitVec(gsl::span<char> range, size_t stride) noexcept {
+        Strided<V>(range, stride, SetUpperBitOp<V>{});
+    }
+
+    template <typename V>
+    void ResetUpperBitVec(gsl::span<char> range, size_t stride) noexcept {
+        Strided<V>(range, stride, ResetUpperBitOp<V>{});
+    }
+
+    template <typename V>
+    void FillByteVec(gsl::span<char> range, size_t stride, char byte) noexcept {
+        Strided<V>(range, stride, FillByteOp<V>{ static_cast<unsigned char>(byte) });
+    }
+
+    // the same four changes as ChangeAsciiInt(), worked out for every lane and then selected
+    // there's no 8-bit arithmetic shift, so the signed halving rounds towards zero by adding the
+    // sign bit first and then shifts each byte right, putting the sign bit back
+    template <typename V>
+    void ChangeAsciiIntVec(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept {
+        if (stride != 1) {
+            ChangeAsciiIntScalar(range, stride, rng);
+            return;
+        }
+
+        unsigned char* p = Bytes(range);
+        const size_t n = range.size();
+        RandomBytes random(rng, n);
+
+        const auto one = V::Set1(0x01);
+        const auto top2 = V::Set1(0xC0);
+        const auto sign = V::Set1(0x80);
+        const auto low7 = V::Set1(0x7F);
+
+        size_t i = 0;
+        for (; i + V::Width <= n; i += V::Width) {
+            const auto x = V::Load(p + i);
+            const auto op = V::And(V::Load(random.Peek(V::Width)), top2);
+            random.Advance(V::Width);
+
+            const auto inc = V::Add(x, one);
+            const auto dec = V::Sub(x, one);
+            const auto t = V::Add(x, V::And(V::template Srli16<7>(x), one));
+            const auto half = V::Or(V::And(V::template Srli16<1>(t), low7), V::And(t, sign));
+            const auto dbl = V::Add(x, x);
+
+            const auto m0 = V::CmpEq(op, V::Set1(0x00));
+            const auto m1 = V::CmpEq(op, V::Set1(0x40));
+            const auto m2 = V::CmpEq(op, sign);
+            const auto m3 = V::AndNot(V::Or(V::Or(m0, m1), m2), V::Set1(0xFF));
+
+            const auto out = V::Or(V::Or(V::And(m0, inc), V::And(m1, dec)),
+                                   V::Or(V::And(m2, half), V::And(m3, dbl)));
+            V::Store(p + i, out);
+        }
+
+        ChangeAsciiIntTail(p, n, 1, i, random);
+    }
+
+    // 16 lanes of 16-bit random values, the lanes where Lemire's method would reject
+    __m128i RejectMask(__m128i v) noexcept {
+        const __m128i low = _mm_mullo_epi16(v, _mm_set1_epi16(static_cast<short>(INTERESTING_COUNT)));
+        return _mm_cmpeq_epi16(_mm_subs_epu16(low, _mm_set1_epi16(static_cast<short>(INTERESTING_REJECT - 1))), _mm_setzero_si128());
+    }
+
+    // SSE2 has no byte shuffle, so this picks the indexes 16 at a time and looks them up one by one
+    // a block with a rejected value is rare (about 1 in 200) and is done by the scalar code,
+    // which consumes the extra random values the same way the reference does
+    void InterestingNumberSse2(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept {
+        if (stride != 1) {
+            InterestingNumberScalar(range, stride, rng);
+            return;
+        }
+
+        unsigned char* p = Bytes(range);
+        const size_t n = range.size();
+        RandomBytes random(rng, 2 * n);
+        const __m128i count = _mm_set1_epi16(static_cast<short>(INTERESTING_COUNT));
+        std::array<unsigned char, 16> idx{};
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const unsigned char* r = random.Peek(32);
+            const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r));
+            const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + 16));
+
+            if (_mm_movemask_epi8(_mm_or_si128(RejectMask(v0), RejectMask(v1))) != 0) {
+                InterestingNumberTail(p, i + 16, 1, i, random);
+                continue;
+            }
+
+            random.Advance(32);
+            const __m128i hi = _mm_packus_epi16(_mm_mulhi_epu16(v0, count), _mm_mulhi_epu16(v1, count));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(idx.data()), hi);
+            for (size_t k = 0; k < 16; k++)
+                p[i + k] = interestingNum[idx.at(k)];
+        }
+
+        InterestingNumberTail(p, n, 1, i, random);
+    }
+
+    // AVX2 looks the numbers up with three 16-entry byte shuffles and picks the right one per lane
+    void InterestingNumberAvx2(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept {
+        if (stride != 1) {
+            InterestingNumberScalar(range, stride, rng);
+            return;
+        }
+
+        unsigned char* p = Bytes(range);
+        const size_t n = range.size();
+        RandomBytes random(rng, 2 * n);
+
+        std::array<unsigned char, 48> table{};
+        memcpy(table.data(), interestingNum, sizeof(interestingNum));
+        const __m256i tbl0 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table.data())));
+        const __m256i tbl1 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table.data() + 16)));
+        const __m256i tbl2 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table.data() + 32)));
+        const __m256i count = _mm256_set1_epi16(static_cast<short>(INTERESTING_COUNT));
+        const __m256i rejectBelow = _mm256_set1_epi16(static_cast<short>(INTERESTING_REJECT - 1));
+        const __m256i sixteen = _mm256_set1_epi8(16);
+        const __m256i thirtyTwo = _mm256_set1_epi8(32);
+
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            const unsigned char* r = random.Peek(64);
+            const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r));
+            const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + 32));
+
+            const __m256i rej0 = _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_mullo_epi16(v0, count), rejectBelow), _mm256_setzero_si256());
+            const __m256i rej1 = _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_mullo_epi16(v1, count), rejectBelow), _mm256_setzero_si256());
+            if (_mm256_movemask_epi8(_mm256_or_si256(rej0, rej1)) != 0) {
+                InterestingNumberTail(p, i + 32, 1, i, random);
+                continue;
+            }
+
+            random.Advance(64);
+
+            // the pack works within each 128-bit half, the permute puts the quarters back in order
+            const __m256i idx = _mm256_permute4x64_epi64(
+                _mm256_packus_epi16(_mm256_mulhi_epu16(v0, count), _mm256_mulhi_epu16(v1, count)), 0xD8);
+
+            const __m256i from0 = _mm256_shuffle_epi8(tbl0, idx);
+            const __m256i from1 = _mm256_shuffle_epi8(tbl1, _mm256_sub_epi8(idx, sixteen));
+            const __m256i from2 = _mm256_shuffle_epi8(tbl2, _mm256_sub_epi8(idx, thirtyTwo));
+
+            __m256i out = _mm256_blendv_epi8(from2, from1, _mm256_cmpgt_epi8(thirtyTwo, idx));
+            out = _mm256_blendv_epi8(out, from0, _mm256_cmpgt_epi8(sixteen, idx));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), out);
+        }
+
+        InterestingNumberTail(p, n, 1, i, random);
+    }
+
+    constexpr MutationKernels sse2Kernels{
+        KernelLevel::Sse2, "sse2",
+        SetUpperBitVec<Sse2>, ResetUpperBitVec<Sse2>, FillByteVec<Sse2>,
+        ChangeAsciiIntVec<Sse2>, InterestingNumberSse2
+    };
+
+    constexpr MutationKernels avx2Kernels{
+        KernelLevel::Avx2, "avx2",
+        SetUpperBitVec<Avx2>, ResetUpperBitVec<Avx2>, FillByteVec<Avx2>,
+        ChangeAsciiIntVec<Avx2>, InterestingNumberAvx2
+    };
+
+#pragma endregion Vector Kernels
+
+#endif
+}
+
+void FillRandom(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept {
+    unsigned char* p = Bytes(range);
+    const size_t n = range.size();
+
+    if (stride == 1) {
+        rng.fill(p, n);
+        return;
+    }
+
+    RandomBytes random(rng, StridedCount(range, stride));
+    for (size_t j = 0; j < n; j += stride) {
+        p[j] = *random.Peek(1);
+        random.Advance(1);
+    }
+}
+
+KernelLevel BestKernelLevel() noexcept {
+#ifdef KERNELS_X86
+    if (CpuHasAvx2())
+        return KernelLevel::Avx2;
+
+    if (CpuHasSse2())
+        return KernelLevel::Sse2;
+#endif
+
+    return KernelLevel::Scalar;
+}
+
+const MutationKernels& GetKernels(KernelLevel level) noexcept {
+    static const KernelLevel best = BestKernelLevel();
+    level = (std::min)(level, best);
+
+#ifdef KERNELS_X86
+    if (level == KernelLevel::Avx2)
+        return avx2Kernels;
+
+    if (level == KernelLevel::Sse2)
+        return sse2Kernels;
+#endif
+
+    return scalarKernels;
+}
+
+const MutationKernels& Kernels() noexcept {
+    static const MutationKernels& kernels = GetKernels(BestKernelLevel());
+    return kernels;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Vectorized kernels for the strided byte mutations in Fuzz()
+// Each mutation touches range[0], range[stride], range[2*stride]... There is a scalar reference
+// version of every kernel and SSE2 and AVX2 versions, the best one the CPU supports is picked at
+// runtime. The kernels that need random numbers pull them from the generator in bulk through
+// one shared stream, so every version consumes exactly the same random bytes in the same order
+// and produces byte-identical output for the same seed.
+
+#include <cstddef>
+#include "gsl/span"
+#include "rand.h"
+
+enum class KernelLevel {
+    Scalar = 0,
+    Sse2 = 1,
+    Avx2 = 2
+};
+
+struct MutationKernels {
+    KernelLevel level;
+    const char* name;
+
+    // range[i] |= 0x80
+    void (*setUpperBit)(gsl::span<char> range, size_t stride) noexcept;
+
+    // range[i] &= 0x7F
+    void (*resetUpperBit)(gsl::span<char> range, size_t stride) noexcept;
+
+    // range[i] = byte
+    void (*fillByte)(gsl::span<char> range, size_t stride, char byte) noexcept;
+
+    // range[i] is randomly incremented, decremented, halved or doubled
+    void (*changeAsciiInt)(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept;
+
+    // range[i] is set to a random edge-case number, often 2^n +/- 1
+    void (*interestingNumber)(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept;
+};
+
+// range[i] = a random byte, the bytes come from RandomNumberGenerator::fill()
+// this is the same for every level, it's memory bound once the bytes are generated in bulk
+void FillRandom(gsl::span<char> range, size_t stride, RandomNumberGenerator& rng) noexcept;
+
+// the best level this CPU and OS support
+KernelLevel BestKernelLevel() noexcept;
+
+// the kernels for a level, levels the CPU doesn't support fall back to the best one it does
+const MutationKernels& GetKernels(KernelLevel level) noexcept;
+
+// the kernels Fuzz() uses, picked once on first use
+const MutationKernels& Kernels() noexcept;
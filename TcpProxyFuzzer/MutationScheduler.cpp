@@ -0,0 +1,300 @@
+// Weighted mutation picking, see MutationScheduler.h
+
+#include <cstdio>
+#include <cctype>
+#include <cmath>
+#include <array>
+#include <string>
+#include <string_view>
+#include <iterator>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+#include "MutationScheduler.h"
+
+namespace {
+
+    ScheduleWeights UnitWeights() noexcept {
+        ScheduleWeights weights{};
+        for (auto& type : weights)
+            type.fill(1.0);
+
+        return weights;
+    }
+
+    // guarded by gScheduleLock
+    std::mutex                                  gScheduleLock{};
+    std::shared_ptr<const MutationSchedule>     gSchedule{};
+    ScheduleWeights                             gWeights{ DefaultScheduleWeights() };
+    ScheduleWeights                             gBoosts{ UnitWeights() };
+    std::atomic<uint64_t>                       gScheduleVersion{ 0 };
+
+    // the set this thread is using, it keeps it alive while the thread does
+    thread_local std::shared_ptr<const MutationSchedule> tSchedule{};
+
+    // set by ScopedSchedule, the owner keeps it alive
+    thread_local const MutationSchedule* tPinned{ nullptr };
+
+    std::shared_ptr<const MutationSchedule> BuildSchedule(uint64_t version) {
+        auto schedule = std::make_shared<MutationSchedule>();
+        schedule->version = version;
+        for (size_t t = 0; t < SCHEDULE_FUZZ_TYPES; t++) {
+            for (size_t m = 0; m < MUTATION_COUNT; m++)
+                schedule->weights[t][m] = gWeights[t][m] * gBoosts[t][m];
+
+            schedule->tables[t].Build(schedule->weights[t]);
+        }
+
+        return schedule;
+    }
+
+    // call with gScheduleLock held
+    void Publish() {
+        const uint64_t version = gScheduleVersion.load(std::memory_order_relaxed) + 1;
+        gSchedule = BuildSchedule(version);
+        gScheduleVersion.store(version, std::memory_order_release);
+    }
+
+    bool EqualsNoCase(const std::string& a, const char* b) noexcept {
+        const std::string_view other(b);
+        return a.size() == other.size() && std::equal(a.begin(), a.end(), other.begin(),
+            [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+    }
+
+    // the parts of a line, false for a blank line or a comment
+    bool ReadWeightLine(const std::string& line, std::string& type, std::string& mutation, std::string& weight) {
+        std::istringstream fields(line.substr(0, line.find('#')));
+        if (!(fields >> type))
+            return false;
+
+        fields >> mutation >> weight;
+        return true;
+    }
+
+    void WatchLoop(std::string path) {
+        std::error_code ec{};
+        auto last = std::filesystem::last_write_time(path, ec);
+
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(WEIGHTS_POLL_MS));
+
+            // a failed load leaves the last good weights in place, the next save gets another go
+            const auto now = std::filesystem::last_write_time(path, ec);
+            if (ec || now == last)
+                continue;
+
+            last = now;
+            if (LoadScheduleWeights(path))
+                fprintf(stdout, "Reloaded mutation weights from %s\n", path.c_str());
+        }
+    }
+}
+
+size_t ScheduleFuzzType(unsigned int fuzz_type) noexcept {
+    for (size_t t = 0; t < SCHEDULE_FUZZ_TYPES; t++) {
+        if (static_cast<unsigned int>(SCHEDULE_FUZZ_TYPE_NAMES[t]) == fuzz_type)
+            return t;
+    }
+
+    return 0;
+}
+
+ScheduleWeights DefaultScheduleWeights() noexcept {
+    ScheduleWeights weights = UnitWeights();
+
+    // Mutate() skips naughty words for binary, so picking it just wastes the iteration
+    weights[ScheduleFuzzType('b')][static_cast<size_t>(FuzzMutation::NaughtyWord)] = 0.0;
+
+    return weights;
+}
+
+#pragma region Alias Table
+
+void AliasTable::Build(const MutationWeights& weights) noexcept {
+    // the mutations that can be picked, and their weights scaled so they average 1
+    std::array<FuzzMutation, MUTATION_COUNT> picked{};
+    std::array<double, MUTATION_COUNT> scaled{};
+    size_t n = 0;
+    double total = 0;
+    for (size_t m = 0; m < MUTATION_COUNT; m++) {
+        if (!(weights[m] > 0) || !std::isfinite(weights[m]))
+            continue;
+
+        picked[n] = static_cast<FuzzMutation>(m);
+        scaled[n] = weights[m];
+        total += weights[m];
+        n++;
+    }
+
+    if (n == 0) {
+        _columns[0] = {};
+        _count = 1;
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        scaled[i] = scaled[i] * static_cast<double>(n) / total;
+
+    // Vose: each column under 1 is topped up from one over 1, which then goes back on whichever list it now belongs to
+    std::array<size_t, MUTATION_COUNT> small{}, large{};
+    size_t smalls = 0, larges = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (scaled[i] < 1.0)
+            small[smalls++] = i;
+        else
+            large[larges++] = i;
+    }
+
+    auto threshold = [](double p) noexcept {
+        return p >= 1.0 - 1e-9 ? kAlways : static_cast<uint32_t>((std::min)(p * 4294967296.0, 4294967294.0));
+    };
+
+    while (smalls && larges) {
+        const size_t s = small[--smalls];
+        const size_t l = large[--larges];
+        _columns[s] = { threshold(scaled[s]), picked[s], picked[l] };
+
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0)
+            small[smalls++] = l;
+        else
+            large[larges++] = l;
+    }
+
+    // what's left is 1 give or take the rounding
+    while (larges) {
+        const size_t l = large[--larges];
+        _columns[l] = { kAlways, picked[l], picked[l] };
+    }
+
+    while (smalls) {
+        const size_t s = small[--smalls];
+        _columns[s] = { kAlways, picked[s], picked[s] };
+    }
+
+    _count = static_cast<unsigned int>(n);
+}
+
+double AliasTable::Probability(FuzzMutation mutation) const noexcept {
+    double p = 0;
+    for (size_t i = 0; i < _count; i++) {
+        const Column& column = _columns[i];
+        const double own = column.threshold == kAlways ? 1.0 : static_cast<double>(column.threshold) / 4294967296.0;
+        if (column.mutation == mutation)
+            p += own;
+        if (column.alias == mutation)
+            p += 1.0 - own;
+    }
+
+    return p / _count;
+}
+
+#pragma endregion Alias Table
+
+const MutationSchedule& CurrentSchedule() {
+    if (tPinned)
+        return *tPinned;
+
+    // the version is all a thread looks at until the weights change
+    if (!tSchedule || tSchedule->version != gScheduleVersion.load(std::memory_order_acquire)) {
+        std::lock_guard lock(gScheduleLock);
+        if (!gSchedule)
+            gSchedule = BuildSchedule(gScheduleVersion.load(std::memory_order_relaxed));
+
+        tSchedule = gSchedule;
+    }
+
+    return *tSchedule;
+}
+
+std::shared_ptr<const MutationSchedule> PublishedSchedule() {
+    std::lock_guard lock(gScheduleLock);
+    if (!gSchedule)
+        gSchedule = BuildSchedule(gScheduleVersion.load(std::memory_order_relaxed));
+
+    return gSchedule;
+}
+
+ScopedSchedule::ScopedSchedule(const MutationSchedule& schedule) noexcept
+    : _previous(tPinned) {
+    tPinned = &schedule;
+}
+
+ScopedSchedule::~ScopedSchedule() {
+    tPinned = _previous;
+}
+
+void SetScheduleWeights(const ScheduleWeights& weights) {
+    std::lock_guard lock(gScheduleLock);
+    gWeights = weights;
+    Publish();
+}
+
+void SetScheduleBoosts(const ScheduleWeights& boosts) {
+    std::lock_guard lock(gScheduleLock);
+    gBoosts = boosts;
+    Publish();
+}
+
+bool LoadScheduleWeights(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Unable to open weights file %s\n", path.c_str());
+        return false;
+    }
+
+    ScheduleWeights weights = DefaultScheduleWeights();
+    std::string line{};
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+
+        std::string type{}, mutation{}, weight{};
+        if (!ReadWeightLine(line, type, mutation, weight))
+            continue;
+
+        size_t m = 0;
+        while (m < MUTATION_COUNT && !EqualsNoCase(mutation, FuzzMutationName(static_cast<FuzzMutation>(m))))
+            m++;
+
+        double value = -1;
+        try {
+            value = std::stod(weight);
+        }
+        catch (const std::exception&) {
+        }
+
+        const char t = type.size() == 1 ? static_cast<char>(std::tolower(static_cast<unsigned char>(type.front()))) : '\0';
+        const bool known = t == '*' || std::find(std::begin(SCHEDULE_FUZZ_TYPE_NAMES), std::end(SCHEDULE_FUZZ_TYPE_NAMES), t) != std::end(SCHEDULE_FUZZ_TYPE_NAMES);
+        if (!known || m == MUTATION_COUNT || !(value >= 0) || !std::isfinite(value)) {
+            fprintf(stderr, "%s(%zu): expected <b|t|x|j|h|*> <mutation> <weight>, got: %s\n", path.c_str(), lineNumber, line.c_str());
+            return false;
+        }
+
+        for (size_t i = 0; i < SCHEDULE_FUZZ_TYPES; i++) {
+            if (t == '*' || t == SCHEDULE_FUZZ_TYPE_NAMES[i])
+                weights[i][m] = value;
+        }
+    }
+
+    SetScheduleWeights(weights);
+    return true;
+}
+
+bool StartWeightsWatcher(const std::string& path) {
+    try {
+        std::thread(WatchLoop, path).detach();
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    return true;
+}
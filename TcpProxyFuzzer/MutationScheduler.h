@@ -0,0 +1,128 @@
+#pragma once
+
+// Which mutation Fuzz() applies next
+// Each fuzz_type has a weight per FuzzMutation and an alias table built from them (Vose's method),
+// so a pick is one range draw to choose a column and, unless the weights are all equal, one more to
+// choose between the column's two mutations, however many mutations there are.
+// A mutation with weight 0 is never picked. By default every mutation weighs 1, except those that do
+// nothing for the type, ie; NaughtyWord for binary. For t, x, j and h that's a uniform table, which
+// draws exactly what the uniform pick it replaced did, so older captures still replay.
+//
+// Weights come from a file, -weights in the proxy and FuzzTools replay, eg;
+//     # fuzz_type mutation weight, * is every type, mutations are named as in FuzzMutationName()
+//     *  None        0
+//     *  Grow        2.5
+//     b  RndUnicode  0.5
+// Mutations the file doesn't name keep their defaults. The proxy reloads the file when it changes.
+// With -novelty the tables are built from these weights times a boost per mutation, from how often
+// it's turned up a server response not seen before, see Novelty.h. A weight of 0 stays 0.
+//
+// A new set of weights is built into new tables off to one side and published with a version number.
+// Fuzz() takes the current set once per call, a thread only looks at the version until it changes,
+// so a call always uses one whole set and the hot path has no lock. An old set is freed when the last
+// thread still using one moves on.
+// With -seed a session pins the set that was published when it started, so neither a reload nor a new set
+// of boosts changes its picks, and its captures record its fuzz_type's weights for the replay to pick with.
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <memory>
+
+#include "Fuzz.h"
+#include "rand.h"
+
+constexpr size_t MUTATION_COUNT = static_cast<size_t>(FuzzMutation::Max);
+
+// b, t, x, j, h, an unknown fuzz_type is treated as binary
+constexpr size_t SCHEDULE_FUZZ_TYPES = 5;
+constexpr char SCHEDULE_FUZZ_TYPE_NAMES[SCHEDULE_FUZZ_TYPES] = { 'b', 't', 'x', 'j', 'h' };
+
+// how often the proxy checks the weights file for changes
+constexpr unsigned int WEIGHTS_POLL_MS = 2000;
+
+using MutationWeights = std::array<double, MUTATION_COUNT>;
+using ScheduleWeights = std::array<MutationWeights, SCHEDULE_FUZZ_TYPES>;
+
+size_t ScheduleFuzzType(unsigned int fuzz_type) noexcept;
+
+// the weights every fuzz_type starts with
+ScheduleWeights DefaultScheduleWeights() noexcept;
+
+// Picks a mutation in proportion to its weight in O(1)
+class AliasTable {
+public:
+    AliasTable() = default;
+
+    // negative weights count as 0, if they're all 0 it only picks None
+    void Build(const MutationWeights& weights) noexcept;
+
+    FuzzMutation Pick(RandomNumberGenerator& rng) const noexcept {
+        const Column& column = _columns[rng.range(0, _count).generate()];
+        if (column.threshold == kAlways || rng.range(0, UINT32_MAX).generate() < column.threshold)
+            return column.mutation;
+
+        return column.alias;
+    }
+
+    // the chance it picks mutation, for reports
+    double Probability(FuzzMutation mutation) const noexcept;
+
+private:
+    static constexpr uint32_t kAlways = UINT32_MAX;
+
+    struct Column {
+        uint32_t        threshold{ kAlways };   // out of 2^32, picks mutation under it, alias over it
+        FuzzMutation    mutation{ FuzzMutation::None };
+        FuzzMutation    alias{ FuzzMutation::None };
+    };
+
+    // only the mutations that can be picked get a column, so an equal weighting needs no second draw
+    std::array<Column, MUTATION_COUNT>  _columns{};
+    unsigned int                        _count{ 1 };
+};
+
+// The weights and tables for every fuzz_type, one published set
+struct MutationSchedule {
+    uint64_t                                        version{ 0 };
+    ScheduleWeights                                 weights{};      // the configured weights times the boosts
+    std::array<AliasTable, SCHEDULE_FUZZ_TYPES>     tables{};
+
+    const AliasTable& Table(unsigned int fuzz_type) const noexcept {
+        return tables[ScheduleFuzzType(fuzz_type)];
+    }
+};
+
+// the set this thread is using, it stays valid until the thread calls this again
+const MutationSchedule& CurrentSchedule();
+
+// the set published now, for a seeded session to hold on to
+std::shared_ptr<const MutationSchedule> PublishedSchedule();
+
+// Makes CurrentSchedule() on this thread return another set until the object goes away
+// Seeded sessions swap in the set they started with around each Fuzz() call, the same as their generator
+class ScopedSchedule {
+public:
+    explicit ScopedSchedule(const MutationSchedule& schedule) noexcept;
+    ~ScopedSchedule();
+
+    ScopedSchedule(const ScopedSchedule&) = delete;
+    ScopedSchedule(ScopedSchedule&&) = delete;
+    ScopedSchedule& operator=(const ScopedSchedule&) = delete;
+    ScopedSchedule& operator=(ScopedSchedule&&) = delete;
+
+private:
+    const MutationSchedule* _previous;
+};
+
+// builds tables for the weights, with the current boosts, and publishes them
+void SetScheduleWeights(const ScheduleWeights& weights);
+
+// the same for new boosts over the current weights, they start at 1
+void SetScheduleBoosts(const ScheduleWeights& boosts);
+
+// reads a weights file over the defaults and publishes the result, errors go to stderr
+bool LoadScheduleWeights(const std::string& path);
+
+// reloads the weights file whenever it changes, on a thread of its own
+bool StartWeightsWatcher(const std::string& path);
@@ -0,0 +1,200 @@
+// Response novelty feedback, see Novelty.h
+
+#include <cstdio>
+#include <cmath>
+#include <array>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <bit>
+#include <algorithm>
+
+#include "Novelty.h"
+#include "Proxy.h"
+#include "MutationScheduler.h"
+#include "crc32.h"
+
+namespace {
+
+    const crc32 gResponseCrc{};
+
+    std::array<std::atomic<uint64_t>, NOVELTY_BITS / 64>    gSeen{};
+    std::atomic<uint64_t>                                   gFingerprints{ 0 };
+
+    // credit since the last rebalance, by fuzz type, and in total for the reports
+    std::array<std::array<std::atomic<uint32_t>, MUTATION_COUNT>, SCHEDULE_FUZZ_TYPES> gCredits{};
+    std::array<std::atomic<uint64_t>, MUTATION_COUNT>                                   gCreditTotals{};
+
+    // how much credit a fuzz type needs before its boosts go all the way, so one lucky answer doesn't
+    // swing the schedule on its own
+    constexpr double kCreditPrior = 4.0;
+
+    // boosts closer than this to the ones in use aren't worth a new set of tables
+    constexpr double kBoostChange = 0.05;
+
+    // returns true if the fingerprint hadn't been seen before
+    bool AddFingerprint(uint32_t fingerprint) noexcept {
+        const uint32_t bit = fingerprint & (NOVELTY_BITS - 1);
+        const uint64_t mask = 1ull << (bit & 63);
+        std::atomic<uint64_t>& word = gSeen[bit / 64];
+
+        // almost every answer has been seen, so most of the time this doesn't write to the shared line
+        if (word.load(std::memory_order_relaxed) & mask)
+            return false;
+
+        if (word.fetch_or(mask, std::memory_order_relaxed) & mask)
+            return false;
+
+        gFingerprints.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void RebalanceLoop() {
+        std::array<std::array<double, MUTATION_COUNT>, SCHEDULE_FUZZ_TYPES> scores{};
+        ScheduleWeights published{};
+        for (auto& type : published)
+            type.fill(1.0);
+
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(NOVELTY_REBALANCE_MS));
+
+            ScheduleWeights boosts{};
+            bool changed = false;
+            for (size_t t = 0; t < SCHEDULE_FUZZ_TYPES; t++) {
+                double total = 0;
+                for (size_t m = 0; m < MUTATION_COUNT; m++) {
+                    scores[t][m] = scores[t][m] / 2 + gCredits[t][m].exchange(0, std::memory_order_relaxed);
+                    total += scores[t][m];
+                }
+
+                for (size_t m = 0; m < MUTATION_COUNT; m++) {
+                    boosts[t][m] = 1.0 + (NOVELTY_MAX_BOOST - 1.0) * scores[t][m] / (total + kCreditPrior);
+                    changed = changed || std::fabs(boosts[t][m] - published[t][m]) > kBoostChange;
+                }
+            }
+
+            if (changed) {
+                SetScheduleBoosts(boosts);
+                published = boosts;
+            }
+        }
+    }
+}
+
+uint32_t ResponseFingerprint(ResponseKind kind, gsl::span<const char> data) noexcept {
+    std::array<char, NOVELTY_PREFIX + 2> normalized{};
+    size_t n = 0;
+    normalized[n++] = static_cast<char>(kind);
+    normalized[n++] = static_cast<char>(std::bit_width(data.size()));
+
+    bool inDigits = false;
+    for (const char c : data.first((std::min)(data.size(), NOVELTY_PREFIX))) {
+        const bool digit = c >= '0' && c <= '9';
+        if (!(digit && inDigits))
+            normalized[n++] = digit ? '0' : c;
+
+        inDigits = digit;
+    }
+
+    return gResponseCrc.calc(gsl::span<const char>(normalized.data(), n));
+}
+
+#pragma region Response Tracker
+
+ResponseTracker::ResponseTracker(uint64_t conn_id, unsigned int fuzz_type) noexcept
+    : _connId(conn_id), _fuzzType(ScheduleFuzzType(fuzz_type)) {
+}
+
+bool ResponseTracker::TimedOut(StatClock::time_point now) const noexcept {
+    return now - _sent >= std::chrono::milliseconds(NOVELTY_TIMEOUT_MS);
+}
+
+void ResponseTracker::OnRequest(FuzzMutationSet mutations) {
+    const auto now = StatClock::now();
+    std::lock_guard lock(_lock);
+
+    // the server never answered the last lot, settle that before this one starts waiting
+    if (_awaiting.load(std::memory_order_relaxed) && TimedOut(now))
+        Settle(ResponseKind::Timeout, {});
+
+    if (!_awaiting.load(std::memory_order_relaxed)) {
+        _sent = now;
+        _awaiting.store(true, std::memory_order_relaxed);
+    }
+
+    _waiting |= mutations;
+}
+
+void ResponseTracker::OnResponse(gsl::span<const char> data) {
+    if (!_awaiting.load(std::memory_order_relaxed))
+        return;
+
+    const auto now = StatClock::now();
+    std::lock_guard lock(_lock);
+    if (_awaiting.load(std::memory_order_relaxed))
+        Settle(TimedOut(now) ? ResponseKind::Timeout : ResponseKind::Data, data);
+}
+
+void ResponseTracker::OnEnd(ResponseKind kind) {
+    const auto now = StatClock::now();
+    std::lock_guard lock(_lock);
+
+    // with nothing waiting there's no one to credit, but the fingerprint still goes in the bitmap,
+    // so it isn't new the next time a mutation leads to it
+    if (_awaiting.load(std::memory_order_relaxed) && TimedOut(now))
+        kind = ResponseKind::Timeout;
+
+    Settle(kind, {});
+}
+
+// call with _lock held
+void ResponseTracker::Settle(ResponseKind kind, gsl::span<const char> data) {
+    const FuzzMutationSet waiting = _waiting;
+    _waiting = 0;
+    _awaiting.store(false, std::memory_order_relaxed);
+
+    CountStat(StatCounter::Responses);
+    const uint32_t fingerprint = ResponseFingerprint(kind, data);
+    if (!AddFingerprint(fingerprint))
+        return;
+
+    CountStat(StatCounter::NovelResponses);
+
+    std::string credited{};
+    for (size_t m = 0; m < MUTATION_COUNT; m++) {
+        if ((waiting & (1u << m)) == 0)
+            continue;
+
+        gCredits[_fuzzType][m].fetch_add(1, std::memory_order_relaxed);
+        gCreditTotals[m].fetch_add(1, std::memory_order_relaxed);
+
+        credited += credited.empty() ? " after " : ", ";
+        credited += FuzzMutationName(static_cast<FuzzMutation>(m));
+    }
+
+    if (!gOptions.quiet && !credited.empty())
+        fprintf(stderr, "Conn:%llu new response 0x%08X%s\n",
+            static_cast<unsigned long long>(_connId), fingerprint, credited.c_str());
+}
+
+#pragma endregion Response Tracker
+
+uint64_t NoveltyFingerprints() noexcept {
+    return gFingerprints.load(std::memory_order_relaxed);
+}
+
+uint64_t NoveltyCredits(FuzzMutation mutation) noexcept {
+    const auto m = static_cast<size_t>(mutation);
+    return m < MUTATION_COUNT ? gCreditTotals[m].load(std::memory_order_relaxed) : 0;
+}
+
+bool StartNoveltyFeedback() {
+    try {
+        std::thread(RebalanceLoop).detach();
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    return true;
+}
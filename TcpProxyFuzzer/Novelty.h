@@ -0,0 +1,94 @@
+#pragma once
+
+// Response novelty, -novelty
+// Feedback for the mutation scheduler that needs nothing from the target: a mutation that gets an answer
+// out of the server it hasn't given before has found a path the usual traffic doesn't take, so it's worth
+// picking more often.
+//
+// A session whose client->server direction is fuzzed has a ResponseTracker, shared by both directions.
+// Each chunk sent to the server adds the mutations Fuzz() applied to it to what's waiting for an answer,
+// and the first read back from the server settles them. That read is fingerprinted: a CRC32 of its first
+// NOVELTY_PREFIX bytes, with each run of digits cut to one, so dates, lengths and ids don't make every
+// response new, and its size to the nearest power of 2. The server closing or resetting the connection,
+// or not answering within NOVELTY_TIMEOUT_MS, settle them too, each as a fingerprint of its own.
+//
+// Fingerprints go in a bitmap of NOVELTY_BITS bits shared by every session. One that sets a new bit credits
+// every mutation that was waiting, requests pipelined ahead of the answer share it. Only the first read of
+// an answer is looked at, the rest of it is forwarded untouched.
+//
+// Every NOVELTY_REBALANCE_MS the credits become boosts for the scheduler, see MutationScheduler.h. A mutation's
+// boost is 1 plus up to NOVELTY_MAX_BOOST - 1 by its share of its fuzz type's recent credit, and credit halves
+// each time, so the schedule follows what's finding new answers now. As the bitmap fills, new answers get rarer
+// and the boosts drift back to 1.
+// A seeded session keeps the boosts it started with, see MutationScheduler.h, so its replay still matches.
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+#include "Fuzz.h"
+#include "Stats.h"
+#include "gsl/span"
+
+// 8KB, shared by every session
+constexpr size_t NOVELTY_BITS = 64 * 1024;
+
+// how much of the first read of an answer is fingerprinted
+constexpr size_t NOVELTY_PREFIX = 64;
+
+// a server that takes longer than this to answer has timed out, whatever it does after
+constexpr unsigned int NOVELTY_TIMEOUT_MS = 2000;
+
+// how often the credits are turned into boosts
+constexpr unsigned int NOVELTY_REBALANCE_MS = 5000;
+
+constexpr double NOVELTY_MAX_BOOST = 8.0;
+
+// how an answer to the client's chunks ended up
+enum class ResponseKind : uint8_t {
+    Data = 0,       // the server sent something back
+    Close = 1,      // the server closed the connection
+    Reset = 2,      // the server reset the connection
+    Timeout = 3     // nothing came back within NOVELTY_TIMEOUT_MS
+};
+
+// the fingerprint of an answer, data is its first read, or empty for the others
+uint32_t ResponseFingerprint(ResponseKind kind, gsl::span<const char> data) noexcept;
+
+// One session's requests and the server's answers to them
+class ResponseTracker {
+public:
+    ResponseTracker(uint64_t conn_id, unsigned int fuzz_type) noexcept;
+
+    // a chunk went to the server, mutations are what Fuzz() applied to it, none if it wasn't fuzzed
+    void OnRequest(FuzzMutationSet mutations);
+
+    // a read from the server, only the first after a request is looked at
+    void OnResponse(gsl::span<const char> data);
+
+    // the server closed or reset the connection
+    void OnEnd(ResponseKind kind);
+
+    ResponseTracker(const ResponseTracker&) = delete;
+    ResponseTracker(ResponseTracker&&) = delete;
+    ResponseTracker& operator=(const ResponseTracker&) = delete;
+    ResponseTracker& operator=(ResponseTracker&&) = delete;
+
+private:
+    bool TimedOut(StatClock::time_point now) const noexcept;
+    void Settle(ResponseKind kind, gsl::span<const char> data);
+
+    std::mutex              _lock{};
+    std::atomic<bool>       _awaiting{ false };     // checked without the lock, so a read with nothing to settle is cheap
+    FuzzMutationSet         _waiting{ 0 };          // guarded by _lock, like the rest
+    StatClock::time_point   _sent{};                // when the first chunk still waiting went
+    uint64_t                _connId;
+    size_t                  _fuzzType;              // the schedule's index for it
+};
+
+// how many distinct fingerprints have been seen, and how often a mutation has been credited, for reports
+uint64_t NoveltyFingerprints() noexcept;
+uint64_t NoveltyCredits(FuzzMutation mutation) noexcept;
+
+// turns credits into boosts for the scheduler, on a thread of its own
+bool StartNoveltyFeedback();
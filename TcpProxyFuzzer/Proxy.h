@@ -0,0 +1,149 @@
+#pragma once
+
+// Shared definitions for the forwarding engines
+
+#include <winsock2.h>
+#include <cstdio>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "rand.h"
+#include "Logger.h"
+#include "Fuzz.h"
+#include "Framer.h"
+#include "gsl/span"
+
+// the defaults for -buffer, -max_buffer and -buffer_budget, see BufferPool.h
+constexpr size_t BUFFER_SIZE = 4096;
+constexpr size_t MAX_BUFFER_SIZE = 64 * 1024;
+constexpr size_t BUFFER_BUDGET = 64 * 1024 * 1024;
+
+// the default for -send_queue, see SendQueue.h
+constexpr size_t SEND_QUEUE_SIZE = 256 * 1024;
+
+// Which engine moves data between the client and the target
+enum class ForwardEngine {
+    Thread = 0,     // two blocking threads per connection (the original engine)
+    Poll = 1,       // a small, fixed set of WSAPoll() event loops
+    Rio = 2         // Registered I/O loops, batched requests and completions
+};
+
+// see Novelty.h
+class ResponseTracker;
+
+// see MutationScheduler.h
+struct MutationSchedule;
+
+// Passes important info to the socket threads
+// because thread APIs only support void* for args
+enum class SocketDir {
+    ClientToServer = 0,
+    ServerToClient = 1
+};
+
+typedef struct {
+    SOCKET          src_sock;
+    SOCKET          dst_sock;
+    SocketDir       sock_dir;    // This is the ACTUAL direction of the socket, ClientToServer or ServerToClient
+    char            fuzz_dir;    // This is the requested fuzzing direction; c=server to client, s=client to server, b=both directions, n=no fuzzing
+    char 		    fuzz_type;   // Fuzzing type; b=binary, t=text, x=xml, j=json, h=html
+    unsigned int    fuzz_aggr;   // Fuzzing aggressiveness as a %
+    unsigned int    offset;	     // Offset in data stream where fuzzing starts, useful to skip headers
+    uint64_t        conn_id;     // Connection number, both directions of a connection share it
+    uint64_t        seed;        // Seed for this direction's fuzzer, only used with -seed
+    RandomNumberGenerator rng{ 0 };  // This direction's fuzzer, reseeded by BeginForwarding() with -seed
+    FILE*           capture;     // Capture file for this direction, only used with -seed
+    std::shared_ptr<const MutationSchedule> schedule;   // The mutation weights this direction started with, only used with -seed
+    uint32_t        crc_in;      // Running CRC32 of the bytes read and sent in this direction, only used with -crc
+    uint32_t        crc_out;
+    std::shared_ptr<ResponseTracker> novelty;   // Shared by both directions, only used with -novelty when client->server is fuzzed
+} ConnectionData;
+
+// Optional settings, these come from the -name:value args after the required args
+struct ProxyOptions {
+    ForwardEngine   engine{ ForwardEngine::Thread };
+    unsigned int    workers{ 0 };    // number of event loops, 0 means one per CPU core
+    unsigned int    connect_timeout_ms{ 5000 };
+    unsigned int    max_connects{ 256 };    // upstream connects in flight
+    unsigned int    shards{ 1 };            // accept threads, each with its own connector and loop
+    bool            pin{ false };           // pin loop and shard threads to CPU cores
+    bool            seeded{ false };        // per-direction seeds derived from seed, with capture files
+    uint64_t        seed{ 0 };
+    bool            crc{ false };           // running CRC32 of each fuzzed direction's input and output
+#ifdef _DEBUG
+    bool            log{ true };            // debug builds log unless told not to
+#else
+    bool            log{ false };
+#endif
+    LogSettings     log_settings{};
+    std::string     events{};               // binary event log file, see EventLog.h
+    std::string     corpus{};               // compiled naughty string corpus, see Corpus.h, empty loads the text files
+    std::string     weights{};              // mutation weights file, see MutationScheduler.h, empty is the defaults
+    bool            quiet{ false };         // no per-connection or per-mutation console output
+    unsigned int    stats_secs{ 0 };        // stats reporter interval, 0 is off
+    unsigned short  metrics_port{ 0 };      // loopback Prometheus endpoint, 0 is off
+    size_t          buffer_size{ BUFFER_SIZE };     // what every direction starts reading into, and the least it shrinks to
+    size_t          max_buffer{ MAX_BUFFER_SIZE };  // the most a direction's buffer grows to, the same as buffer_size turns growing off
+    size_t          buffer_budget{ BUFFER_BUDGET }; // what all the grown buffers can hold above buffer_size together
+    size_t          send_queue{ SEND_QUEUE_SIZE };  // bytes a direction can have waiting to send before it stops reading
+    bool            send_queue_set{ false };        // -send_queue was given, the thread engine only sizes SO_SNDBUF then
+    FrameSettings   frame{};                // fuzz fuzzed directions a message at a time, see Framer.h
+    bool            novelty{ false };       // credit mutations with new server answers, see Novelty.h
+};
+
+extern ProxyOptions gOptions;
+
+// where seeded sessions write their capture files
+constexpr auto CAPTURE_DIR = "fuzzcaptures";
+
+// Per-direction helpers, these are shared by all the engines so fuzzing behaves the same
+// ProcessChunk() is only needed for directions being fuzzed, the others are passed through as-is
+// With -seed these also own the direction's generator and capture file, so connData can't be const
+bool ShouldFuzz(_In_ const ConnectionData* connData) noexcept;
+void BeginForwarding(_Inout_ ConnectionData* connData, bool bFuzz);
+// Fuzz() leaves anything it inserts in insert, so the chunk is sent as FuzzOutput(buffer, insert)
+// bWhole is false for a piece a framer passes through, it's counted in the CRCs and logs but not fuzzed
+void ProcessChunk(_Inout_ ConnectionData* connData, bool bFuzz, std::vector<char>& buffer, FuzzInsert& insert, bool bWhole = true);
+void EndForwarding(_Inout_ ConnectionData* connData, bool bFuzz, uint64_t bytes);
+
+// -novelty, the engines pass on what the server sends and how it goes away, both do nothing for a client's
+// direction or without a tracker, ProcessChunk() does the reads of fuzzed directions itself
+// error is 0 when the server closed the connection, or what WSAGetLastError() gave
+void NoteServerRead(_In_ const ConnectionData* connData, gsl::span<const char> data);
+void NoteServerEnd(_In_ const ConnectionData* connData, int error);
+
+// points bufs at what's left of a chunk from offset from onward, for WSASend(), returns how many it used
+ULONG GatherOutput(const FuzzOutput& output, size_t from, std::array<WSABUF, 3>& bufs) noexcept;
+
+// creates a TCP socket suitable for the given engine
+SOCKET CreateTcpSocket(ForwardEngine engine) noexcept;
+
+// hands a connected client/target pair to the selected engine
+// shard is the listener shard that accepted the client, sessions stay on that shard's loop
+void StartSession(SOCKET client_sock, SOCKET target_sock, size_t shard);
+
+// pins a thread to a CPU core when -pin is on, index wraps around the number of cores
+void PinThread(HANDLE thread, size_t index) noexcept;
+
+// picks which engine loop gets a new session, next is a round-robin counter
+// loop i belongs to shard (i % shards), so with one shard this is plain round-robin
+size_t PickLoop(size_t shard, size_t loops, size_t next) noexcept;
+
+// Upstream connects, see Connector.cpp
+bool StartConnectors(_In_ const SOCKADDR_IN& target, unsigned int timeout_ms, unsigned int max_inflight, size_t count);
+bool ConnectUpstream(SOCKET client_sock, size_t shard);
+
+// Poll engine, see EventLoop.cpp
+bool StartEventLoops(unsigned int count);
+void AddToEventLoop(_In_ const ConnectionData& client_to_target, _In_ const ConnectionData& target_to_client, size_t shard);
+
+// Prometheus endpoint on 127.0.0.1, see Metrics.cpp
+bool StartMetricsServer(unsigned short port);
+
+// RIO engine, see RioEngine.cpp
+// StartRioLoops() fails if registered I/O is not available on this version of Windows
+bool StartRioLoops(unsigned int count);
+void AddToRioLoop(_In_ const ConnectionData& client_to_target, _In_ const ConnectionData& target_to_client, size_t shard);
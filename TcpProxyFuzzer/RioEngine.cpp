@@ -0,0 +1,612 @@
+// Registered I/O (RIO) forwarding engine
+// RIO is the Windows counterpart to io_uring: data buffers are registered with the kernel once,
+// requests are queued without a kernel transition each, and completions are reaped in batches
+// from a completion queue. Each worker loop owns a completion queue, a pool of registered
+// buffer slices and its sessions, so like the poll engine there's no locking on the data path.
+// Requires Windows 8 / Server 2012 or later, the caller falls back to the poll engine otherwise.
+
+#define  _WINSOCK_DEPRECATED_NO_WARNINGS 1
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mswsock.h>
+#include <process.h>
+#include <windows.h>
+#include <stdio.h>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+
+#include "Proxy.h"
+#include "Stats.h"
+#include "BufferPool.h"
+#include "SendQueue.h"
+#include "gsl/util"
+
+namespace {
+
+    RIO_EXTENSION_FUNCTION_TABLE gRio{};
+
+    constexpr size_t kChunkSize       = 1024 * 1024;    // slices are registered in 1MB chunks, or one slice if it's bigger
+    constexpr DWORD  kInitialCqSize   = 1024;
+    constexpr ULONG  kMaxResults      = 256;     // completions reaped per dequeue
+
+    // a session has a request queue per socket, each with room for one receive and one send, and the CQ has
+    // to have room for every one of them, whether or not it's in flight
+    constexpr ULONG  kRqReceives      = 1;
+    constexpr ULONG  kRqSends         = 1;
+    constexpr size_t kRqsPerSession   = 2;
+
+    // slices are registered up front, so unlike the other engines they stay at -buffer rather than adapting
+    ULONG SliceSize() noexcept {
+        return gsl::narrow_cast<ULONG>(gOptions.buffer_size);
+    }
+
+    enum class RioOp : uint32_t { Recv, Send };
+
+    struct RioSession;
+    struct RioDirection;
+
+    // passed as the RIO request context, maps a completion back to its direction
+    struct RioRequest {
+        RioDirection*   dir{ nullptr };
+        RioOp           op{ RioOp::Recv };
+    };
+
+    // One half of a proxied connection
+    // a direction only ever has one request in flight, a recv() or a send(), so it needs just
+    // one registered slice; data is received into it, fuzzed, copied back and sent from it
+    // directions that are not fuzzed send straight from the slice, so the data is never copied
+    struct RioDirection {
+        ConnectionData      conn{};
+        bool                bFuzz{ false };
+        RioSession*         session{ nullptr };
+        RIO_RQ              src_rq{ RIO_INVALID_RQ };
+        RIO_RQ              dst_rq{ RIO_INVALID_RQ };
+        RIO_BUF             slice{};
+        RIO_BUF             send_buf{};     // the part of the slice being sent
+        char*               slice_data{ nullptr };
+        std::vector<char>   buffer{};       // fuzzed chunk waiting to go to conn.dst_sock
+        FuzzInsert          insert{};       // what Fuzz() added to it, spliced in as it's copied to the slice
+        size_t              len{ 0 };       // size of the chunk being sent
+        size_t              sent{ 0 };
+        uint64_t            bytes{ 0 };     // total forwarded
+        StatClock::time_point received{};   // when the chunk being sent arrived, for the latency histogram
+        StatClock::time_point sendPosted{}; // when the last send went in, a slow one counts as throttled
+        RioRequest          recvReq{};
+        RioRequest          sendReq{};
+    };
+
+    struct RioSession {
+        SOCKET                      client_sock{ INVALID_SOCKET };
+        SOCKET                      target_sock{ INVALID_SOCKET };
+        std::array<RioDirection,2>  dir{};      // indexed by SocketDir
+        unsigned int                outstanding{ 0 };   // requests posted but not yet completed
+        bool                        closing{ false };
+    };
+
+    // Fixed-size slices carved from large registered buffers
+    // registering is expensive, so it's done once per chunk, not per connection
+    class SlicePool {
+    public:
+        SlicePool() = default;
+        ~SlicePool();
+
+        bool Acquire(RIO_BUF& slice, char*& data);
+        void Release(const RIO_BUF& slice, char* data);
+
+        SlicePool(const SlicePool&) = delete;
+        SlicePool(SlicePool&&) = delete;
+        SlicePool& operator=(const SlicePool&) = delete;
+        SlicePool& operator=(SlicePool&&) = delete;
+
+    private:
+        struct Chunk {
+            char*           base{ nullptr };
+            RIO_BUFFERID    id{ RIO_INVALID_BUFFERID };
+        };
+
+        struct FreeSlice {
+            RIO_BUF         slice{};
+            char*           data{ nullptr };
+        };
+
+        bool Grow();
+
+        std::vector<Chunk>      _chunks{};
+        std::vector<FreeSlice>  _free{};
+    };
+
+    class RioLoop {
+    public:
+        RioLoop() = default;
+        ~RioLoop();
+
+        bool Init();
+        void Add(std::unique_ptr<RioSession> session);
+        void Run();
+
+        // makes Run() return, for a loop with no sessions yet
+        void Stop();
+
+        RioLoop(const RioLoop&) = delete;
+        RioLoop(RioLoop&&) = delete;
+        RioLoop& operator=(const RioLoop&) = delete;
+        RioLoop& operator=(RioLoop&&) = delete;
+
+    private:
+        void AdoptPending();
+        bool Adopt(RioSession& s);
+        void OnCompletion(const RIORESULT& result);
+        bool PostRecv(RioDirection& d);
+        bool PostSend(RioDirection& d);
+        void MarkClose(RioSession& s);
+        void Commit();
+        void CloseMarked();
+        void Release(RioSession& s);
+
+        HANDLE                  _event{ NULL };
+        RIO_CQ                  _cq{ RIO_INVALID_CQ };
+        DWORD                   _cqSize{ 0 };
+        SlicePool               _slices{};
+        BufferPool              _buffers{};     // for fuzzed directions, the chunk is copied out of the slice to be fuzzed
+
+        std::mutex                                  _pendingLock{};
+        std::vector<std::unique_ptr<RioSession>>    _pending{};
+        std::atomic<bool>                           _stopping{ false };
+
+        std::unordered_map<RioSession*, std::unique_ptr<RioSession>>   _sessions{};
+        std::vector<RioSession*>    _toClose{};     // marked for closing, sockets still open
+        std::vector<RioSession*>    _draining{};    // sockets closed, waiting on aborted requests
+
+        // request queues with deferred requests, committed once per batch of completions
+        std::vector<RIO_RQ>         _deferredRecv{};
+        std::vector<RIO_RQ>         _deferredSend{};
+    };
+
+    std::vector<std::unique_ptr<RioLoop>>   gRioLoops{};
+    std::atomic<size_t>                     gNextRioLoop{ 0 };
+
+    unsigned __stdcall rio_thread(_In_ void* data) {
+        RioLoop* loop = static_cast<RioLoop*>(data);
+        loop->Run();
+
+        return 0;
+    }
+
+    // when the engine only partly starts, the loops that did are stopped and their threads waited for,
+    // so nothing of it is left running behind the poll engine it falls back to
+    void StopRioLoops(const std::vector<HANDLE>& threads) {
+        for (auto& loop : gRioLoops)
+            loop->Stop();
+
+        for (const HANDLE thread : threads) {
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+        }
+
+        gRioLoops.clear();
+    }
+}
+
+#pragma region Registered Buffers
+
+SlicePool::~SlicePool() {
+    for (const auto& c : _chunks) {
+        gRio.RIODeregisterBuffer(c.id);
+        VirtualFree(c.base, 0, MEM_RELEASE);
+    }
+}
+
+bool SlicePool::Grow() {
+    const ULONG sliceSize = SliceSize();
+    const size_t slicesPerChunk = (std::max)(kChunkSize / sliceSize, static_cast<size_t>(1));
+    const DWORD chunkSize = gsl::narrow_cast<DWORD>(sliceSize * slicesPerChunk);
+
+    Chunk c{};
+    c.base = static_cast<char*>(VirtualAlloc(NULL, chunkSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    if (c.base == nullptr)
+        return false;
+
+    c.id = gRio.RIORegisterBuffer(c.base, chunkSize);
+    if (c.id == RIO_INVALID_BUFFERID) {
+        VirtualFree(c.base, 0, MEM_RELEASE);
+        return false;
+    }
+
+    _chunks.push_back(c);
+    for (size_t i = 0; i < slicesPerChunk; i++) {
+        const ULONG offset = gsl::narrow_cast<ULONG>(i * sliceSize);
+        _free.push_back({ { c.id, offset, sliceSize }, c.base + offset });
+    }
+
+    return true;
+}
+
+bool SlicePool::Acquire(RIO_BUF& slice, char*& data) {
+    if (_free.empty() && !Grow())
+        return false;
+
+    slice = _free.back().slice;
+    data = _free.back().data;
+    _free.pop_back();
+
+    return true;
+}
+
+void SlicePool::Release(const RIO_BUF& slice, char* data) {
+    _free.push_back({ { slice.BufferId, slice.Offset, SliceSize() }, data });
+}
+
+#pragma endregion Registered Buffers
+
+#pragma region RIO Loop
+
+RioLoop::~RioLoop() {
+    if (_cq != RIO_INVALID_CQ)
+        gRio.RIOCloseCompletionQueue(_cq);
+
+    if (_event != NULL)
+        CloseHandle(_event);
+}
+
+bool RioLoop::Init() {
+    // auto-reset event, signalled by RIO when completions arrive, and by Add()
+    _event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (_event == NULL)
+        return false;
+
+    RIO_NOTIFICATION_COMPLETION notify{};
+    notify.Type = RIO_EVENT_COMPLETION;
+    notify.Event.EventHandle = _event;
+    notify.Event.NotifyReset = FALSE;
+
+    _cqSize = kInitialCqSize;
+    _cq = gRio.RIOCreateCompletionQueue(_cqSize, &notify);
+
+    return _cq != RIO_INVALID_CQ;
+}
+
+// called from the accept thread
+void RioLoop::Add(std::unique_ptr<RioSession> session) {
+    {
+        std::lock_guard lock(_pendingLock);
+        _pending.push_back(std::move(session));
+    }
+
+    SetEvent(_event);
+}
+
+void RioLoop::Stop() {
+    _stopping.store(true);
+    SetEvent(_event);
+}
+
+void RioLoop::AdoptPending() {
+    std::vector<std::unique_ptr<RioSession>> incoming{};
+    {
+        std::lock_guard lock(_pendingLock);
+        incoming.swap(_pending);
+    }
+
+    for (auto& s : incoming) {
+        RioSession* raw = s.get();
+        _sessions.emplace(raw, std::move(s));
+
+        for (auto& d : raw->dir)
+            BeginForwarding(&d.conn, d.bFuzz);
+
+        if (!Adopt(*raw))
+            MarkClose(*raw);
+    }
+}
+
+// sets up the request queues and slices, then starts reading from both sides
+bool RioLoop::Adopt(RioSession& s) {
+    // RIOCreateRequestQueue() reserves its receives and sends in the CQ up front, so it has to hold them all
+    const size_t needed = _sessions.size() * kRqsPerSession * (kRqReceives + kRqSends);
+    if (needed > _cqSize) {
+        const DWORD newSize = gsl::narrow_cast<DWORD>(needed * 2);
+        if (!gRio.RIOResizeCompletionQueue(_cq, newSize))
+            return false;
+
+        _cqSize = newSize;
+    }
+
+    // one RQ per socket; each socket is the source of one direction and the destination of the other
+    const RIO_RQ client_rq = gRio.RIOCreateRequestQueue(s.client_sock, kRqReceives, 1, kRqSends, 1, _cq, _cq, &s);
+    const RIO_RQ target_rq = gRio.RIOCreateRequestQueue(s.target_sock, kRqReceives, 1, kRqSends, 1, _cq, _cq, &s);
+    if (client_rq == RIO_INVALID_RQ || target_rq == RIO_INVALID_RQ) {
+        fprintf(stderr, "RIO request queue creation failed. Error: %d\n", WSAGetLastError());
+        return false;
+    }
+
+    for (auto& d : s.dir) {
+        const bool fromClient = d.conn.sock_dir == SocketDir::ClientToServer;
+        d.session = &s;
+        d.src_rq = fromClient ? client_rq : target_rq;
+        d.dst_rq = fromClient ? target_rq : client_rq;
+        d.recvReq = { &d, RioOp::Recv };
+        d.sendReq = { &d, RioOp::Send };
+
+        if (!_slices.Acquire(d.slice, d.slice_data)) {
+            fprintf(stderr, "RIO buffer registration failed. Error: %d\n", WSAGetLastError());
+            return false;
+        }
+
+        if (d.bFuzz)
+            d.buffer = _buffers.Acquire(SliceSize());
+    }
+
+    for (auto& d : s.dir) {
+        if (!PostRecv(d))
+            return false;
+    }
+
+    return true;
+}
+
+bool RioLoop::PostRecv(RioDirection& d) {
+    d.slice.Length = SliceSize();
+    if (!gRio.RIOReceive(d.src_rq, &d.slice, 1, RIO_MSG_DEFER, &d.recvReq))
+        return false;
+
+    d.session->outstanding++;
+    _deferredRecv.push_back(d.src_rq);
+
+    return true;
+}
+
+// sends the rest of the chunk, a fuzzed chunk can be bigger than the slice
+// so it's copied in, with any insert spliced in on the way, and sent a slice-sized piece at a time
+bool RioLoop::PostSend(RioDirection& d) {
+    d.send_buf.BufferId = d.slice.BufferId;
+
+    if (d.bFuzz) {
+        const FuzzOutput output(d.buffer, d.insert);
+        const size_t len = output.CopyTo(d.sent, gsl::span<char>(d.slice_data, SliceSize()));
+        d.send_buf.Offset = d.slice.Offset;
+        d.send_buf.Length = gsl::narrow_cast<ULONG>(len);
+    } else {
+        d.send_buf.Offset = d.slice.Offset + gsl::narrow_cast<ULONG>(d.sent);
+        d.send_buf.Length = gsl::narrow_cast<ULONG>(d.len - d.sent);
+    }
+
+    if (!gRio.RIOSend(d.dst_rq, &d.send_buf, 1, RIO_MSG_DEFER, &d.sendReq))
+        return false;
+
+    d.sendPosted = StatClock::now();
+
+    d.session->outstanding++;
+    _deferredSend.push_back(d.dst_rq);
+
+    return true;
+}
+
+void RioLoop::OnCompletion(const RIORESULT& result) {
+    const RioRequest* req = reinterpret_cast<const RioRequest*>(result.RequestContext);
+    RioDirection& d = *req->dir;
+    RioSession& s = *d.session;
+
+    s.outstanding--;
+
+    // once closing, completions are just drained, they're mostly aborted requests
+    if (s.closing)
+        return;
+
+    if (result.Status != 0 || (req->op == RioOp::Recv && result.BytesTransferred == 0)) {
+        if (req->op == RioOp::Recv)
+            NoteServerEnd(&d.conn, result.Status);
+
+        MarkClose(s);
+        return;
+    }
+
+    const size_t dir = static_cast<size_t>(d.conn.sock_dir);
+    bool ok = true;
+    if (req->op == RioOp::Recv) {
+        d.sent = 0;
+        d.len = result.BytesTransferred;
+        d.received = StatClock::now();
+        CountStat(BytesInCounter(dir), result.BytesTransferred);
+
+        // Fuzz() works on a vector because it can truncate the data
+        if (d.bFuzz) {
+            d.buffer.assign(d.slice_data, d.slice_data + result.BytesTransferred);
+            ProcessChunk(&d.conn, d.bFuzz, d.buffer, d.insert);
+            d.len = d.buffer.size() + d.insert.length;
+        } else {
+            NoteServerRead(&d.conn, gsl::span<const char>(d.slice_data, result.BytesTransferred));
+        }
+
+        // the chunk in flight is the direction's whole send queue
+        CountStat(StatCounter::SendQueued, d.len);
+        ok = d.len == 0 ? PostRecv(d) : PostSend(d);
+    } else {
+        d.sent += result.BytesTransferred;
+        d.bytes += result.BytesTransferred;
+        CountStat(BytesOutCounter(dir), result.BytesTransferred);
+        CountSendWait(d.sendPosted);
+
+        if (d.sent >= d.len) {
+            RecordLatencySince(ChunkLatencyHistogram(dir, StatFuzzMode(d.bFuzz, d.conn.fuzz_type)), d.received);
+            CountStat(StatCounter::SendDequeued, d.len);
+        }
+
+        // all sent, only now read more from the source, this keeps ordering and applies backpressure
+        ok = d.sent < d.len ? PostSend(d) : PostRecv(d);
+    }
+
+    if (!ok)
+        MarkClose(s);
+}
+
+void RioLoop::MarkClose(RioSession& s) {
+    if (!s.closing) {
+        s.closing = true;
+        _toClose.push_back(&s);
+    }
+}
+
+// submits all the requests deferred while handling a batch, one call per request queue
+void RioLoop::Commit() {
+    for (const RIO_RQ rq : _deferredRecv)
+        gRio.RIOReceive(rq, nullptr, 0, RIO_MSG_COMMIT_ONLY, nullptr);
+
+    for (const RIO_RQ rq : _deferredSend)
+        gRio.RIOSend(rq, nullptr, 0, RIO_MSG_COMMIT_ONLY, nullptr);
+
+    _deferredRecv.clear();
+    _deferredSend.clear();
+}
+
+// closing the sockets aborts any requests in flight, the session is freed
+// once all their completions have been reaped
+void RioLoop::CloseMarked() {
+    for (RioSession* s : _toClose) {
+        closesocket(s->client_sock);
+        closesocket(s->target_sock);
+        _draining.push_back(s);
+    }
+
+    _toClose.clear();
+
+    size_t keep = 0;
+    for (size_t i = 0; i < _draining.size(); i++) {
+        RioSession* s = _draining.at(i);
+        if (s->outstanding == 0) {
+            Release(*s);
+            _sessions.erase(s);
+        } else {
+            _draining.at(keep++) = s;
+        }
+    }
+
+    _draining.resize(keep);
+}
+
+void RioLoop::Release(RioSession& s) {
+    for (auto& d : s.dir) {
+        if (d.slice_data != nullptr)
+            _slices.Release(d.slice, d.slice_data);
+
+        if (d.bFuzz)
+            _buffers.Release(std::move(d.buffer));
+
+        // a chunk that didn't all go is off the queue now too
+        if (d.sent < d.len)
+            CountStat(StatCounter::SendDequeued, d.len);
+
+        EndForwarding(&d.conn, d.bFuzz, d.bytes);
+    }
+}
+
+void RioLoop::Run() {
+    std::array<RIORESULT, kMaxResults> results{};
+
+    while (!_stopping.load(std::memory_order_relaxed)) {
+        AdoptPending();
+
+        const ULONG count = gRio.RIODequeueCompletion(_cq, results.data(), kMaxResults);
+        if (count == RIO_CORRUPT_CQ) {
+            fprintf(stderr, "RIO completion queue is corrupt, loop is exiting\n");
+            return;
+        }
+
+        for (ULONG i = 0; i < count; i++)
+            OnCompletion(gsl::at(results, i));
+
+        Commit();
+        CloseMarked();
+
+        // nothing left to reap, ask for a notification and sleep until it or a new session arrives
+        if (count == 0) {
+            gRio.RIONotify(_cq);
+            WaitForSingleObject(_event, INFINITE);
+        }
+    }
+}
+
+#pragma endregion RIO Loop
+
+#pragma region Engine API
+
+// the RIO function table is loaded from a socket, which must be created for registered I/O
+bool LoadRio() {
+    const SOCKET s = CreateTcpSocket(ForwardEngine::Rio);
+    if (s == INVALID_SOCKET)
+        return false;
+
+    GUID functionTableId = WSAID_MULTIPLE_RIO;
+    DWORD bytes = 0;
+    const int err = WSAIoctl(s, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER,
+        &functionTableId, sizeof(functionTableId),
+        &gRio, sizeof(gRio),
+        &bytes, NULL, NULL);
+
+    closesocket(s);
+
+    return err != SOCKET_ERROR;
+}
+
+bool StartRioLoops(unsigned int count) {
+    if (!LoadRio())
+        return false;
+
+    if (count == 0)
+        count = 1;
+
+    for (unsigned int i = 0; i < count; i++) {
+        auto loop = std::make_unique<RioLoop>();
+        if (!loop->Init()) {
+            fprintf(stderr, "RIO loop creation failed. Error: %d\n", WSAGetLastError());
+            StopRioLoops({});
+            return false;
+        }
+
+        gRioLoops.push_back(std::move(loop));
+    }
+
+    // the handles are kept until every loop is running, so a failure part way can wait for the rest
+    std::vector<HANDLE> threads{};
+    for (size_t i = 0; i < gRioLoops.size(); i++) {
+        const auto thread = _beginthreadex(NULL, 0, rio_thread, gRioLoops.at(i).get(), 0, NULL);
+        if (thread == 0) {
+            fprintf(stderr, "RIO loop thread creation failed. Error: %d\n", errno);
+            StopRioLoops(threads);
+            return false;
+        }
+
+        PinThread(reinterpret_cast<HANDLE>(thread), i);
+        threads.push_back(reinterpret_cast<HANDLE>(thread));
+    }
+
+    for (const HANDLE thread : threads)
+        CloseHandle(thread);
+
+    return true;
+}
+
+// hands a connected client/target pair to one of the shard's loops
+void AddToRioLoop(_In_ const ConnectionData& client_to_target, _In_ const ConnectionData& target_to_client, size_t shard) {
+    auto session = std::make_unique<RioSession>();
+    session->client_sock = client_to_target.src_sock;
+    session->target_sock = client_to_target.dst_sock;
+
+    auto& c2s = gsl::at(session->dir, static_cast<int>(SocketDir::ClientToServer));
+    c2s.conn = client_to_target;
+    c2s.bFuzz = ShouldFuzz(&client_to_target);
+
+    auto& s2c = gsl::at(session->dir, static_cast<int>(SocketDir::ServerToClient));
+    s2c.conn = target_to_client;
+    s2c.bFuzz = ShouldFuzz(&target_to_client);
+
+    const size_t which = PickLoop(shard, gRioLoops.size(), gNextRioLoop++);
+    gRioLoops.at(which)->Add(std::move(session));
+}
+
+#pragma endregion Engine API
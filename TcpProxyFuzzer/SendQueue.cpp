@@ -0,0 +1,65 @@
+// The per-direction send queue, see SendQueue.h
+
+#include <vector>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+
+#include "SendQueue.h"
+
+void CountSendWait(StatClock::time_point started) noexcept {
+    const auto waited = StatClock::now() - started;
+    if (waited < SEND_THROTTLE_THRESHOLD)
+        return;
+
+    CountStat(StatCounter::Throttles);
+    CountStat(StatCounter::ThrottledNs, std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count());
+}
+
+void SendQueue::Push(QueuedChunk&& chunk) {
+    if (_count == _ring.size()) {
+        // unwind the ring into a bigger one, oldest first
+        std::vector<QueuedChunk> bigger((std::max)(_ring.size() * 2, static_cast<size_t>(4)));
+        for (size_t i = 0; i < _count; i++)
+            bigger[i] = std::move(_ring[(_head + i) % _ring.size()]);
+
+        _ring.swap(bigger);
+        _head = 0;
+    }
+
+    const size_t charge = Charge(chunk);
+    _ring[(_head + _count) % _ring.size()] = std::move(chunk);
+    _count++;
+
+    const bool wasFull = Full();
+    _bytes += charge;
+    CountStat(StatCounter::SendQueued, charge);
+
+    if (!wasFull && Full()) {
+        _fullSince = StatClock::now();
+        CountStat(StatCounter::Throttles);
+    }
+}
+
+std::vector<char> SendQueue::Pop() {
+    QueuedChunk& chunk = _ring[_head];
+    const size_t charge = Charge(chunk);
+
+    const bool wasFull = Full();
+    _bytes -= charge;
+    CountStat(StatCounter::SendDequeued, charge);
+
+    if (wasFull && !Full())
+        CountStat(StatCounter::ThrottledNs, std::chrono::duration_cast<std::chrono::nanoseconds>(StatClock::now() - _fullSince).count());
+
+    std::vector<char> buffer = std::move(chunk.buffer);
+    _head = (_head + 1) % _ring.size();
+    _count--;
+
+    return buffer;
+}
+
+SendQueue::~SendQueue() {
+    if (_bytes)
+        CountStat(StatCounter::SendDequeued, _bytes);
+}
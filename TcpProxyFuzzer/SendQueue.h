@@ -0,0 +1,81 @@
+#pragma once
+
+// Chunks read from one side of a connection waiting to be written to the other
+// A direction keeps reading while its queue is under -send_queue bytes, so a receiver that's a
+// little slow doesn't stall the sender, and stops reading once it's full, which is backpressure:
+// the source's TCP window closes rather than the proxy buffering without limit.
+// A chunk is charged at its buffer's capacity, not just the bytes in it, so the limit bounds
+// memory however small the reads are. The time a direction spends full is counted as throttled.
+//
+// The poll engine queues this way. The thread engine's queue is the destination socket's send
+// buffer, autotuned by Windows unless -send_queue sizes it, and RIO keeps one chunk in flight per direction; neither can see
+// its queue fill, so both count a send that takes longer than SEND_THROTTLE_THRESHOLD as throttled.
+
+#include <vector>
+#include <chrono>
+
+#include "Proxy.h"
+#include "Stats.h"
+
+constexpr auto SEND_THROTTLE_THRESHOLD = std::chrono::milliseconds(1);
+
+// counts the time since started as throttled if it's over SEND_THROTTLE_THRESHOLD
+void CountSendWait(StatClock::time_point started) noexcept;
+
+// a chunk and how much of it has gone
+struct QueuedChunk {
+    std::vector<char>       buffer{};
+    size_t                  len{ 0 };       // how much of the buffer is data
+    FuzzInsert              insert{};       // spliced into the data when it's sent
+    size_t                  sent{ 0 };
+    StatClock::time_point   received{};     // for the latency histogram
+
+    FuzzOutput Output() const noexcept {
+        return FuzzOutput(gsl::span<const char>(buffer.data(), len), insert);
+    }
+};
+
+class SendQueue {
+public:
+    SendQueue() = default;
+
+    bool Empty() const noexcept {
+        return _count == 0;
+    }
+
+    // at -send_queue, the direction shouldn't read again until some of it has gone
+    bool Full() const noexcept {
+        return _bytes >= gOptions.send_queue;
+    }
+
+    // queues a chunk, its buffer is handed back by Pop() once it's all sent
+    void Push(QueuedChunk&& chunk);
+
+    // the oldest chunk, the queue mustn't be empty
+    QueuedChunk& Front() noexcept {
+        return _ring[_head];
+    }
+
+    // drops the oldest chunk and returns its buffer for reuse
+    std::vector<char> Pop();
+
+    SendQueue(const SendQueue&) = delete;
+    SendQueue(SendQueue&&) = delete;
+    SendQueue& operator=(const SendQueue&) = delete;
+    SendQueue& operator=(SendQueue&&) = delete;
+
+    // what's left is counted as dequeued, so the queue depth stat goes back down
+    ~SendQueue();
+
+private:
+    static size_t Charge(const QueuedChunk& chunk) noexcept {
+        return chunk.buffer.capacity() + chunk.insert.length;
+    }
+
+    // a ring, so a queue that has reached its deepest never allocates again
+    std::vector<QueuedChunk>    _ring{};
+    size_t                      _head{ 0 };
+    size_t                      _count{ 0 };
+    size_t                      _bytes{ 0 };
+    StatClock::time_point       _fullSince{};
+};
@@ -0,0 +1,295 @@
+// Proxy-wide counters and the stats reporter, see Stats.h
+
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <format>
+#include <algorithm>
+#include <bit>
+#include <new>
+
+#include "Stats.h"
+
+namespace {
+
+    // one per thread, only the owning thread writes, the atomics are there so readers see whole values
+    struct ThreadHistogram {
+        std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> buckets{};
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sum_ns{ 0 };
+    };
+
+    // histograms are allocated by the owning thread the first time it records into one,
+    // they're a few KB each and most threads only ever use two or three of them
+    struct alignas(64) ThreadCounters {
+        std::array<std::atomic<uint64_t>, STAT_COUNTERS> values{};
+        std::array<std::atomic<ThreadHistogram*>, STAT_HISTOGRAMS> histograms{};
+    };
+
+    // only the owning thread writes, so a load and a store is enough, no locked add
+    void Bump(std::atomic<uint64_t>& value, uint64_t n) noexcept {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // adds a thread's counts to a snapshot
+    void AddTo(StatsSnapshot& total, const ThreadCounters& counters) noexcept {
+        for (size_t i = 0; i < STAT_COUNTERS; i++)
+            total.values[i] += counters.values[i].load(std::memory_order_relaxed);
+
+        for (size_t h = 0; h < STAT_HISTOGRAMS; h++) {
+            const ThreadHistogram* from = counters.histograms[h].load(std::memory_order_acquire);
+            if (!from)
+                continue;
+
+            HistogramSnapshot& to = total.histograms[h];
+            for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+                to.buckets[b] += from->buckets[b].load(std::memory_order_relaxed);
+
+            to.count += from->count.load(std::memory_order_relaxed);
+            to.sum_ns += from->sum_ns.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::mutex registryLock{};
+    std::vector<ThreadCounters*> live{};
+    StatsSnapshot retired{};
+
+    // registers the thread's counters on first use, and retires them when the thread exits
+    class ThreadSlot {
+    public:
+        ThreadSlot() {
+            std::lock_guard lock(registryLock);
+            live.push_back(&_counters);
+        }
+
+        ~ThreadSlot() {
+            std::lock_guard lock(registryLock);
+            AddTo(retired, _counters);
+            std::erase(live, &_counters);
+
+            // readers hold the lock, so nobody is looking at these any more
+            for (auto& h : _counters.histograms)
+                delete h.load(std::memory_order_relaxed);
+        }
+
+        ThreadCounters& Counters() noexcept { return _counters; }
+
+        ThreadSlot(const ThreadSlot&) = delete;
+        ThreadSlot(ThreadSlot&&) = delete;
+        ThreadSlot& operator=(const ThreadSlot&) = delete;
+        ThreadSlot& operator=(ThreadSlot&&) = delete;
+
+    private:
+        ThreadCounters _counters{};
+    };
+
+    thread_local ThreadSlot tSlot{};
+
+    // bytes per second as a short string, eg; 12.3 MB/s
+    std::string Rate(double bytesPerSec) {
+        if (bytesPerSec >= 1024.0 * 1024.0)
+            return std::format("{:.1f} MB/s", bytesPerSec / (1024.0 * 1024.0));
+
+        if (bytesPerSec >= 1024.0)
+            return std::format("{:.1f} KB/s", bytesPerSec / 1024.0);
+
+        return std::format("{:.0f} B/s", bytesPerSec);
+    }
+
+    void ReportLoop(unsigned int interval_ms) {
+        StatsSnapshot last = CollectStats();
+        auto lastTime = std::chrono::steady_clock::now();
+
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+
+            const StatsSnapshot now = CollectStats();
+            const auto nowTime = std::chrono::steady_clock::now();
+            const double secs = (std::max)(1e-3, std::chrono::duration<double>(nowTime - lastTime).count());
+
+            auto perSec = [&](size_t i) { return static_cast<double>(now.values[i] - last.values[i]) / secs; };
+            auto counterPerSec = [&](StatCounter c) { return perSec(static_cast<size_t>(c)); };
+
+            const double in = counterPerSec(StatCounter::BytesInC2S) + counterPerSec(StatCounter::BytesInS2C);
+            const double out = counterPerSec(StatCounter::BytesOutC2S) + counterPerSec(StatCounter::BytesOutS2C);
+            std::string line = std::format("[stats] {} conns, in {} out {}, chunks fuzzed {:.0f}/s skipped {:.0f}/s",
+                now.ActiveConnections(), Rate(in), Rate(out),
+                counterPerSec(StatCounter::ChunksFuzzed), counterPerSec(StatCounter::ChunksSkipped));
+
+            // only with -frame
+            const double frames = counterPerSec(StatCounter::Frames);
+            if (frames > 0)
+                line += std::format(", frames {:.0f}/s", frames);
+
+            // only with -novelty, new ones are rare, so they're a running total
+            const double responses = counterPerSec(StatCounter::Responses);
+            if (responses > 0)
+                line += std::format(", responses {:.0f}/s ({} new)", responses, now[StatCounter::NovelResponses]);
+
+            // zero once the buffer pools have warmed up, so it's only shown when it isn't
+            const double allocs = counterPerSec(StatCounter::BufferAllocs) + counterPerSec(StatCounter::BufferRegrows);
+            if (allocs > 0)
+                line += std::format(", buffer allocs {:.0f}/s", allocs);
+
+            // as a share of the time, summed over the directions, so 2.0 is two directions stalled throughout
+            const double throttled = counterPerSec(StatCounter::ThrottledNs) / 1e9;
+            if (throttled > 0)
+                line += std::format(", throttled {:.2f}, queued {:.0f} KB", throttled, static_cast<double>(now.QueuedBytes()) / 1024.0);
+
+            // only the mutations that happened, in enum order
+            bool first = true;
+            for (size_t m = 0; m < static_cast<size_t>(FuzzMutation::Max); m++) {
+                const size_t i = static_cast<size_t>(StatCounter::Mutations) + m;
+                if (now.values[i] == last.values[i])
+                    continue;
+
+                line += std::format("{}{} {:.0f}/s", first ? " | " : ", ",
+                    FuzzMutationName(static_cast<FuzzMutation>(m)), perSec(i));
+                first = false;
+            }
+
+            fprintf(stdout, "%s\n", line.c_str());
+            fflush(stdout);
+
+            last = now;
+            lastTime = nowTime;
+        }
+    }
+}
+
+size_t HistogramBucket(uint64_t ns) noexcept {
+    if (ns < HISTOGRAM_SUB_BUCKETS)
+        return static_cast<size_t>(ns);
+
+    // the top bit picks the power of two, the next three bits the sub-bucket
+    const size_t exponent = static_cast<size_t>(std::bit_width(ns)) - 1;
+    if (exponent > HISTOGRAM_MAX_EXPONENT)
+        return HISTOGRAM_BUCKETS - 1;
+
+    const size_t sub = static_cast<size_t>(ns >> (exponent - 3)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (std::min)(HISTOGRAM_BUCKETS - 1, HISTOGRAM_SUB_BUCKETS * (exponent - 2) + sub);
+}
+
+uint64_t HistogramBucketEnd(size_t bucket) noexcept {
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+        return bucket + 1;
+
+    const size_t exponent = bucket / HISTOGRAM_SUB_BUCKETS + 2;
+    const size_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+    return static_cast<uint64_t>(HISTOGRAM_SUB_BUCKETS + sub + 1) << (exponent - 3);
+}
+
+void CountStat(StatCounter counter, uint64_t n) noexcept {
+    Bump(tSlot.Counters().values[static_cast<size_t>(counter)], n);
+}
+
+void RecordLatency(StatHistogram histogram, uint64_t ns) noexcept {
+    auto& slot = tSlot.Counters().histograms[static_cast<size_t>(histogram)];
+    ThreadHistogram* h = slot.load(std::memory_order_relaxed);
+    if (!h) {
+        // the release store publishes the zeroed buckets to readers
+        h = new (std::nothrow) ThreadHistogram{};
+        if (!h)
+            return;
+
+        slot.store(h, std::memory_order_release);
+    }
+
+    Bump(h->buckets[HistogramBucket(ns)], 1);
+    Bump(h->count, 1);
+    Bump(h->sum_ns, ns);
+}
+
+uint64_t HistogramSnapshot::Percentile(double p) const noexcept {
+    if (count == 0)
+        return 0;
+
+    // the rank of the sample we want, 1-based, so p100 is the last sample
+    const auto rank = (std::max)(static_cast<uint64_t>(1),
+        static_cast<uint64_t>(static_cast<double>(count) * (std::min)(100.0, p) / 100.0 + 0.5));
+
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= rank)
+            return HistogramBucketEnd(b) - 1;
+    }
+
+    return HistogramBucketEnd(HISTOGRAM_BUCKETS - 1) - 1;
+}
+
+size_t StatFuzzMode(bool bFuzz, char fuzz_type) noexcept {
+    if (!bFuzz)
+        return 0;
+
+    switch (fuzz_type) {
+        case 'b': return 1;
+        case 't': return 2;
+        case 'x': return 3;
+        case 'j': return 4;
+        case 'h': return 5;
+        default:  return 1;
+    }
+}
+
+const char* StatFuzzModeName(size_t mode) noexcept {
+    constexpr const char* names[STAT_FUZZ_MODES] = { "passthrough", "binary", "text", "xml", "json", "html" };
+    return mode < STAT_FUZZ_MODES ? names[mode] : "unknown";
+}
+
+std::string StatHistogramName(StatHistogram histogram) {
+    const auto i = static_cast<size_t>(histogram);
+    if (histogram == StatHistogram::ConnectLatency)
+        return "connect";
+
+    if (i < static_cast<size_t>(StatHistogram::MutationCost)) {
+        const size_t chunk = i - static_cast<size_t>(StatHistogram::ChunkLatency);
+        return std::format("chunk {} {}", chunk / STAT_FUZZ_MODES == 0 ? "c2s" : "s2c", StatFuzzModeName(chunk % STAT_FUZZ_MODES));
+    }
+
+    return std::format("mutation {}", FuzzMutationName(static_cast<FuzzMutation>(i - static_cast<size_t>(StatHistogram::MutationCost))));
+}
+
+std::string FormatPercentiles(const StatsSnapshot& stats) {
+    // microseconds, with enough places for the sub-microsecond mutation costs
+    auto us = [](uint64_t ns) { return std::format("{:.3f}", static_cast<double>(ns) / 1000.0); };
+
+    std::string out = std::format("{:<36} {:>10} {:>12} {:>12} {:>12} {:>12} {:>12} {:>12}\n",
+        "latency (us)", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+
+    for (size_t i = 0; i < STAT_HISTOGRAMS; i++) {
+        const HistogramSnapshot& h = stats.histograms[i];
+        if (h.count == 0)
+            continue;
+
+        out += std::format("{:<36} {:>10} {:>12} {:>12} {:>12} {:>12} {:>12} {:>12}\n",
+            StatHistogramName(static_cast<StatHistogram>(i)), h.count, us(h.sum_ns / h.count),
+            us(h.Percentile(50)), us(h.Percentile(90)), us(h.Percentile(99)), us(h.Percentile(99.9)), us(h.Percentile(100)));
+    }
+
+    return out;
+}
+
+StatsSnapshot CollectStats() {
+    std::lock_guard lock(registryLock);
+    StatsSnapshot total = retired;
+    for (const auto* counters : live)
+        AddTo(total, *counters);
+
+    return total;
+}
+
+bool StartStatsReporter(unsigned int interval_ms) {
+    try {
+        std::thread(ReportLoop, (std::max)(100u, interval_ms)).detach();
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+// Proxy-wide counters and latency histograms
+// Every thread counts into its own block, so the hot path is a plain add to memory only that
+// thread writes, no locks and no shared cache lines. Readers sum all the blocks; a thread's
+// counts are folded into a retired total when it exits so nothing is lost.
+
+#include <cstdint>
+#include <array>
+#include <chrono>
+#include <string>
+
+#include "Fuzz.h"
+
+enum class StatCounter : size_t {
+    BytesInC2S = 0,     // read from the client
+    BytesInS2C,         // read from the target
+    BytesOutC2S,        // written to the target, differs from BytesInC2S when Fuzz() grows or truncates
+    BytesOutS2C,        // written to the client
+    ChunksFuzzed,       // chunks Fuzz() mutated
+    ChunksSkipped,      // chunks Fuzz() left alone, too small or not picked
+    Accepted,           // clients accepted
+    AcceptFailures,
+    ConnectFailures,    // the target refused or errored
+    ConnectTimeouts,    // the target didn't answer within -connect_timeout
+    ConnectsDropped,    // clients dropped because -max_connects were already in flight
+    SessionsStarted,    // client and target both connected
+    DirectionsClosed,   // two per finished session
+    BufferAllocs,       // chunk buffers a pool had to allocate, flat once the pools have warmed up
+    BufferReuses,       // chunk buffers a pool handed out again
+    BufferRegrows,      // chunks Fuzz() grew past their buffer's headroom, each one a reallocation
+    BufferGrows,        // a direction's reads kept filling its buffer, so it doubled
+    BufferShrinks,      // a direction's reads came back short or it went idle, so its buffer shrank
+    BufferGrowsDenied,  // a buffer would have doubled but -buffer_budget was used up
+    SendQueued,         // bytes charged to send queues, less SendDequeued is what's queued now
+    SendDequeued,
+    Throttles,          // times a direction stopped reading because what it had read couldn't be sent
+    ThrottledNs,        // and how long it stopped for
+    Frames,             // whole messages framers handed out to be fuzzed, with -frame
+    FramesPassed,       // messages passed through unfuzzed, too big for -max_frame or cut short waiting for the rest
+    Responses,          // answers from the server fingerprinted, with -novelty
+    NovelResponses,     // and those with a fingerprint not seen before
+    Mutations,          // one counter per FuzzMutation from here
+    Count = Mutations + static_cast<size_t>(FuzzMutation::Max)
+};
+
+constexpr size_t STAT_COUNTERS = static_cast<size_t>(StatCounter::Count);
+
+// dir is a SocketDir
+inline StatCounter BytesInCounter(size_t dir) noexcept {
+    return static_cast<StatCounter>(static_cast<size_t>(StatCounter::BytesInC2S) + dir);
+}
+
+inline StatCounter BytesOutCounter(size_t dir) noexcept {
+    return static_cast<StatCounter>(static_cast<size_t>(StatCounter::BytesOutC2S) + dir);
+}
+
+// What a direction does with its chunks, passthrough or fuzzed as one of the fuzz_types
+constexpr size_t STAT_FUZZ_MODES = 6;
+
+// fuzz_type is b, t, x, j or h
+size_t StatFuzzMode(bool bFuzz, char fuzz_type) noexcept;
+const char* StatFuzzModeName(size_t mode) noexcept;
+
+enum class StatHistogram : size_t {
+    ConnectLatency = 0,     // connect() to the target until it completed
+    ChunkLatency,           // a chunk's recv() returning until its send() completed, one per direction and fuzz mode
+    MutationCost = ChunkLatency + 2 * STAT_FUZZ_MODES,  // time spent in each mutation, one per FuzzMutation
+    Count = MutationCost + static_cast<size_t>(FuzzMutation::Max)
+};
+
+constexpr size_t STAT_HISTOGRAMS = static_cast<size_t>(StatHistogram::Count);
+
+// dir is a SocketDir, mode comes from StatFuzzMode()
+inline StatHistogram ChunkLatencyHistogram(size_t dir, size_t mode) noexcept {
+    return static_cast<StatHistogram>(static_cast<size_t>(StatHistogram::ChunkLatency) + dir * STAT_FUZZ_MODES + mode);
+}
+
+inline StatHistogram MutationCostHistogram(FuzzMutation mutation) noexcept {
+    return static_cast<StatHistogram>(static_cast<size_t>(StatHistogram::MutationCost) + static_cast<size_t>(mutation));
+}
+
+// a readable name for a histogram, eg; chunk c2s text
+std::string StatHistogramName(StatHistogram histogram);
+
+// HDR-style log-linear buckets over nanoseconds
+// Values under 8ns get a bucket each, above that every power of two is split into 8 equal
+// sub-buckets, so any value is within 12.5% of its bucket's bounds. The last bucket also
+// takes everything over 2^44ns (about 4.9 hours).
+constexpr size_t HISTOGRAM_SUB_BUCKETS = 8;
+constexpr size_t HISTOGRAM_MAX_EXPONENT = 44;
+constexpr size_t HISTOGRAM_BUCKETS = HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_MAX_EXPONENT - 1);
+
+size_t HistogramBucket(uint64_t ns) noexcept;
+
+// the smallest value that lands in the next bucket
+uint64_t HistogramBucketEnd(size_t bucket) noexcept;
+
+struct HistogramSnapshot {
+    std::array<uint64_t, HISTOGRAM_BUCKETS> buckets{};
+    uint64_t    count{ 0 };
+    uint64_t    sum_ns{ 0 };
+
+    // the highest value in the bucket that holds the p'th percentile, p is 0-100, eg; 99.9
+    uint64_t Percentile(double p) const noexcept;
+
+    // for code that keeps its own histogram rather than recording into the thread's, eg; the benchmarks
+    void Add(uint64_t ns) noexcept {
+        buckets[HistogramBucket(ns)]++;
+        count++;
+        sum_ns += ns;
+    }
+
+    void Add(const HistogramSnapshot& other) noexcept {
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+            buckets[b] += other.buckets[b];
+
+        count += other.count;
+        sum_ns += other.sum_ns;
+    }
+};
+
+struct StatsSnapshot {
+    std::array<uint64_t, STAT_COUNTERS> values{};
+    std::array<HistogramSnapshot, STAT_HISTOGRAMS> histograms{};
+
+    uint64_t operator[](StatCounter counter) const noexcept {
+        return values[static_cast<size_t>(counter)];
+    }
+
+    uint64_t Mutation(FuzzMutation mutation) const noexcept {
+        return values[static_cast<size_t>(StatCounter::Mutations) + static_cast<size_t>(mutation)];
+    }
+
+    const HistogramSnapshot& Histogram(StatHistogram histogram) const noexcept {
+        return histograms[static_cast<size_t>(histogram)];
+    }
+
+    // a half-closed connection still counts as open
+    uint64_t ActiveConnections() const noexcept {
+        const uint64_t open = 2 * (*this)[StatCounter::SessionsStarted];
+        const uint64_t closed = (*this)[StatCounter::DirectionsClosed];
+        return open > closed ? (open - closed + 1) / 2 : 0;
+    }
+
+    // what's in the send queues across every direction
+    uint64_t QueuedBytes() const noexcept {
+        const uint64_t queued = (*this)[StatCounter::SendQueued];
+        const uint64_t dequeued = (*this)[StatCounter::SendDequeued];
+        return queued > dequeued ? queued - dequeued : 0;
+    }
+};
+
+// adds to the calling thread's counter
+void CountStat(StatCounter counter, uint64_t n = 1) noexcept;
+
+inline void CountMutation(FuzzMutation mutation) noexcept {
+    CountStat(static_cast<StatCounter>(static_cast<size_t>(StatCounter::Mutations) + static_cast<size_t>(mutation)));
+}
+
+// adds a value to the calling thread's histogram
+// a thread only allocates the histograms it records into, so a forwarding thread carries two or three, not all of them
+void RecordLatency(StatHistogram histogram, uint64_t ns) noexcept;
+
+using StatClock = std::chrono::steady_clock;
+
+inline void RecordLatencySince(StatHistogram histogram, StatClock::time_point start) noexcept {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(StatClock::now() - start).count();
+    RecordLatency(histogram, elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0);
+}
+
+// the totals over every thread so far, this takes a lock, it's for readers, not the hot path
+StatsSnapshot CollectStats();
+
+// p50/p90/p99/p99.9 and max of every histogram with samples in it, one per line
+std::string FormatPercentiles(const StatsSnapshot& stats);
+
+// prints a line of rates to stdout every interval_ms, returns false if the thread can't be started
+bool StartStatsReporter(unsigned int interval_ms);
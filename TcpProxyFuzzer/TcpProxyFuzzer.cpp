@@ -18,8 +18,23 @@
 #include <sstream>
 #include <iomanip>
 #include <format>
+#include <memory>
+#include <thread>
+#include <array>
+#include <atomic>
+#include <filesystem>
 
 #include "Logger.h"
+#include "Proxy.h"
+#include "Fuzz.h"
+#include "Capture.h"
+#include "EventLog.h"
+#include "Corpus.h"
+#include "Stats.h"
+#include "BufferPool.h"
+#include "SendQueue.h"
+#include "MutationScheduler.h"
+#include "Novelty.h"
 #include "gsl/util"
 #include "gsl/span"
 #include "crc32.h"
@@ -28,44 +43,43 @@
 
 constexpr auto VERSION = "1.91";
 constexpr auto AUTHOR = "Michael Howard (Azure Data Security)";
-constexpr size_t BUFFER_SIZE = 4096;
 
-#ifdef _DEBUG
+// off until main() starts it, debug builds always log, release builds log with -log:on
 Logger gLog("proxylog");
-#endif
 
 auto gCrc32 = crc32();
 
-// Passes important info to the socket threads 
-// because thread APIs only support void* for args
-enum class SocketDir {
-    ClientToServer = 0,
-    ServerToClient = 1
-};
-
-typedef struct {
-    SOCKET          src_sock;
-    SOCKET          dst_sock;
-    SocketDir       sock_dir;    // This is the ACTUAL direction of the socket, ClientToServer or ServerToClient
-    char            fuzz_dir;    // This is the requested fuzzing direction; c=server to client, s=client to server, b=both directions, n=no fuzzing
-    char 		    fuzz_type;   // Fuzzing type; b=binary, t=text, x=xml, j=json, h=html
-    unsigned int    fuzz_aggr;   // Fuzzing aggressiveness as a %
-    unsigned int    offset;	     // Offset in data stream where fuzzing starts, useful to skip headers
-} ConnectionData;
+// the binary event log, only open with -events
+EventLog gEvents{};
+
+ProxyOptions gOptions{};
+
+// fuzzing settings from the command-line, the sockets and direction are filled in per session
+ConnectionData gSessionTemplate{};
+
+// shared by all the accept threads
+SOCKET gListenSock{ INVALID_SOCKET };
+
+// chunk buffers for the thread engine's fuzzed directions
+SharedBufferPool gBuffers{};
 
 // forward decls
 void PrintLogo();
 std::string getCurrentTimeAsString();
-void forward_data(_In_ const ConnectionData*);
+bool ParseOptions(const std::vector<std::string>& args, size_t first, ProxyOptions& options);
+bool StartEngine(unsigned int workers);
+void accept_loop(size_t shard);
+unsigned __stdcall accept_thread(_In_ void*);
+void forward_data(_Inout_ ConnectionData*);
 unsigned __stdcall forward_thread(_In_  void*);
-bool Fuzz(std::vector<char>& buff, unsigned int fuzzaggr, unsigned int fuzz_type, unsigned int offset);
+BOOL WINAPI console_handler(DWORD ctrlType);
 
 // let's ggoooo...
 int main(int argc, char* argv[]) {
 
-    // you must pass in all 7 args
+    // you must pass in all 7 args, optional -name:value args can follow
     // TODO: Replace with real arg parsing!
-    if (argv==nullptr || argc != 8) {
+    if (argv==nullptr || argc < 8) {
 
         fprintf(stdout,
             "Usage: TcpProxyFuzzer <listen_port> <forward_ip> <forward_port> <start_offset> <aggressiveness> <fuzz_direction> <fuzz_type>\n"
@@ -73,10 +87,35 @@ int main(int argc, char* argv[]) {
             "\tlisten_port is the proxy listening port.Eg; 8088\n"
             "\tforward_ip is the host to forward resuests to. Eg; 192.168.1.77\n"
             "\tforward_port is the port to proxy requests to. Eg; 80\n"
-            "\tstart_offset is how far into the datastream to start fuzzing. Eg; 42\n"
+            "\tstart_offset is how far into each chunk (or message, with -frame) to start fuzzing, no more than -max_buffer (or -max_frame). Eg; 42\n"
             "\taggressiveness is how agressive the fuzzing should be as a percentage between 0-100. Eg; 7\n"
             "\tfuzz_direction determines whether to fuzz from client->server (s), server->client (c), none (n) or both (b). Eg; s\n"
-            "\tfuzz_type is a hint to the fuzzer about the data type; b=binary, t=text, x=xml, j=json, h=html\n\n");
+            "\tfuzz_type is a hint to the fuzzer about the data type; b=binary, t=text, x=xml, j=json, h=html\n"
+            "Optional args:\n"
+            "\t-engine:<thread|poll|rio> selects the forwarding engine, thread is two threads per connection, poll uses a few event loops, rio uses registered I/O loops. Eg; -engine:poll\n"
+            "\t-workers:<n> is the number of poll or rio engine loops, the default is one per CPU core. Eg; -workers:4\n"
+            "\t-connect_timeout:<ms> is how long to wait for the target to accept a connection, the default is 5000. Eg; -connect_timeout:2000\n"
+            "\t-max_connects:<n> caps connects to the target in flight, clients over the cap are dropped, the default is 256. Eg; -max_connects:1000\n"
+            "\t-buffer:<bytes> is how much each direction reads at a time to start with, and the least it drops back to, the default is 4096. Eg; -buffer:16384\n"
+            "\t-max_buffer:<bytes> is the most a direction's reads grow to while they keep filling the buffer, the same as -buffer stops them growing, the default is 65536. Eg; -max_buffer:262144\n"
+            "\t-buffer_budget:<MB> caps what all the grown buffers together hold above -buffer, the default is 64. Eg; -buffer_budget:256\n"
+            "\t-send_queue:<bytes> is how much a direction can have read but not yet sent before it stops reading, the default is 262144. With the thread engine it sets each socket's SO_SNDBUF, which turns off send buffer autotuning, so it's left alone unless this is given. Eg; -send_queue:1048576\n"
+            "\t-frame:<none|http|delim:<text>|length:<offset>:<size>[:<header size>][:le][:incl]> fuzzes fuzzed directions a message at a time, and start_offset counts from the start of each message, the default is none. Eg; -frame:length:0:4:le or -frame:delim:\\r\\n\n"
+            "\t-max_frame:<bytes> is the biggest message -frame holds to fuzz whole, bigger ones pass through unfuzzed, the default is 1048576. Eg; -max_frame:65536\n"
+            "\t-shards:<n> is the number of accept threads, each with its own connector and share of the loops, the default is 1. Eg; -shards:8\n"
+            "\t-pin:<on|off> pins the shard and loop threads to CPU cores, the default is off. Eg; -pin:on\n"
+            "\t-seed:<n|random> seeds every fuzzed direction from n and writes capture files for offline replay. Eg; -seed:0x1234\n"
+            "\t-crc:<on|off> keeps a CRC32 of what each fuzzed direction received and sent, printed when it closes, the default is off. Eg; -crc:on\n"
+            "\t-log:<on|off> writes a log of every chunk and mutation to the fuzzlogs directory, the default is on in debug builds and off in release. Eg; -log:on\n"
+            "\t-log_flush:<ms> is how often the log writer thread writes out what has been logged, the default is 100. Eg; -log_flush:1000\n"
+            "\t-log_full:<drop|block> is what happens when a thread logs faster than the writer keeps up, drop loses lines (and says how many), block waits, the default is drop. Eg; -log_full:block\n"
+            "\t-corpus:<file> maps a corpus compiled with FuzzTools compile instead of loading the naughty*.txt files. Eg; -corpus:http.tpc\n"
+            "\t-weights:<file> weights how often each mutation is picked, per fuzz type, the file is reloaded when it changes, see MutationScheduler.h. Eg; -weights:weights.txt\n"
+            "\t-novelty:<on|off> fingerprints the server's answers and picks the client->server mutations that led to new ones more often, see Novelty.h, the default is off. Eg; -novelty:on\n"
+            "\t-events:<file> appends a binary record of every connection, chunk and mutation to file, read it with FuzzTools events. Eg; -events:fuzz.evl\n"
+            "\t-quiet:<on|off> stops the per-connection and per-mutation console output, the default is off. Eg; -quiet:on\n"
+            "\t-stats:<seconds> prints throughput and mutation rates every so many seconds, the default is 0, which is never. Ctrl+Break prints latency percentiles. Eg; -stats:5\n"
+            "\t-metrics:<port> serves Prometheus metrics at http://127.0.0.1:port/metrics, the default is 0, which is off. Eg; -metrics:9464\n\n");
 
         return 1;
     }
@@ -104,7 +143,6 @@ int main(int argc, char* argv[]) {
     // basic error checking
     if (listen_port <= 0 || listen_port >= 65535 ||
         aggressiveness < 0 || aggressiveness > 100 ||
-        offset > BUFFER_SIZE || 
         (direction != 'c' && direction != 's' && direction != 'n' && direction != 'b') || 
         (f_type != 'b' && f_type != 't' && f_type != 'x' && f_type != 'j' && f_type !='h')) {
         fprintf(stderr, "Error in one or more args.");
@@ -112,7 +150,60 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    const SOCKET server_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (!ParseOptions(args, 8, gOptions)) {
+        fprintf(stderr, "Error in one or more optional args.");
+
+        return 1;
+    }
+
+    // a chunk is never bigger than the biggest buffer, or with -frame the biggest message, so fuzzing could never start past it
+    const size_t max_chunk = gOptions.frame.kind == FrameKind::None ? gOptions.max_buffer : gOptions.frame.max_frame;
+    if (offset > max_chunk) {
+        fprintf(stderr, "Error in one or more args.");
+
+        return 1;
+    }
+
+    if (gOptions.log && !gLog.Start(gOptions.log_settings)) {
+        fprintf(stderr, "Unable to open the log file in fuzzlogs\n");
+
+        return 1;
+    }
+
+    if (!gOptions.events.empty() && !gEvents.Open(gOptions.events)) {
+        fprintf(stderr, "Unable to create the event log %s\n", gOptions.events.c_str());
+
+        return 1;
+    }
+
+    SetFuzzTrace(!gOptions.quiet);
+
+    // before any forwarding thread can call Fuzz(), so the first fuzzed chunk doesn't pay for it
+    if (gOptions.corpus.empty())
+        LoadNaughtyCorpus();
+    else if (!MapNaughtyCorpus(gOptions.corpus))
+        return 1;
+
+    // the file is watched from here on, so the weights can be tuned without a restart
+    if (!gOptions.weights.empty()) {
+        if (!LoadScheduleWeights(gOptions.weights))
+            return 1;
+
+        if (!StartWeightsWatcher(gOptions.weights))
+            fprintf(stderr, "Unable to watch %s, changes to it won't be picked up\n", gOptions.weights.c_str());
+    }
+
+    // start the engine first, the listening socket is created differently for RIO
+    const unsigned int workers = gOptions.workers
+        ? gOptions.workers
+        : (std::max)(1u, std::thread::hardware_concurrency());
+
+    if (!StartEngine(workers)) {
+        WSACleanup();
+        return 1;
+    }
+
+    const SOCKET server_sock = CreateTcpSocket(gOptions.engine);
     if (server_sock == INVALID_SOCKET) {
         fprintf(stderr, "Socket creation failed. Error: %d\n", WSAGetLastError());
         WSACleanup();
@@ -131,7 +222,8 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    constexpr int backlog = 10;
+    // sharded listeners are there to soak up bursts, so they get the biggest backlog
+    const int backlog = gOptions.shards > 1 ? SOMAXCONN : 10;
     if (listen(server_sock, backlog) == SOCKET_ERROR) {
         fprintf(stderr, "Listen failed. Error: %d\n", WSAGetLastError());
         closesocket(server_sock);
@@ -144,110 +236,807 @@ int main(int argc, char* argv[]) {
     fprintf(stdout, "Proxying from port %u -> %s:%u\n", 
         listen_port, forward_ip.c_str(), forward_port);
 
-    while (true) {
-        const SOCKET client_sock = accept(server_sock, NULL, NULL);
-        if (client_sock == INVALID_SOCKET) {
-            fprintf(stderr, "Accept failed. Error: %d\n", WSAGetLastError());
-            continue;
-        }
+    if (gOptions.engine == ForwardEngine::Poll)
+        fprintf(stdout, "Using %u event loops\n", workers);
+    else if (gOptions.engine == ForwardEngine::Rio)
+        fprintf(stdout, "Using %u registered I/O loops\n", workers);
 
-        const SOCKET target_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-        if (target_sock == INVALID_SOCKET) {
-            fprintf(stderr, "Target socket creation failed. Error: %d\n", WSAGetLastError());
-            closesocket(client_sock);
-            continue;
-        }
+    // every session gets the same fuzzing settings
+    gSessionTemplate.fuzz_dir = direction;
+    gSessionTemplate.fuzz_type = f_type;
+    gSessionTemplate.fuzz_aggr = aggressiveness;
+    gSessionTemplate.offset = offset;
 
-        SOCKADDR_IN target_addr{};
-        target_addr.sin_family = AF_INET;
-        inet_pton(AF_INET, forward_ip.c_str(), &target_addr.sin_addr);
-        target_addr.sin_port = htons(forward_port);
+    // the credit goes to client->server mutations, so without them there's nothing to feed back
+    if (gOptions.novelty && direction != 's' && direction != 'b') {
+        fprintf(stderr, "-novelty needs client->server fuzzing, s or b, so it's off\n");
+        gOptions.novelty = false;
+    }
 
-        if (connect(target_sock, reinterpret_cast<SOCKADDR*>(&target_addr), sizeof(target_addr)) == SOCKET_ERROR) {
-            fprintf(stderr, "Connect to target failed. Error: %d\n", WSAGetLastError());
-            closesocket(target_sock);
-            closesocket(client_sock);
-            continue;
+    if (gOptions.novelty && !StartNoveltyFeedback()) {
+        fprintf(stderr, "Unable to start the novelty feedback, so it's off\n");
+        gOptions.novelty = false;
+    }
+
+    SOCKADDR_IN target_addr{};
+    target_addr.sin_family = AF_INET;
+    inet_pton(AF_INET, forward_ip.c_str(), &target_addr.sin_addr);
+    target_addr.sin_port = htons(forward_port);
+
+    if (!StartConnectors(target_addr, gOptions.connect_timeout_ms, gOptions.max_connects, gOptions.shards)) {
+        closesocket(server_sock);
+        WSACleanup();
+        return 1;
+    }
+
+    // shard 0 accepts on this thread, the other shards get their own threads
+    gListenSock = server_sock;
+    for (size_t shard = 1; shard < gOptions.shards; shard++) {
+        const auto thread = _beginthreadex(NULL, 0, accept_thread, reinterpret_cast<void*>(shard), 0, NULL);
+        if (thread == 0) {
+            fprintf(stderr, "Accept thread creation failed. Error: %d\n", errno);
+            closesocket(server_sock);
+            WSACleanup();
+            return 1;
         }
 
-        ConnectionData client_to_target = { client_sock, target_sock, SocketDir::ClientToServer, direction, f_type, aggressiveness, offset };
-        ConnectionData target_to_client = { target_sock, client_sock, SocketDir::ServerToClient, direction, f_type, aggressiveness, offset};
+        PinThread(reinterpret_cast<HANDLE>(thread), shard);
+        CloseHandle(reinterpret_cast<HANDLE>(thread));
+    }
+
+    if (gOptions.shards > 1)
+        fprintf(stdout, "Using %u listener shards\n", gOptions.shards);
 
-        // Create two threads to handle bidirectional forwarding
-        _beginthreadex(NULL, 0, forward_thread, &client_to_target, 0, NULL);
-        _beginthreadex(NULL, 0, forward_thread, &target_to_client, 0, NULL);
+    if (gOptions.seeded) {
+        std::error_code ec{};
+        std::filesystem::create_directory(CAPTURE_DIR, ec);
+        fprintf(stdout, "Seeded sessions, master seed 0x%016llx, captures in %s\n", 
+            static_cast<unsigned long long>(gOptions.seed), CAPTURE_DIR);
     }
 
+    if (gOptions.stats_secs && !StartStatsReporter(gOptions.stats_secs * 1000))
+        fprintf(stderr, "Unable to start the stats reporter\n");
+
+    // Ctrl+Break prints the latency percentiles, Ctrl+C prints them on the way out
+    SetConsoleCtrlHandler(console_handler, TRUE);
+
+    if (gOptions.metrics_port && StartMetricsServer(gOptions.metrics_port))
+        fprintf(stdout, "Metrics at http://127.0.0.1:%u/metrics\n", gOptions.metrics_port);
+
+    PinThread(GetCurrentThread(), 0);
+    accept_loop(0);
+
     closesocket(server_sock);
     WSACleanup();
 
     return 0;
 }
 
+#pragma region Option Parsing
+
+// parses the optional args, these are of the form -name:value
+bool ParseOptions(const std::vector<std::string>& args, size_t first, ProxyOptions& options) {
+    for (size_t i = first; i < args.size(); i++) {
+        const std::string& arg = args.at(i);
+        const auto colon = arg.find(':');
+        if (arg.size() < 2 || arg.at(0) != '-' || colon == std::string::npos) {
+            fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return false;
+        }
+
+        std::string name = arg.substr(1, colon - 1);
+        std::transform(name.begin(), name.end(), name.begin(),
+            [](unsigned char c) { return gsl::narrow_cast<char>(std::tolower(c)); });
+        const std::string value = arg.substr(colon + 1);
+
+        try {
+            if (name == "engine") {
+                if (value == "thread")      options.engine = ForwardEngine::Thread;
+                else if (value == "poll")   options.engine = ForwardEngine::Poll;
+                else if (value == "rio")    options.engine = ForwardEngine::Rio;
+                else return false;
+            } else if (name == "workers") {
+                options.workers = std::stoi(value);
+                if (options.workers > 1024) return false;
+            } else if (name == "connect_timeout") {
+                options.connect_timeout_ms = std::stoi(value);
+                if (options.connect_timeout_ms == 0) return false;
+            } else if (name == "max_connects") {
+                options.max_connects = std::stoi(value);
+                if (options.max_connects == 0) return false;
+            } else if (name == "shards") {
+                options.shards = std::stoi(value);
+                if (options.shards == 0 || options.shards > 1024) return false;
+            } else if (name == "pin") {
+                if (value == "on")          options.pin = true;
+                else if (value == "off")    options.pin = false;
+                else return false;
+            } else if (name == "seed") {
+                // decimal or 0x hex, so a seed can be pasted straight from the log
+                options.seed = value == "random"
+                    ? RandomNumberGenerator::RandomSeed()
+                    : std::stoull(value, nullptr, 0);
+                options.seeded = true;
+            } else if (name == "log") {
+                if (value == "on")          options.log = true;
+                else if (value == "off")    options.log = false;
+                else return false;
+            } else if (name == "log_flush") {
+                options.log_settings.flush_ms = std::stoi(value);
+                if (options.log_settings.flush_ms == 0) return false;
+            } else if (name == "log_full") {
+                if (value == "drop")        options.log_settings.full = LogFull::Drop;
+                else if (value == "block")  options.log_settings.full = LogFull::Block;
+                else return false;
+            } else if (name == "quiet") {
+                if (value == "on")          options.quiet = true;
+                else if (value == "off")    options.quiet = false;
+                else return false;
+            } else if (name == "stats") {
+                options.stats_secs = std::stoi(value);
+                if (options.stats_secs > 86400) return false;
+            } else if (name == "metrics") {
+                const int port = std::stoi(value);
+                if (port <= 0 || port > 65535) return false;
+                options.metrics_port = gsl::narrow_cast<unsigned short>(port);
+            } else if (name == "buffer") {
+                options.buffer_size = std::stoul(value);
+                if (options.buffer_size < MIN_BUFF_LEN || options.buffer_size > 1024 * 1024) return false;
+            } else if (name == "max_buffer") {
+                options.max_buffer = std::stoul(value);
+                if (options.max_buffer < MIN_BUFF_LEN || options.max_buffer > 16 * 1024 * 1024) return false;
+            } else if (name == "buffer_budget") {
+                const unsigned long mb = std::stoul(value);
+                if (mb > 64 * 1024) return false;
+                options.buffer_budget = static_cast<size_t>(mb) * 1024 * 1024;
+            } else if (name == "send_queue") {
+                options.send_queue = std::stoul(value);
+                options.send_queue_set = true;
+                if (options.send_queue == 0 || options.send_queue > 64 * 1024 * 1024) return false;
+            } else if (name == "frame") {
+                if (!ParseFrameSettings(value, options.frame)) return false;
+            } else if (name == "max_frame") {
+                options.frame.max_frame = std::stoul(value);
+                if (options.frame.max_frame < MIN_BUFF_LEN || options.frame.max_frame > 64 * 1024 * 1024) return false;
+            } else if (name == "corpus") {
+                if (value.empty()) return false;
+                options.corpus = value;
+            } else if (name == "weights") {
+                if (value.empty()) return false;
+                options.weights = value;
+            } else if (name == "events") {
+                if (value.empty()) return false;
+                options.events = value;
+            } else if (name == "novelty") {
+                if (value == "on")          options.novelty = true;
+                else if (value == "off")    options.novelty = false;
+                else return false;
+            } else if (name == "crc") {
+                if (value == "on")          options.crc = true;
+                else if (value == "off")    options.crc = false;
+                else return false;
+            } else {
+                fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+                return false;
+            }
+        }
+        catch (const std::exception&) {
+            fprintf(stderr, "Bad value for option: %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    // -buffer on its own can go past the default -max_buffer, growing then just doesn't happen
+    if (options.max_buffer < options.buffer_size)
+        options.max_buffer = options.buffer_size;
+
+    // RIO sends each chunk from the slice it was read into, there's nowhere to hold a message being put together
+    if (options.engine == ForwardEngine::Rio && options.frame.kind != FrameKind::None) {
+        fprintf(stderr, "-frame isn't supported by the rio engine, using the poll engine\n");
+        options.engine = ForwardEngine::Poll;
+    }
+
+    return true;
+}
+
+#pragma endregion Option Parsing
+
 #pragma region Threading Code
 
+// Windows has no load-balancing SO_REUSEPORT, so the shards share one listening socket;
+// every shard's thread blocks in accept() and the kernel hands each connection to one of them
+void accept_loop(size_t shard) {
+    while (true) {
+        const SOCKET client_sock = accept(gListenSock, NULL, NULL);
+        if (client_sock == INVALID_SOCKET) {
+            fprintf(stderr, "Accept failed. Error: %d\n", WSAGetLastError());
+            CountStat(StatCounter::AcceptFailures);
+            continue;
+        }
+
+        CountStat(StatCounter::Accepted);
+
+        // the connect to the target completes in the background, so a slow target
+        // doesn't hold up the next accept()
+        ConnectUpstream(client_sock, shard);
+    }
+}
+
+unsigned __stdcall accept_thread(_In_ void* data) {
+    accept_loop(reinterpret_cast<size_t>(data));
+
+    return 0;
+}
+
+// called on a thread Windows creates for the event
+// returning FALSE hands Ctrl+C and closing the console on to the default handler, which exits
+BOOL WINAPI console_handler(DWORD ctrlType) {
+    const std::string percentiles = FormatPercentiles(CollectStats());
+    fprintf(stdout, "\n%s", percentiles.c_str());
+    fflush(stdout);
+
+    return ctrlType == CTRL_BREAK_EVENT ? TRUE : FALSE;
+}
+
+void PinThread(HANDLE thread, size_t index) noexcept {
+    if (!gOptions.pin)
+        return;
+
+    // SetThreadAffinityMask() only covers the 64 cores in the thread's processor group
+    const size_t cores = (std::min)(static_cast<size_t>(64), static_cast<size_t>((std::max)(1u, std::thread::hardware_concurrency())));
+    const DWORD_PTR mask = static_cast<DWORD_PTR>(1) << (index % cores);
+    if (SetThreadAffinityMask(thread, mask) == 0)
+        fprintf(stderr, "Thread affinity failed. Error: %lu\n", GetLastError());
+}
+
+size_t PickLoop(size_t shard, size_t loops, size_t next) noexcept {
+    const size_t shards = gOptions.shards;
+    if (shards <= 1 || loops < shards)
+        return (shards <= 1 ? next : shard) % loops;
+
+    // loops shard, shard + shards, shard + 2*shards ... belong to this shard, when shards doesn't divide
+    // loops the first loops % shards shards have one more
+    const size_t owned = (loops - shard + shards - 1) / shards;
+    return shard + shards * (next % owned);
+}
+
+// starts the loops for the poll and rio engines, the thread engine starts threads per connection
+// if registered I/O isn't available, this falls back to the poll engine
+bool StartEngine(unsigned int workers) {
+    if (gOptions.engine == ForwardEngine::Rio && !StartRioLoops(workers)) {
+        fprintf(stderr, "Registered I/O is not available, falling back to the poll engine\n");
+        gOptions.engine = ForwardEngine::Poll;
+    }
+
+    if (gOptions.engine == ForwardEngine::Poll)
+        return StartEventLoops(workers);
+
+    return true;
+}
+
+// RIO needs sockets created for registered I/O, sockets accepted from a RIO listening socket inherit that
+SOCKET CreateTcpSocket(ForwardEngine engine) noexcept {
+    if (engine == ForwardEngine::Rio)
+        return WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+
+    return socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+}
+
+// each direction's seed is derived from the master seed, the connection number and the direction,
+// and is logged, so one direction can be replayed without knowing the master seed
+uint64_t DirectionSeed(uint64_t conn_id, SocketDir dir) noexcept {
+    uint64_t state = gOptions.seed ^ ((conn_id << 1) | static_cast<uint64_t>(dir));
+    return SplitMix64(state);
+}
+
+// hands a connected client/target pair to the selected engine
+void StartSession(SOCKET client_sock, SOCKET target_sock, size_t shard) {
+    static std::atomic<uint64_t> nextConnId{ 0 };
+    const uint64_t conn_id = ++nextConnId;
+    CountStat(StatCounter::SessionsStarted);
+
+    ConnectionData client_to_target = gSessionTemplate;
+    client_to_target.src_sock = client_sock;
+    client_to_target.dst_sock = target_sock;
+    client_to_target.sock_dir = SocketDir::ClientToServer;
+    client_to_target.conn_id = conn_id;
+    client_to_target.seed = DirectionSeed(conn_id, SocketDir::ClientToServer);
+
+    ConnectionData target_to_client = gSessionTemplate;
+    target_to_client.src_sock = target_sock;
+    target_to_client.dst_sock = client_sock;
+    target_to_client.sock_dir = SocketDir::ServerToClient;
+    target_to_client.conn_id = conn_id;
+    target_to_client.seed = DirectionSeed(conn_id, SocketDir::ServerToClient);
+
+    if (gOptions.novelty)
+        client_to_target.novelty = target_to_client.novelty = std::make_shared<ResponseTracker>(conn_id, gSessionTemplate.fuzz_type);
+
+    if (gOptions.engine == ForwardEngine::Poll) {
+        AddToEventLoop(client_to_target, target_to_client, shard);
+        return;
+    }
+
+    if (gOptions.engine == ForwardEngine::Rio) {
+        AddToRioLoop(client_to_target, target_to_client, shard);
+        return;
+    }
+
+    // Create two threads to handle bidirectional forwarding
+    // each thread gets its own copy of the connection data and frees it when done
+    for (const auto* conn : { &client_to_target, &target_to_client }) {
+        auto* threadData = new ConnectionData(*conn);
+        const auto thread = _beginthreadex(NULL, 0, forward_thread, threadData, 0, NULL);
+        if (thread == 0) {
+            fprintf(stderr, "Thread creation failed. Error: %d\n", errno);
+            delete threadData;
+            continue;
+        }
+
+        CloseHandle(reinterpret_cast<HANDLE>(thread));
+    }
+}
+
 // this func handles both server->client and client->server
 unsigned __stdcall forward_thread(_In_ void* data) {
-    const ConnectionData* connData = static_cast<const ConnectionData*>(data);
-    forward_data(connData);
+    const std::unique_ptr<ConnectionData> connData(static_cast<ConnectionData*>(data));
+    forward_data(connData.get());
 
     return 0;
 }
 
-void forward_data(_In_ const ConnectionData* connData) {
+// fuzzing only happens in some instances
+bool ShouldFuzz(_In_ const ConnectionData* connData) noexcept {
+    return (connData->fuzz_dir == 'b')
+        || (connData->sock_dir == SocketDir::ServerToClient && connData->fuzz_dir == 'c')
+        || (connData->sock_dir == SocketDir::ClientToServer && connData->fuzz_dir == 's');
+}
 
-    bool bFuzz = false;
+// seeded sessions start the direction's generator from its seed and open its capture file
+void OpenCapture(_Inout_ ConnectionData* connData) {
+    connData->rng.seed(connData->seed);
 
-    // fuzzing only happens in some instances
-    if ((connData->fuzz_dir == 'b')
-        || (connData->sock_dir == SocketDir::ServerToClient && connData->fuzz_dir == 'c')
-        || (connData->sock_dir == SocketDir::ClientToServer && connData->fuzz_dir == 's'))
-        bFuzz = true;
+    // the weights are pinned too, so a reload or new boosts don't change the picks partway through
+    connData->schedule = PublishedSchedule();
+
+    const bool c2s = connData->sock_dir == SocketDir::ClientToServer;
+    const auto path = std::format("{}\\{:016x}-{:06}-{}.cap", 
+        CAPTURE_DIR, gOptions.seed, connData->conn_id, c2s ? "c2s" : "s2c");
+
+    if (fopen_s(&connData->capture, path.c_str(), "wb") != 0 || connData->capture == nullptr) {
+        fprintf(stderr, "Unable to open capture file %s\n", path.c_str());
+        connData->capture = nullptr;
+        return;
+    }
+
+    CaptureHeader header{};
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.seed = connData->seed;
+    header.conn_id = connData->conn_id;
+    header.sock_dir = static_cast<uint32_t>(connData->sock_dir);
+    header.fuzz_type = static_cast<uint32_t>(connData->fuzz_type);
+    header.fuzz_aggr = connData->fuzz_aggr;
+    header.offset = connData->offset;
+    const MutationWeights& weights = connData->schedule->weights[ScheduleFuzzType(static_cast<unsigned int>(connData->fuzz_type))];
+    std::copy(weights.begin(), weights.end(), std::begin(header.weights));
+    WriteCaptureHeader(connData->capture, header);
+}
 
-#ifdef _DEBUG
-    gLog.Log(0,true, std::format("Thread: {0}, SockDir:{1}, FuzzDir:{2}", 
-        bFuzz, 
-        static_cast<int>(connData->sock_dir), 
-        connData->fuzz_dir));
-#endif
+void BeginForwarding(_Inout_ ConnectionData* connData, bool bFuzz) {
+    if (gLog.Enabled())
+        gLog.Log(0,true, std::format("Thread: {0}, SockDir:{1}, FuzzDir:{2}", 
+            bFuzz, 
+            static_cast<int>(connData->sock_dir), 
+            connData->fuzz_dir));
+
+    if (gEvents.IsOpen()) {
+        EventRecord record{};
+        record.type = static_cast<uint8_t>(EventType::ConnOpen);
+        record.dir = static_cast<uint8_t>(connData->sock_dir);
+        record.conn_id = connData->conn_id;
+        record.open.seed = gOptions.seeded ? connData->seed : 0;
+        record.open.fuzz_type = static_cast<uint32_t>(connData->fuzz_type);
+        record.open.fuzz_aggr = connData->fuzz_aggr;
+        record.open.offset = connData->offset;
+        record.open.fuzzed = bFuzz ? 1 : 0;
+        gEvents.Write(record);
+    }
+
+    if (bFuzz && gOptions.seeded)
+        OpenCapture(connData);
+
+    if (gOptions.quiet)
+        return;
 
     auto currTime = getCurrentTimeAsString();
     auto ctime = currTime.c_str();
-    fprintf(stderr, "%s\t", ctime);
 
-    int bytes_received{};
-    std::vector<char> buffer(BUFFER_SIZE);
+    if (bFuzz && gOptions.seeded) {
+        fprintf(stderr, "%s\tConn:%llu %s Seed:0x%016llx\t", ctime, 
+            static_cast<unsigned long long>(connData->conn_id),
+            connData->sock_dir == SocketDir::ClientToServer ? "c->s" : "s->c",
+            static_cast<unsigned long long>(connData->seed));
+    } else {
+        fprintf(stderr, "%s\t", ctime);
+    }
+}
 
-    // the recv() can be from the client or the server, this code is called on one of two threads
-    while ((bytes_received = recv(connData->src_sock, buffer.data(), BUFFER_SIZE, 0)) > 0) {
-        buffer.resize(bytes_received);
+// continues a CRC over a chunk that may be in pieces
+uint32_t OutputCrc(uint32_t crc, const FuzzOutput& output) noexcept {
+    for (const auto& piece : output.Pieces())
+        crc = gCrc32.update(crc, piece);
 
-#ifdef _DEBUG
+    return crc;
+}
+
+void RecordChunk(_In_ const ConnectionData* connData, EventType type, size_t size, uint32_t crc) {
+    EventRecord record{};
+    record.type = static_cast<uint8_t>(type);
+    record.dir = static_cast<uint8_t>(connData->sock_dir);
+    record.conn_id = connData->conn_id;
+    record.size = gsl::narrow_cast<uint32_t>(size);
+    record.chunk.crc = crc;
+    gEvents.Write(record);
+}
+
+// called for every block of data read, regardless of the engine
+void ProcessChunk(_Inout_ ConnectionData* connData, bool bFuzz, std::vector<char>& buffer, FuzzInsert& insert, bool bWhole) {
+
+    if (gLog.Enabled()) {
         auto crc32r = gCrc32.calc(buffer);
-        gLog.Log(0,false, std::format("recv() {0} bytes, CRC32: 0x{1:X}", bytes_received, crc32r));
-#endif
+        gLog.Log(0,false, std::format("recv() {0} bytes, CRC32: 0x{1:X}", buffer.size(), crc32r));
+    }
+
+    if (bFuzz && gOptions.crc)
+        connData->crc_in = gCrc32.update(connData->crc_in, buffer);
+
+    if (gEvents.IsOpen())
+        RecordChunk(connData, EventType::Recv, buffer.size(), gCrc32.calc(buffer));
+
+    // what the server said, before it's fuzzed on its way to the client
+    NoteServerRead(connData, buffer);
+
+    // mutations are recorded against this connection while Fuzz() runs
+    const ScopedFuzzEvents scopedEvents(gEvents, connData->conn_id, static_cast<uint8_t>(connData->sock_dir));
+    insert.length = 0;
+
+    // a piece that's passed through isn't captured either, a replay would fuzz it
+    const bool bMutate = bFuzz && bWhole;
+    const size_t capacity = buffer.capacity();
+    if (bMutate && gOptions.seeded) {
+        // the input is captured before Fuzz() touches it, and the output CRC lets a replay check itself
+        if (connData->capture)
+            WriteCaptureInput(connData->capture, buffer);
+
+        {
+            const ScopedFuzzRng scopedRng(connData->rng);
+            const ScopedSchedule scopedSchedule(*connData->schedule);
+            Fuzz(buffer, insert, connData->fuzz_aggr, connData->fuzz_type, connData->offset);
+        }
+    } else if (bMutate) {
+        Fuzz(buffer, insert, connData->fuzz_aggr, connData->fuzz_type, connData->offset);
+    }
+
+    // a pooled buffer has room for anything Truncate adds, so this only counts buffers from elsewhere
+    if (buffer.capacity() != capacity)
+        CountStat(StatCounter::BufferRegrows);
+
+    // the server's next answer is down to what this chunk had done to it
+    if (connData->novelty && connData->sock_dir == SocketDir::ClientToServer)
+        connData->novelty->OnRequest(bMutate ? LastFuzzMutations() : 0);
+
+    // what's sent, with anything Grow added spliced in
+    const FuzzOutput output(buffer, insert);
+
+    if (bMutate && gOptions.seeded && connData->capture)
+        WriteCaptureOutputCrc(connData->capture, OutputCrc(0, output));
+
+    if (bFuzz && gOptions.crc)
+        connData->crc_out = OutputCrc(connData->crc_out, output);
+
+    if (gEvents.IsOpen())
+        RecordChunk(connData, EventType::Send, output.Size(), OutputCrc(0, output));
+
+    if (gLog.Enabled()) {
+        auto crc32s = OutputCrc(0, output);
+        gLog.Log(0, false,std::format("send() {0} bytes, CRC32: 0x{1:X}", output.Size(), crc32s));
+    }
+}
+
+void NoteServerRead(_In_ const ConnectionData* connData, gsl::span<const char> data) {
+    if (connData->novelty && connData->sock_dir == SocketDir::ServerToClient)
+        connData->novelty->OnResponse(data);
+}
+
+void NoteServerEnd(_In_ const ConnectionData* connData, int error) {
+    if (!connData->novelty || connData->sock_dir != SocketDir::ServerToClient)
+        return;
+
+    // any other error is the proxy closing the socket under the read once the client has gone
+    if (error == 0)
+        connData->novelty->OnEnd(ResponseKind::Close);
+    else if (error == WSAECONNRESET)
+        connData->novelty->OnEnd(ResponseKind::Reset);
+}
+
+ULONG GatherOutput(const FuzzOutput& output, size_t from, std::array<WSABUF, 3>& bufs) noexcept {
+    ULONG count = 0;
+    for (const auto& piece : output.Pieces()) {
+        if (from >= piece.size()) {
+            from -= piece.size();
+            continue;
+        }
+
+        // WSABUF isn't const, but WSASend() only reads through it
+        bufs[count].buf = const_cast<char*>(piece.data() + from);
+        bufs[count].len = gsl::narrow_cast<ULONG>(piece.size() - from);
+        count++;
+        from = 0;
+    }
+
+    return count;
+}
+
+void EndForwarding(_Inout_ ConnectionData* connData, bool bFuzz, uint64_t bytes) {
+    CountStat(StatCounter::DirectionsClosed);
+
+    if (gLog.Enabled())
+        gLog.Log(0, true, std::format("Done: SockDir:{0}, {1} bytes forwarded", 
+            static_cast<int>(connData->sock_dir), 
+            bytes));
+
+    if (gEvents.IsOpen()) {
+        EventRecord record{};
+        record.type = static_cast<uint8_t>(EventType::ConnClose);
+        record.dir = static_cast<uint8_t>(connData->sock_dir);
+        record.conn_id = connData->conn_id;
+        record.close.bytes = bytes;
+        record.close.crc_in = connData->crc_in;
+        record.close.crc_out = connData->crc_out;
+        gEvents.Write(record);
+    }
+
+    if (connData->capture) {
+        fclose(connData->capture);
+        connData->capture = nullptr;
+    }
+
+    if (gOptions.quiet)
+        return;
+
+    if (bFuzz && gOptions.crc)
+        fprintf(stderr, " CRC32 in:0x%08X out:0x%08X", connData->crc_in, connData->crc_out);
+
+    if (bFuzz) 
+        fprintf(stderr, "\n");
+}
+
+// waits up to ms for sock to have something to read, returns false if it didn't
+bool wait_readable(SOCKET sock, unsigned int ms) noexcept {
+    fd_set readable{};
+    FD_ZERO(&readable);
+    FD_SET(sock, &readable);
+
+    timeval idle{ static_cast<long>(ms / 1000), static_cast<long>((ms % 1000) * 1000) };
+    return select(0, &readable, NULL, NULL, &idle) != 0;
+}
+
+// recv()s the next chunk into buffer, which is refitted and resized to the direction's size first
+// a direction whose buffer has grown only blocks for BUFFER_IDLE_MS before dropping back to -buffer,
+// so an idle connection doesn't sit on the memory. After a full read there's more waiting, so the select()
+// is only paid for once a read has caught up, the socket can't be made non-blocking for a recv() as the
+// other direction's thread sends on it
+int recv_chunk(_In_ const ConnectionData* connData, BufferSizer& sizer, std::vector<char>& buffer) {
+    if (sizer.Grown() && !sizer.LastReadFull() && !wait_readable(connData->src_sock, BUFFER_IDLE_MS))
+        sizer.Shrink();
+
+    gBuffers.Refit(buffer, sizer.Size());
+    if (buffer.size() != sizer.Size())
+        buffer.resize(sizer.Size());
+
+    const int bytes_received = recv(connData->src_sock, buffer.data(), gsl::narrow_cast<int>(buffer.size()), 0);
+    if (bytes_received > 0)
+        sizer.OnRead(bytes_received);
+
+    return bytes_received;
+}
+
+// sends a fuzzed chunk, anything Grow inserted goes out between the two halves of the buffer in the same call,
+// and like send() it can take less than all of it, so it loops until it's all gone
+// returns false if the send failed
+bool send_output(_In_ const ConnectionData* connData, const FuzzOutput& output, std::array<WSABUF, 3>& bufs, uint64_t& total) {
+    const auto started = StatClock::now();
+    size_t bytes_sent{};
+    while (bytes_sent < output.Size()) {
+        DWORD sent{};
+        if (WSASend(connData->dst_sock, bufs.data(), GatherOutput(output, bytes_sent, bufs), &sent, 0, NULL, NULL) == SOCKET_ERROR)
+            break;
+
+        bytes_sent += sent;
+    }
+
+    CountSendWait(started);
+    total += bytes_sent;
+    CountStat(BytesOutCounter(static_cast<size_t>(connData->sock_dir)), bytes_sent);
+
+    return bytes_sent == output.Size();
+}
+
+// Windows has no splice(), so the closest we can get for directions that are not fuzzed
+// is to recv() into a buffer and send() straight from it: the buffer is only resized when
+// the direction's size changes (which zero-fills), no fuzzing and no per-chunk logging
+// returns the number of bytes forwarded
+uint64_t forward_passthrough(_In_ const ConnectionData* connData) {
+    BufferSizer sizer{};
+    std::vector<char> buffer = gBuffers.Acquire(sizer.Size());
+    uint64_t total{};
+    const size_t dir = static_cast<size_t>(connData->sock_dir);
+    const StatHistogram latency = ChunkLatencyHistogram(dir, StatFuzzMode(false, connData->fuzz_type));
+
+    int bytes_received{};
+    bool sending = true;
+    while ((bytes_received = recv_chunk(connData, sizer, buffer)) > 0) {
+        const auto received = StatClock::now();
+        CountStat(BytesInCounter(dir), bytes_received);
+        NoteServerRead(connData, gsl::span<const char>(buffer.data(), bytes_received));
+
+        // send() can accept less than asked for, so loop until it's all gone
+        const auto started = StatClock::now();
+        int bytes_sent{};
+        while (bytes_sent < bytes_received) {
+            const int sent = send(connData->dst_sock, buffer.data() + bytes_sent, bytes_received - bytes_sent, 0);
+            if (sent == SOCKET_ERROR) {
+                sending = false;
+                break;
+            }
+
+            bytes_sent += sent;
+        }
+
+        CountSendWait(started);
+
+        if (!sending)
+            break;
+
+        total += bytes_received;
+        CountStat(BytesOutCounter(dir), bytes_received);
+        RecordLatencySince(latency, received);
+    }
+
+    if (bytes_received <= 0)
+        NoteServerEnd(connData, bytes_received == 0 ? 0 : WSAGetLastError());
+
+    gBuffers.Release(std::move(buffer));
 
-        if (bFuzz)
-            Fuzz(buffer, connData->fuzz_aggr, connData->fuzz_type, connData->offset);
+    return total;
+}
+
+// a fuzzed direction with -frame, reads go into the framer and each piece it hands back is processed and sent,
+// so a message is fuzzed whole however it was split, see Framer.h
+// returns the number of bytes forwarded
+uint64_t forward_frames(_Inout_ ConnectionData* connData) {
+    BufferSizer sizer{};
+    Framer framer(gOptions.frame);
+    std::vector<char> buffer = gBuffers.Acquire(sizer.Size());
+    FuzzInsert insert{};
+    std::array<WSABUF, 3> bufs{};
+    uint64_t total{};
+    const size_t dir = static_cast<size_t>(connData->sock_dir);
+    const StatHistogram latency = ChunkLatencyHistogram(dir, StatFuzzMode(true, connData->fuzz_type));
+    auto received = StatClock::now();
+
+    bool open = true;
+    while (true) {
+        // each piece is copied into buffer, which keeps its capacity from one piece to the next
+        bool sending = true;
+        while (sending && framer.Ready()) {
+            const bool whole = framer.Next(buffer);
+            ProcessChunk(connData, true, buffer, insert, whole);
+            sending = send_output(connData, FuzzOutput(buffer, insert), bufs, total);
+            RecordLatencySince(latency, received);
+        }
 
-        const auto bytes_to_send = gsl::narrow_cast<int>(buffer.size());
+        if (!sending || !open)
+            break;
 
-#ifdef _DEBUG
-        auto crc32s = gCrc32.calc(buffer);
-        gLog.Log(0, false,std::format("send() {0} bytes, CRC32: 0x{1:X}", bytes_to_send, crc32s));
-#endif
+        // part of a message that's been waited on for long enough goes as it is
+        if (framer.Holding()) {
+            if (!wait_readable(connData->src_sock, FRAME_IDLE_MS)) {
+                framer.Flush();
+                continue;
+            }
+        } else if (sizer.Grown() && !sizer.LastReadFull() && !wait_readable(connData->src_sock, BUFFER_IDLE_MS)) {
+            sizer.Shrink();
+        }
 
-        send(connData->dst_sock, buffer.data(), bytes_to_send, 0);
+        const gsl::span<char> space = framer.ReadSpace(sizer.Size());
+        const int bytes_received = recv(connData->src_sock, space.data(), gsl::narrow_cast<int>(space.size()), 0);
+        if (bytes_received <= 0) {
+            NoteServerEnd(connData, bytes_received == 0 ? 0 : WSAGetLastError());
 
-        buffer.resize(BUFFER_SIZE);
+            // what's held of a last message still goes, once
+            framer.Commit(0);
+            framer.Flush();
+            open = false;
+            continue;
+        }
+
+        received = StatClock::now();
+        sizer.OnRead(bytes_received);
+        CountStat(BytesInCounter(dir), bytes_received);
+        framer.Commit(bytes_received);
+    }
+
+    gBuffers.Release(std::move(buffer));
+    gBuffers.Release(framer.Release());
+
+    return total;
+}
+
+void forward_data(_Inout_ ConnectionData* connData) {
+
+    const bool bFuzz = ShouldFuzz(connData);
+    BeginForwarding(connData, bFuzz);
+
+    // a blocking send() is this engine's backpressure, so the socket's send buffer is the direction's queue
+    // setting its size turns off Windows' send buffer autotuning, so it's only done when asked for
+    if (gOptions.send_queue_set) {
+        const int send_queue = gsl::narrow_cast<int>(gOptions.send_queue);
+        if (setsockopt(connData->dst_sock, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&send_queue), sizeof(send_queue)) == SOCKET_ERROR)
+            fprintf(stderr, "setsockopt(SO_SNDBUF) failed. Error: %d\n", WSAGetLastError());
+    }
+
+    uint64_t total{};
+
+    if (bFuzz && gOptions.frame.kind != FrameKind::None) {
+        total = forward_frames(connData);
+    } else if (bFuzz) {
+        int bytes_received{};
+        BufferSizer sizer{};
+        std::vector<char> buffer = gBuffers.Acquire(sizer.Size());
+        std::vector<char> chunk = gBuffers.Acquire(sizer.Size());
+        FuzzInsert insert{};
+        std::array<WSABUF, 3> bufs{};
+        const size_t dir = static_cast<size_t>(connData->sock_dir);
+        const StatHistogram latency = ChunkLatencyHistogram(dir, StatFuzzMode(bFuzz, connData->fuzz_type));
+
+        // the recv() can be from the client or the server, this code is called on one of two threads
+        // a full read is fuzzed where it is, a short one is copied to chunk, so buffer keeps its size for
+        // the next recv() rather than being cut to the read and zero-filled back out
+        while ((bytes_received = recv_chunk(connData, sizer, buffer)) > 0) {
+            const auto received = StatClock::now();
+            CountStat(BytesInCounter(dir), bytes_received);
+
+            std::vector<char>* data = &buffer;
+            if (static_cast<size_t>(bytes_received) < buffer.size()) {
+                gBuffers.Refit(chunk, sizer.Size());
+                chunk.assign(buffer.begin(), buffer.begin() + bytes_received);
+                data = &chunk;
+            }
+
+            ProcessChunk(connData, bFuzz, *data, insert);
+
+            if (!send_output(connData, FuzzOutput(*data, insert), bufs, total))
+                break;
+
+            RecordLatencySince(latency, received);
+        }
+
+        if (bytes_received <= 0)
+            NoteServerEnd(connData, bytes_received == 0 ? 0 : WSAGetLastError());
+
+        gBuffers.Release(std::move(buffer));
+        gBuffers.Release(std::move(chunk));
+    } else {
+        total = forward_passthrough(connData);
     }
 
     // Clean up the sockets once we're done forwarding
     closesocket(connData->src_sock);
     closesocket(connData->dst_sock);
 
-    if (bFuzz) 
-        fprintf(stderr, "\n");
+    EndForwarding(connData, bFuzz, total);
 }
 
 #pragma endregion Threading Code
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <winsock2.h>
+
+// A loopback UDP socket that sends to itself
+// Winsock has no eventfd or pipe that WSAPoll() can wait on, so a thread blocked in WSAPoll()
+// includes this socket in its poll set and other threads call Wake() to break it out
+class WakeSocket {
+public:
+    WakeSocket() = default;
+
+    ~WakeSocket() {
+        if (_sock != INVALID_SOCKET)
+            closesocket(_sock);
+    }
+
+    bool Init() noexcept {
+        _sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (_sock == INVALID_SOCKET)
+            return false;
+
+        _addr.sin_family = AF_INET;
+        _addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        _addr.sin_port = 0;
+
+        int len = sizeof(_addr);
+        if (bind(_sock, reinterpret_cast<SOCKADDR*>(&_addr), len) == SOCKET_ERROR ||
+            getsockname(_sock, reinterpret_cast<SOCKADDR*>(&_addr), &len) == SOCKET_ERROR)
+            return false;
+
+        u_long nonBlocking = 1;
+        return ioctlsocket(_sock, FIONBIO, &nonBlocking) != SOCKET_ERROR;
+    }
+
+    // can be called from any thread
+    void Wake() noexcept {
+        constexpr char ping = 0;
+        sendto(_sock, &ping, 1, 0, reinterpret_cast<const SOCKADDR*>(&_addr), sizeof(_addr));
+    }
+
+    // called by the polling thread once it's awake
+    void Drain() noexcept {
+        char drain[64]{};
+        while (recv(_sock, drain, sizeof(drain), 0) > 0)
+            ;
+    }
+
+    SOCKET Socket() const noexcept {
+        return _sock;
+    }
+
+    WakeSocket(const WakeSocket&) = delete;
+    WakeSocket(WakeSocket&&) = delete;
+    WakeSocket& operator=(const WakeSocket&) = delete;
+    WakeSocket& operator=(WakeSocket&&) = delete;
+
+private:
+    SOCKET          _sock{ INVALID_SOCKET };
+    SOCKADDR_IN     _addr{};
+};
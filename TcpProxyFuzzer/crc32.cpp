@@ -0,0 +1,234 @@
+// CRC-32 implementations, see crc32.h
+// All of them work on the inverted running value, update() does the inversion once either side.
+
+#include <intrin.h>
+#include <cstring>
+#include <array>
+
+#include "crc32.h"
+#include "CpuFeatures.h"
+
+#ifdef _M_ARM64
+#include <windows.h>
+#endif
+
+namespace {
+
+    constexpr uint32_t POLY = 0xEDB88320;
+
+    // table k gives the CRC of a byte followed by k zero bytes, table 0 is the classic one
+    using SliceTables = std::array<std::array<uint32_t, 256>, 8>;
+
+    constexpr SliceTables MakeTables() noexcept {
+        SliceTables t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; j++)
+                crc = (crc & 1) ? (crc >> 1) ^ POLY : crc >> 1;
+
+            t[0][i] = crc;
+        }
+
+        for (size_t k = 1; k < t.size(); k++)
+            for (size_t i = 0; i < 256; i++)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+
+        return t;
+    }
+
+    constexpr SliceTables tables = MakeTables();
+
+    uint32_t Bytewise(uint32_t crc, const unsigned char* p, size_t n) noexcept {
+        while (n--)
+            crc = (crc >> 8) ^ tables[0][(crc ^ *p++) & 0xFF];
+
+        return crc;
+    }
+
+    uint32_t Slicing8(uint32_t crc, const unsigned char* p, size_t n) noexcept {
+        for (; n >= 8; n -= 8, p += 8) {
+            uint32_t lo{}, hi{};
+            memcpy(&lo, p, sizeof(lo));
+            memcpy(&hi, p + 4, sizeof(hi));
+            lo ^= crc;
+
+            crc = tables[7][lo & 0xFF] ^ tables[6][(lo >> 8) & 0xFF] ^
+                  tables[5][(lo >> 16) & 0xFF] ^ tables[4][lo >> 24] ^
+                  tables[3][hi & 0xFF] ^ tables[2][(hi >> 8) & 0xFF] ^
+                  tables[1][(hi >> 16) & 0xFF] ^ tables[0][hi >> 24];
+        }
+
+        return Bytewise(crc, p, n);
+    }
+
+#if defined(_M_X64) || defined(_M_IX86)
+
+    // Folding with carry-less multiplies, after Gopal et al, "Fast CRC Computation for Generic
+    // Polynomials Using PCLMULQDQ Instruction" (Intel, 2009), in the bit-reflected form zlib uses
+    // Four 128-bit lanes are folded forward 64 bytes at a time, then folded into one lane,
+    // then reduced to 64 and 32 bits and finished with a Barrett reduction.
+    // n must be at least 64 and a multiple of 16
+    uint32_t ClmulFold(uint32_t crc, const unsigned char* p, size_t n) noexcept {
+        alignas(16) static constexpr uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+        alignas(16) static constexpr uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+        alignas(16) static constexpr uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+        alignas(16) static constexpr uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+        auto load = [](const unsigned char* at) noexcept {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(at));
+        };
+
+        // fold x by 128 bits with k and add in the next block
+        auto fold = [](__m128i x, __m128i k, __m128i next) noexcept {
+            const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+            const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+            return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+        };
+
+        __m128i x1 = _mm_xor_si128(load(p), _mm_cvtsi32_si128(static_cast<int>(crc)));
+        __m128i x2 = load(p + 0x10);
+        __m128i x3 = load(p + 0x20);
+        __m128i x4 = load(p + 0x30);
+        p += 64;
+        n -= 64;
+
+        __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+        for (; n >= 64; n -= 64, p += 64) {
+            x1 = fold(x1, k, load(p));
+            x2 = fold(x2, k, load(p + 0x10));
+            x3 = fold(x3, k, load(p + 0x20));
+            x4 = fold(x4, k, load(p + 0x30));
+        }
+
+        k = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+        x1 = fold(x1, k, x2);
+        x1 = fold(x1, k, x3);
+        x1 = fold(x1, k, x4);
+
+        for (; n >= 16; n -= 16, p += 16)
+            x1 = fold(x1, k, load(p));
+
+        // 128 bits down to 64
+        const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+        __m128i x2r = _mm_clmulepi64_si128(x1, k, 0x10);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2r);
+
+        k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+        x2r = _mm_srli_si128(x1, 4);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, low32), k, 0x00), x2r);
+
+        // Barrett reduction to 32 bits
+        k = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+        x2r = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), k, 0x10);
+        x2r = _mm_clmulepi64_si128(_mm_and_si128(x2r, low32), k, 0x00);
+        x1 = _mm_xor_si128(x1, x2r);
+
+        return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+    }
+
+    uint32_t Clmul(uint32_t crc, const unsigned char* p, size_t n) noexcept {
+        if (n >= 64) {
+            const size_t folded = n & ~static_cast<size_t>(15);
+            crc = ClmulFold(crc, p, folded);
+            p += folded;
+            n -= folded;
+        }
+
+        return Slicing8(crc, p, n);
+    }
+
+#endif
+
+#ifdef _M_ARM64
+
+    uint32_t Armv8(uint32_t crc, const unsigned char* p, size_t n) noexcept {
+        for (; n >= 8; n -= 8, p += 8) {
+            uint64_t v{};
+            memcpy(&v, p, sizeof(v));
+            crc = __crc32d(crc, v);
+        }
+
+        while (n--)
+            crc = __crc32b(crc, *p++);
+
+        return crc;
+    }
+
+#endif
+
+    using CrcFn = uint32_t(*)(uint32_t, const unsigned char*, size_t) noexcept;
+
+    // nullptr if this CPU can't run it
+    CrcFn Detect(crc32::Impl impl) noexcept {
+        switch (impl) {
+            case crc32::Impl::Bytewise:
+                return Bytewise;
+
+            case crc32::Impl::Slicing8:
+                return Slicing8;
+
+#if defined(_M_X64) || defined(_M_IX86)
+            case crc32::Impl::Clmul:
+                return CpuHasPclmul() ? Clmul : nullptr;
+#endif
+
+#ifdef _M_ARM64
+            case crc32::Impl::Armv8:
+                return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE) ? Armv8 : nullptr;
+#endif
+
+            default:
+                return nullptr;
+        }
+    }
+
+    // cpuid is slow, a VM can trap it, so the answers are worked out once
+    CrcFn Lookup(crc32::Impl impl) noexcept {
+        static const CrcFn found[] = {
+            Detect(crc32::Impl::Bytewise), Detect(crc32::Impl::Slicing8),
+            Detect(crc32::Impl::Clmul), Detect(crc32::Impl::Armv8)
+        };
+
+        const auto i = static_cast<size_t>(impl);
+        return i < std::size(found) ? found[i] : nullptr;
+    }
+
+    const unsigned char* Bytes(gsl::span<const char> buf) noexcept {
+        return reinterpret_cast<const unsigned char*>(buf.data());
+    }
+}
+
+crc32::Impl crc32::Best() noexcept {
+    if (Lookup(Impl::Clmul))
+        return Impl::Clmul;
+
+    if (Lookup(Impl::Armv8))
+        return Impl::Armv8;
+
+    return Impl::Slicing8;
+}
+
+const char* crc32::Name(Impl impl) noexcept {
+    switch (impl) {
+        case Impl::Bytewise:    return "bytewise";
+        case Impl::Slicing8:    return "slicing-by-8";
+        case Impl::Clmul:       return "pclmulqdq";
+        case Impl::Armv8:       return "armv8-crc32";
+        default:                return "unknown";
+    }
+}
+
+uint32_t crc32::update(uint32_t crc, gsl::span<const char> buf) const noexcept {
+    static const CrcFn best = Lookup(Best());
+
+    return ~best(~crc, Bytes(buf), buf.size());
+}
+
+bool crc32::update(Impl impl, uint32_t& crc, gsl::span<const char> buf) noexcept {
+    const CrcFn fn = Lookup(impl);
+    if (fn == nullptr)
+        return false;
+
+    crc = ~fn(~crc, Bytes(buf), buf.size());
+    return true;
+}
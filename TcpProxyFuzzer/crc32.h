@@ -1,36 +1,32 @@
 #pragma once
 #include <stdint.h>
+#include "gsl/span"
 
+// CRC-32 as used by zip, png and Ethernet (reflected 0x04C11DB7, inverted in and out)
+// The work is done by the fastest implementation the CPU supports, picked on first use:
+// carry-less multiply folding on x86 (PCLMULQDQ), the CRC32 instructions on ARMv8,
+// and slicing-by-8 tables everywhere else. Any contiguous range of chars converts to the span.
 class crc32 {
 public:
-    crc32() noexcept {
-        uint32_t crc{};
-        for (uint32_t i = 0; i < 256; i++) {
-            crc = i;
-            for (uint32_t j = 8; j > 0; j--) {
-                if (crc & 1) {
-                    crc = (crc >> 1) ^ 0xEDB88320;
-                }
-                else {
-                    crc >>= 1;
-                }
-            }
+    enum class Impl {
+        Bytewise = 0,   // one table lookup per byte, the reference
+        Slicing8 = 1,   // eight table lookups per 8 bytes
+        Clmul = 2,      // 64 bytes per step folded with PCLMULQDQ, x86 only
+        Armv8 = 3       // __crc32d, ARM64 only
+    };
 
-            gsl::at(_crc_table, i) = crc;
-        }
+    crc32() noexcept = default;
+
+    uint32_t calc(gsl::span<const char> buf) const noexcept {
+        return update(0, buf);
     }
 
-    uint32_t calc(const std::vector<char>& buf) const {
-        if (buf.empty()) return 0;
+    // continues a CRC over more data, so update(update(0, a), b) == calc(a followed by b)
+    uint32_t update(uint32_t crc, gsl::span<const char> buf) const noexcept;
 
-        uint32_t crc = 0xFFFFFFFF;
-        for (const auto& byte : buf) { 
-            const uint8_t index = gsl::narrow_cast<uint8_t>(crc ^ static_cast<uint8_t>(byte));
-            crc = (crc >> 8) ^ gsl::at(_crc_table, index);
-        }
-        return ~crc;
-    }
+    // a specific implementation, for the benchmark, returns false if this CPU can't run it
+    static bool update(Impl impl, uint32_t& crc, gsl::span<const char> buf) noexcept;
 
-private: 
-    uint32_t _crc_table[256]{};
-};
\ No newline at end of file
+    static Impl Best() noexcept;
+    static const char* Name(Impl impl) noexcept;
+};
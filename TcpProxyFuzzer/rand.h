@@ -3,39 +3,131 @@
 
 #include <random>
 #include <algorithm>
-#include "gsl/util" 
+#include <cstdint>
+#include <cstring>
+#include "gsl/util"
+
+// splitmix64, advances state and returns the next output
+// used to expand a seed into xoshiro state and to derive per-connection seeds from a master seed
+inline uint64_t SplitMix64(uint64_t& state) noexcept {
+    state += 0x9E3779B97F4A7C15ull;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256** by Blackman and Vigna, https://prng.di.unimi.it/
+// 32 bytes of state and a handful of ALU ops per 64-bit output, it satisfies
+// UniformRandomBitGenerator so it can drive the std:: distributions too
+class Xoshiro256 {
+public:
+    using result_type = uint64_t;
+
+    explicit Xoshiro256(uint64_t seed) noexcept {
+        reseed(seed);
+    }
+
+    // the state is filled from splitmix64, as recommended by the authors,
+    // so that any seed (including 0) gives a well-mixed state
+    void reseed(uint64_t seed) noexcept {
+        for (auto& word : s)
+            word = SplitMix64(seed);
+    }
+
+    result_type operator()() noexcept {
+        const uint64_t result = rotl(s[1] * 5, 7) * 9;
+        const uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+    // (min) and (max) are in parens to dodge the windows.h macros
+    static constexpr result_type (min)() noexcept { return 0; }
+    static constexpr result_type (max)() noexcept { return UINT64_MAX; }
+
+private:
+    static constexpr uint64_t rotl(const uint64_t x, int k) noexcept {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t s[4]{};
+};
 
 // High-level RNG wrapper class
-// Uses the Mersenne Twister engine and provides various rng distributions
+// Uses the xoshiro256** engine and provides various rng distributions
+// This is not thread-safe, declare instances thread_local, see Fuzz.cpp
 class RandomNumberGenerator {
 public:
     RandomNumberGenerator()
-        : gen(rd()), dist(0, std::numeric_limits<unsigned int>::max()) {
+        : gen(RandomSeed()) {
+    }
+
+    // the same seed always gives the same sequence, this is what makes seeded sessions replayable
+    explicit RandomNumberGenerator(uint64_t value) noexcept
+        : gen(value) {
+    }
+
+    void seed(uint64_t value) noexcept {
+        gen.reseed(value);
+        range(0, UINT32_MAX);
+    }
+
+    // a 64-bit seed from the OS
+    static uint64_t RandomSeed() {
+        std::random_device rd;
+        return rd() | (static_cast<uint64_t>(rd()) << 32);
     }
 
     // Generate a random number in the current range
-    auto generate() {
-        return dist(gen);
+    // Uses Lemire's multiply-shift method, which is unbiased and only divides when
+    // a sample lands in the small rejection zone, https://arxiv.org/abs/1805.10941
+    unsigned int generate() noexcept {
+        return _min + bounded(_span);
     }
 
     // Generate a random number in a specific percentage range (0-100)
-    auto generatePercent() {
+    auto generatePercent() noexcept {
         return generateInRange(0, 100);
     }
 
     // Generate a random small integer (0-256)
-    auto generateSmallInt() {
+    auto generateSmallInt() noexcept {
         return generateInRange(0, 256);
     }
 
     // Generate a random character
-    auto generateChar() {
-        return gsl::narrow_cast<unsigned char>(generateInRange(0, 256));
+    // the top byte of a 64-bit output is uniform, so no range reduction is needed
+    auto generateChar() noexcept {
+        return gsl::narrow_cast<unsigned char>(gen() >> 56);
+    }
+
+    // Fill dst with random bytes, 8 per engine output, for mutations that need a lot of them
+    // a partial last output is dropped, so n bytes always use (n + 7) / 8 outputs
+    void fill(unsigned char* dst, size_t n) noexcept {
+        for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t), dst += sizeof(uint64_t)) {
+            const uint64_t r = gen();
+            memcpy(dst, &r, sizeof(r));
+        }
+
+        if (n) {
+            const uint64_t r = gen();
+            memcpy(dst, &r, n);
+        }
     }
 
     // Set the range for random number generation and return *this for chaining
+    // the range is [min, max), it's just two stores, nothing is rebuilt
     RandomNumberGenerator& range(unsigned int min, unsigned int max) noexcept {
-        dist.param(std::uniform_int_distribution<unsigned int>::param_type(min, max - 1));
+        _min = min;
+        _span = max > min ? max - min : 1;
         return *this;
     }
 
@@ -51,16 +143,29 @@ public:
 	}
 
 private:
-    std::random_device rd;                              // Used to obtain a seed for the random number engine
-    std::mt19937 gen;                                   // Mersenne Twister engine
-    std::uniform_int_distribution<unsigned int> dist;   // Uniform integer distribution
+    Xoshiro256      gen;
+    unsigned int    _min{ 0 };
+    unsigned int    _span{ UINT32_MAX };
+
+    // returns [0, span)
+    uint32_t bounded(uint32_t span) noexcept {
+        uint64_t m = static_cast<uint64_t>(static_cast<uint32_t>(gen() >> 32)) * span;
+        auto low = static_cast<uint32_t>(m);
+        if (low < span) {
+            const uint32_t threshold = (0u - span) % span;
+            while (low < threshold) {
+                m = static_cast<uint64_t>(static_cast<uint32_t>(gen() >> 32)) * span;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+
+        return static_cast<uint32_t>(m >> 32);
+    }
 
     // Helper method to generate a number in a specific range
-    unsigned int generateInRange(unsigned int min, unsigned int max) {
-        const std::uniform_int_distribution<unsigned int>::param_type newRange(min, max - 1);
-        dist.param(newRange);
-        return dist(gen);
+    unsigned int generateInRange(unsigned int min, unsigned int max) noexcept {
+        return min + bounded(max > min ? max - min : 1);
     }
 };
 
-#endif
\ No newline at end of file
+#endif